@@ -0,0 +1,88 @@
+// Ana Carolina dos Santos
+// Davi Galdino de Oliveira
+
+// Interface para usar o analisador dentro de outro programa, sem processo
+// separado. Compile main.c com -DANALYZER_NO_MAIN e ligue com -pthread:
+//
+//   gcc -c -DANALYZER_NO_MAIN -pthread main.c -o analyzer.o
+//
+// Cada contexto guarda todo o estado de uma análise e nada é impresso; vários
+// contextos podem ser usados ao mesmo tempo, um por thread. Os ponteiros
+// devolvidos pelas funções abaixo valem até a próxima análise no mesmo
+// contexto (ou até analyzer_destroy). O objeto só exporta estas funções.
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct AnalysisContext AnalysisContext;
+
+// Token com a sua posição no conteúdo analisado
+typedef struct AnalyzerToken {
+    // Texto do token: em analyzer_lexed_token é o texto normalizado pelo lexer
+    // (a quebra de linha aparece como "\n" escrito); no resultado da análise
+    // é o trecho do conteúdo original
+    const char *text;
+    size_t text_length;
+    int token_class;    // Classe do token; -1 quando veio só do lexer
+    const char *class_name;
+    int index;
+    int offset;         // Posição em bytes no conteúdo
+    int length;
+    int line;
+} AnalyzerToken;
+
+typedef struct AnalyzerDiagnostic {
+    const char *code;   // Código estável, como "SYN001"
+    bool is_warning;
+    int token;          // Índice do token, ou -1 quando não há um token associado
+    int offset;
+    int length;
+    int line;
+    const char *suggestion; // NULL quando não há sugestão
+    size_t suggestion_length;
+    const char *message;    // Mensagem legível, sem quebra de linha no fim
+    size_t message_length;
+} AnalyzerDiagnostic;
+
+typedef struct AnalyzerSymbol {
+    const char *name;
+    const char *kind;      // "VARIABLE", "FUNCTION" ou "PARAMETER"
+    const char *data_type; // "INTEGER", "STRING", "FLOAT", "VOID" ou "UNKNOWN"
+    int scope_level;
+    int line;
+    bool used;
+    int param_count;
+} AnalyzerSymbol;
+
+// Resultado de analyzer_analyze, percorrido com as funções analyzer_next_*
+typedef struct AnalyzerResult {
+    int token_count;
+    int error_count;
+    int warning_count;
+    AnalysisContext *ctx;
+    const char *content;
+    size_t token_cursor;
+    size_t diagnostic_cursor;
+    int symbol_cursor;
+} AnalyzerResult;
+
+AnalysisContext* analyzer_create(void);
+void analyzer_destroy(AnalysisContext *ctx);
+
+// Só a separação em tokens. Devolve a quantidade de tokens, ou -1 se o
+// conteúdo passa do limite de memória da análise.
+int analyzer_lex(AnalysisContext *ctx, const char *buffer, size_t length);
+bool analyzer_lexed_token(AnalysisContext *ctx, int index, AnalyzerToken *token);
+
+// Análise completa. Devolve 0, ou -1 se o conteúdo passa do limite de
+// memória ou uma alocação falha. `buffer` precisa continuar válido enquanto
+// o resultado é lido.
+int analyzer_analyze(AnalysisContext *ctx, const char *buffer, size_t length, AnalyzerResult *result);
+bool analyzer_next_token(AnalyzerResult *result, AnalyzerToken *token);
+bool analyzer_next_diagnostic(AnalyzerResult *result, AnalyzerDiagnostic *diagnostic);
+bool analyzer_next_symbol(AnalyzerResult *result, AnalyzerSymbol *symbol);
+
+#endif
@@ -7,11 +7,35 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <setjmp.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+#include "analyzer.h"
+
+// Tudo o que não está em analyzer.h é static: na biblioteca, só a interface
+// fica visível para o programa que a usa. Lá, o que só o programa chama
+// (lotes, pipeline, watch, daemon) fica sem uso.
+#ifdef ANALYZER_NO_MAIN
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
 #define MAX_MEMORY (2048 * 1024) // 2048 KB em bytes
 #define MAX_SYMBOLS 1000
 
-size_t memory = sizeof(memory);
-
 // Estrutura para a tabela de símbolos
 typedef enum {
     SYMBOL_VARIABLE,
@@ -33,10 +57,12 @@ typedef struct Symbol {
     DataType data_type;
     int scope_level;
     int line_declared;
-    bool is_used;
+    int token_declared;
+    int name_token; // Token do nome, que identifica a declaração em ctx->links
     int param_count;  
     char **param_names;
     DataType *param_types; 
+    int order; // Posição entre os símbolos já inseridos na tabela
     struct Symbol *next;
 } Symbol;
 
@@ -44,164 +70,1465 @@ typedef struct SymbolTable {
     Symbol *symbols[MAX_SYMBOLS];
     int count;
     int current_scope;
+    // Trilha de versões: símbolos na ordem de inserção. Como os escopos são
+    // aninhados, os símbolos do escopo atual são sempre um sufixo da trilha.
+    Symbol **trail;
+    int trail_top;
+    int trail_capacity;
+    int inserted; // Símbolos inseridos desde o início do arquivo
 } SymbolTable;
 
+// Snapshot da tabela de símbolos. Guarda apenas a versão (topo da trilha),
+// então criar um snapshot é O(1) e vários snapshots podem compartilhar a
+// mesma tabela base.
+typedef struct SymbolSnapshot {
+    int trail_top;
+    int count;
+    int current_scope;
+} SymbolSnapshot;
+
 // Estrutura para chamadas de função pendentes
 typedef struct PendingFunctionCall {
     char *function_name;
     int param_count;
     int line_number;
+    int token_index;
     struct PendingFunctionCall *next;
 } PendingFunctionCall;
 
-// Lista de chamadas pendentes
-PendingFunctionCall *pending_calls = NULL;
+// Classes de token usadas na classificação (e nos formatos de saída estruturados)
+typedef enum {
+    CLASS_NEWLINE,
+    CLASS_STRING,
+    CLASS_KEYWORD,
+    CLASS_FUNC_NAME,
+    CLASS_PARAMETER,
+    CLASS_COMMA,
+    CLASS_VARIABLE_USE,
+    CLASS_LEFT_PAREN,
+    CLASS_RIGHT_PAREN,
+    CLASS_LEFT_BRACE,
+    CLASS_SEMICOLON,
+    CLASS_PLUS,
+    CLASS_MINUS,
+    CLASS_MULTIPLY,
+    CLASS_DIVIDE,
+    CLASS_POWER,
+    CLASS_EQUALS,
+    CLASS_NOT_EQUALS,
+    CLASS_LESS,
+    CLASS_LESS_EQUAL,
+    CLASS_GREATER,
+    CLASS_GREATER_EQUAL,
+    CLASS_AND,
+    CLASS_OR,
+    CLASS_ASSIGNMENT,
+    CLASS_RIGHT_BRACE,
+    CLASS_INTEGER,
+    CLASS_LEIA_COMMAND,
+    CLASS_VARIABLE_READ,
+    CLASS_ESCREVA_COMMAND,
+    CLASS_QUOTE,
+    CLASS_VARIABLE_WRITE,
+    CLASS_STRING_TEXT,
+    CLASS_SE_COMMAND,
+    CLASS_SENAO_KEYWORD,
+    CLASS_VARIABLE_CONDITION,
+    CLASS_CONDITIONAL_CONTENT,
+    CLASS_PARA_COMMAND,
+    CLASS_MATH_OPERATOR,
+    CLASS_INCREMENT_DECREMENT,
+    CLASS_VARIABLE_LOOP,
+    CLASS_NUMBER,
+    CLASS_LOOP_CONTENT,
+    CLASS_FLOAT_TYPE,
+    CLASS_VARIABLE_DECLARATION,
+    CLASS_IDENTIFIER,
+    CLASS_INTEGER_TYPE,
+    CLASS_STRING_TYPE,
+    CLASS_FUNCTION_CALL,
+    CLASS_FUNCTION_CALL_PENDING,
+    NUM_TOKEN_CLASSES
+} TokenClass;
+
+static const char* const TOKEN_CLASS_NAMES[NUM_TOKEN_CLASSES] = {
+    [CLASS_NEWLINE] = "NEWLINE",
+    [CLASS_STRING] = "STRING",
+    [CLASS_KEYWORD] = "KEYWORD",
+    [CLASS_FUNC_NAME] = "FUNC_NAME",
+    [CLASS_PARAMETER] = "PARAMETER",
+    [CLASS_COMMA] = "COMMA",
+    [CLASS_VARIABLE_USE] = "VARIABLE (uso)",
+    [CLASS_LEFT_PAREN] = "LEFT_PAREN",
+    [CLASS_RIGHT_PAREN] = "RIGHT_PAREN",
+    [CLASS_LEFT_BRACE] = "LEFT_BRACE",
+    [CLASS_SEMICOLON] = "SEMICOLON",
+    [CLASS_PLUS] = "PLUS",
+    [CLASS_MINUS] = "MINUS",
+    [CLASS_MULTIPLY] = "MULTIPLY",
+    [CLASS_DIVIDE] = "DIVIDE",
+    [CLASS_POWER] = "POWER",
+    [CLASS_EQUALS] = "EQUALS",
+    [CLASS_NOT_EQUALS] = "NOT_EQUALS",
+    [CLASS_LESS] = "LESS",
+    [CLASS_LESS_EQUAL] = "LESS_EQUAL",
+    [CLASS_GREATER] = "GREATER",
+    [CLASS_GREATER_EQUAL] = "GREATER_EQUAL",
+    [CLASS_AND] = "AND",
+    [CLASS_OR] = "OR",
+    [CLASS_ASSIGNMENT] = "ASSIGNMENT",
+    [CLASS_RIGHT_BRACE] = "RIGHT_BRACE",
+    [CLASS_INTEGER] = "INTEGER",
+    [CLASS_LEIA_COMMAND] = "LEIA_COMMAND",
+    [CLASS_VARIABLE_READ] = "VARIABLE (leitura)",
+    [CLASS_ESCREVA_COMMAND] = "ESCREVA_COMMAND",
+    [CLASS_QUOTE] = "QUOTE",
+    [CLASS_VARIABLE_WRITE] = "VARIABLE (escrita)",
+    [CLASS_STRING_TEXT] = "STRING_TEXT",
+    [CLASS_SE_COMMAND] = "SE_COMMAND",
+    [CLASS_SENAO_KEYWORD] = "SENAO_KEYWORD",
+    [CLASS_VARIABLE_CONDITION] = "VARIABLE (condicional)",
+    [CLASS_CONDITIONAL_CONTENT] = "CONDITIONAL_CONTENT",
+    [CLASS_PARA_COMMAND] = "PARA_COMMAND",
+    [CLASS_MATH_OPERATOR] = "MATH_OPERATOR",
+    [CLASS_INCREMENT_DECREMENT] = "INCREMENT_DECREMENT",
+    [CLASS_VARIABLE_LOOP] = "VARIABLE (loop)",
+    [CLASS_NUMBER] = "NUMBER",
+    [CLASS_LOOP_CONTENT] = "LOOP_CONTENT",
+    [CLASS_FLOAT_TYPE] = "FLOAT_TYPE",
+    [CLASS_VARIABLE_DECLARATION] = "VARIABLE (declaração)",
+    [CLASS_IDENTIFIER] = "IDENTIFIER/OTHER",
+    [CLASS_INTEGER_TYPE] = "INTEGER_TYPE",
+    [CLASS_STRING_TYPE] = "STRING_TYPE",
+    [CLASS_FUNCTION_CALL] = "FUNCTION_CALL",
+    [CLASS_FUNCTION_CALL_PENDING] = "FUNCTION_CALL_PENDING",
+};
+
+// Tipo de cada token, decidido pelo texto dele assim que o lexer (ou o cache
+// de tokens) o produz. A classificação escolhe o tratamento de cada token com um switch
+// sobre o tipo, em vez de comparar o texto com cada palavra e símbolo.
+typedef enum {
+    KIND_NEWLINE,
+    KIND_QUOTED,    // Começa com aspas
+    KIND_FUNCAO,
+    KIND_PRINCIPAL,
+    KIND_SEMICOLON,
+    KIND_PLUS,
+    KIND_MINUS,
+    KIND_MULTIPLY,
+    KIND_DIVIDE,
+    KIND_POWER,
+    KIND_EQUALS,
+    KIND_NOT_EQUALS,
+    KIND_LESS,
+    KIND_LESS_EQUAL,
+    KIND_GREATER,
+    KIND_GREATER_EQUAL,
+    KIND_AND,
+    KIND_OR,
+    KIND_INVALID_OPERATOR,
+    KIND_COMMA,
+    KIND_ASSIGN,
+    KIND_LEFT_PAREN,
+    KIND_RIGHT_PAREN,
+    KIND_LEFT_BRACE,
+    KIND_RIGHT_BRACE,
+    KIND_NUMBER,    // Começa com dígito
+    KIND_LEIA,
+    KIND_ESCREVA,
+    KIND_SE,
+    KIND_PARA,
+    KIND_TYPE,      // inteiro, texto ou decimal
+    KIND_VARIABLE,
+    KIND_WORD,      // Qualquer outro texto: palavra-chave, chamada ou erro léxico
+    KIND_END        // Sentinela depois do último token
+} TokenKind;
+
+// Nós da árvore sintática montada por parse_program()
+typedef enum {
+    AST_PROGRAM,
+    AST_FUNCTION,     // funcao __nome (parâmetros) bloco
+    AST_PRINCIPAL,    // principal() bloco
+    AST_BLOCK,        // { comandos }
+    AST_DECLARATION,  // inteiro !a = 1, !b;
+    AST_READ,         // leia(...);
+    AST_WRITE,        // escreva(...);
+    AST_IF,           // se (teste) comando [senao comando]
+    AST_ELSE,
+    AST_FOR,          // para (x1; x2; x3) comando
+    AST_RETURN,
+    AST_EXPRESSION,   // Expressão usada como comando
+    AST_GROUP,        // Parênteses: argumentos, parâmetros, teste ou cabeçalho do para
+    AST_SEGMENT,      // Uma das partes do cabeçalho do para, separadas por ';'
+    AST_PARAMETER,
+    AST_ASSIGNMENT,
+    AST_BINARY,
+    AST_UNARY,
+    AST_POSTFIX,
+    AST_CALL,
+    AST_VARIABLE,
+    AST_NUMBER,
+    AST_STRING,
+    AST_NAME,
+    AST_ERROR         // Token fora da gramática; o parser segue em frente
+} AstKind;
+
+// Os nós ficam numa arena do contexto e são descartados juntos no fim de
+// cada arquivo. O operador de um nó AST_BINARY é o tipo do seu token.
+typedef struct AstNode {
+    AstKind kind;
+    int token; // Palavra-chave, operador, nome ou abertura ('(', '{', '"')
+    int end;   // Último token do nó; -1 quando o fechamento não foi encontrado
+    struct AstNode *child;
+    struct AstNode *last_child;
+    struct AstNode *next;
+    struct CommandCheck *check; // leia, escreva, se e para: o que o parser conferiu
+} AstNode;
+
+// Regra da lista do leia ou do escreva que o parser viu quebrar primeiro
+typedef enum {
+    CHECK_OK,
+    CHECK_EXPECTED_ITEM,  // Esperada variável (ou, no escreva, texto)
+    CHECK_EXPECTED_COMMA, // Esperada vírgula entre os itens
+    CHECK_TRAILING_COMMA, // A lista termina numa vírgula
+    CHECK_EMPTY           // Nenhum item entre os parênteses
+} CheckRule;
+
+// Corpo do se, do senao ou do para. O de uma linha vai até o primeiro ';',
+// em qualquer nível, e não pode declarar variáveis.
+typedef struct CommandBranch {
+    int start;       // Primeiro token; '{' quando o corpo é um bloco
+    int semicolon;   // ';' que termina a linha, ou -1
+    int declaration; // Tipo declarado antes do ';', ou -1
+} CommandBranch;
+
+// O que o parser conferiu ao montar o comando. As posições valem para o
+// arquivo inteiro; as validações só as comparam com o fim do trecho que
+// estão classificando e relatam a regra no token onde ela quebra.
+typedef struct CommandCheck {
+    CheckRule rule;
+    int token;        // Onde a regra quebra
+    int items;
+    int branch_count; // se: 2 quando há senao; para: 1
+    CommandBranch branches[2];
+} CommandCheck;
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+} ArenaBlock;
+
+// Blocos encadeados; reset_arena() só zera o uso, e os blocos são reaproveitados
+typedef struct Arena {
+    ArenaBlock *first;
+    ArenaBlock *current;
+} Arena;
+
+// Códigos dos diagnósticos
+typedef enum {
+    DIAG_IO_ERROR,
+    DIAG_LEXICAL_ERROR,
+    DIAG_INVALID_OPERATOR,
+    DIAG_UNEXPECTED_END,
+    DIAG_MISSING_SEMICOLON,
+    DIAG_UNEXPECTED_SEMICOLON,
+    DIAG_EXPECTED_PAREN,
+    DIAG_UNCLOSED_PAREN,
+    DIAG_EXPECTED_BRACE,
+    DIAG_UNCLOSED_BRACE,
+    DIAG_UNCLOSED_STRING,
+    DIAG_UNBALANCED,
+    DIAG_BAD_PARAMETER_LIST,
+    DIAG_BAD_COMMAND_ARGUMENTS,
+    DIAG_BAD_FOR_HEADER,
+    DIAG_INCOMPLETE_COMMAND,
+    DIAG_UNDECLARED_VARIABLE,
+    DIAG_NOT_A_VARIABLE,
+    DIAG_DECLARATION_IN_BLOCK,
+    DIAG_REDECLARED_SYMBOL,
+    DIAG_REDECLARED_PARAMETER,
+    DIAG_BAD_FUNCTION_NAME,
+    DIAG_UNDECLARED_FUNCTION,
+    DIAG_NOT_A_FUNCTION,
+    DIAG_ARGUMENT_COUNT,
+    DIAG_INVALID_CALL,
+    DIAG_MISSING_RETURN,
+    DIAG_TYPE_MISMATCH,
+    DIAG_UNUSED_SYMBOL,
+    DIAG_RECOVERY,
+    NUM_DIAGNOSTIC_CODES
+} DiagnosticCode;
+
+typedef enum {
+    SEVERITY_ERROR,
+    SEVERITY_WARNING,
+    SEVERITY_NOTE // Só no texto, sem contar como erro ou aviso
+} DiagnosticSeverity;
+
+typedef struct DiagnosticInfo {
+    const char *id;
+    DiagnosticSeverity severity;
+} DiagnosticInfo;
+
+static const DiagnosticInfo DIAGNOSTIC_INFO[NUM_DIAGNOSTIC_CODES] = {
+    [DIAG_IO_ERROR]              = {"IO001", SEVERITY_ERROR},
+    [DIAG_LEXICAL_ERROR]         = {"LEX001", SEVERITY_ERROR},
+    [DIAG_INVALID_OPERATOR]      = {"LEX002", SEVERITY_ERROR},
+    [DIAG_UNEXPECTED_END]        = {"LEX003", SEVERITY_ERROR},
+    [DIAG_MISSING_SEMICOLON]     = {"SYN001", SEVERITY_ERROR},
+    [DIAG_UNEXPECTED_SEMICOLON]  = {"SYN002", SEVERITY_ERROR},
+    [DIAG_EXPECTED_PAREN]        = {"SYN003", SEVERITY_ERROR},
+    [DIAG_UNCLOSED_PAREN]        = {"SYN004", SEVERITY_ERROR},
+    [DIAG_EXPECTED_BRACE]        = {"SYN005", SEVERITY_ERROR},
+    [DIAG_UNCLOSED_BRACE]        = {"SYN006", SEVERITY_ERROR},
+    [DIAG_UNCLOSED_STRING]       = {"SYN007", SEVERITY_ERROR},
+    [DIAG_UNBALANCED]            = {"SYN008", SEVERITY_ERROR},
+    [DIAG_BAD_PARAMETER_LIST]    = {"SYN009", SEVERITY_ERROR},
+    [DIAG_BAD_COMMAND_ARGUMENTS] = {"SYN010", SEVERITY_ERROR},
+    [DIAG_BAD_FOR_HEADER]        = {"SYN011", SEVERITY_ERROR},
+    [DIAG_INCOMPLETE_COMMAND]    = {"SYN012", SEVERITY_ERROR},
+    [DIAG_UNDECLARED_VARIABLE]   = {"SEM001", SEVERITY_ERROR},
+    [DIAG_NOT_A_VARIABLE]        = {"SEM002", SEVERITY_ERROR},
+    [DIAG_DECLARATION_IN_BLOCK]  = {"SEM003", SEVERITY_ERROR},
+    [DIAG_REDECLARED_SYMBOL]     = {"SEM004", SEVERITY_ERROR},
+    [DIAG_REDECLARED_PARAMETER]  = {"SEM005", SEVERITY_ERROR},
+    [DIAG_BAD_FUNCTION_NAME]     = {"SEM006", SEVERITY_ERROR},
+    [DIAG_UNDECLARED_FUNCTION]   = {"SEM007", SEVERITY_ERROR},
+    [DIAG_NOT_A_FUNCTION]        = {"SEM008", SEVERITY_ERROR},
+    [DIAG_ARGUMENT_COUNT]        = {"SEM009", SEVERITY_ERROR},
+    [DIAG_INVALID_CALL]          = {"SEM010", SEVERITY_ERROR},
+    [DIAG_MISSING_RETURN]        = {"SEM011", SEVERITY_ERROR},
+    [DIAG_TYPE_MISMATCH]         = {"SEM012", SEVERITY_ERROR},
+    [DIAG_UNUSED_SYMBOL]         = {"WRN001", SEVERITY_WARNING},
+    [DIAG_RECOVERY]              = {"NOTE001", SEVERITY_NOTE},
+};
+
+// Formato da saída
+typedef enum {
+    FORMAT_TEXT,   // Relatório legível
+    FORMAT_NDJSON, // Um objeto JSON por linha
+    FORMAT_BINARY  // Registros binários com prefixo de tamanho
+} OutputFormat;
+
+// Tipos de registro do formato binário
+typedef enum {
+    RECORD_FILE_BEGIN = 1,
+    RECORD_TOKEN = 2,
+    RECORD_DIAGNOSTIC = 3,
+    RECORD_FILE_END = 4
+} RecordType;
+
+#define BINARY_MAGIC "LXTK"
+#define BINARY_VERSION 1
+
+// Posição de um token no arquivo fonte
+typedef struct TokenSpan {
+    int offset;
+    int length;
+    int line;
+} TokenSpan;
+
+#define TOKEN_CACHE_MAGIC "LXTC"
+// Deve mudar sempre que o lexer passar a produzir tokens diferentes
+#define TOKEN_CACHE_VERSION 1
+#define TOKEN_CACHE_BYTE_ORDER 0x01020304u
+
+// Cabeçalho de um arquivo do cache de tokens. Em seguida vêm as posições
+// (TokenSpan[token_count]), o deslocamento de cada token no bloco de texto
+// (uint32_t[token_count]) e o bloco com os tokens terminados em '\0'. Tudo
+// fica alinhado, então os tokens são usados direto do arquivo mapeado.
+typedef struct TokenCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order; // Arquivos de outra arquitetura são ignorados
+    uint32_t token_count;
+    uint64_t content_hash;
+    uint64_t content_length;
+    uint64_t lexer_memory; // Memória que o lexer contabilizou, mantida no relatório
+    uint64_t text_size;
+} TokenCacheHeader;
+
+#define RESULT_CACHE_MAGIC "LXTR"
+// Deve mudar sempre que a análise ou o texto do relatório mudarem
+#define RESULT_CACHE_VERSION 9
+
+// Cabeçalho de um resultado guardado, seguido de body_size bytes do relatório.
+// A chave inclui a versão e as opções que mudam o relatório (nível, formato e limites).
+typedef struct ResultCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t verbosity;
+    uint32_t format;
+    uint32_t token_count;
+    uint32_t error_count;
+    uint32_t warning_count;
+    uint64_t content_hash;
+    uint64_t content_length;
+    uint64_t body_size;
+} ResultCacheHeader;
+
+// Nível de detalhe do relatório
+typedef enum {
+    VERBOSITY_SUMMARY,     // Apenas contagens por arquivo
+    VERBOSITY_DIAGNOSTICS, // Apenas erros e avisos
+    VERBOSITY_TOKENS       // Classificação completa dos tokens
+} Verbosity;
+
+#define REPORT_BUFFER_INITIAL (64 * 1024)
+
+// Buffer de saída de um relatório, reaproveitado entre arquivos
+typedef struct ReportBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    AnalysisContext *owner; // Recebe a falta de memória; sem contexto, o programa termina
+} ReportBuffer;
+
+// Diagnóstico guardado até ser escrito. A mensagem não é montada na hora: o
+// formato (sempre um literal) fica no registro, e os argumentos e a sugestão
+// ficam no bloco de texto do contexto.
+typedef struct DiagnosticRecord {
+    DiagnosticCode code;
+    int token;
+    TokenSpan span;
+    const char *format;
+    size_t args;       // Posição dos argumentos no bloco de texto
+    int args_length;
+    size_t suggestion; // Posição no bloco de texto, ou NO_SUGGESTION
+    int count;         // Vezes em que foi relatado, contando as repetições
+    bool written;      // Já saiu no relatório
+    uint64_t hash;     // Do código, do formato e dos argumentos, para descartar repetições
+    int slot;          // Posição na tabela de repetições, ou -1 fora dela
+} DiagnosticRecord;
+
+#define NO_SUGGESTION ((size_t)-1)
+
+// Inferência de tipos. Cada variável, parâmetro, argumento de chamada e
+// comparação é um nó; atribuições, testes e chamadas ligam o nó de um
+// operando ao nó do lugar onde ele é usado.
+typedef struct TypeNode {
+    DataType type;  // TYPE_UNKNOWN até a inferência chegar ao nó
+    bool fixed;     // Tipo declarado, que a inferência só confere
+    int first_edge;
+} TypeNode;
+
+// Cada ligação vira duas meias-arestas seguidas, uma em cada sentido, para o
+// tipo correr do operando para o uso e do uso para o operando
+typedef struct TypeEdge {
+    int to;
+    int operand;
+    int context;
+    int token; // Token do operando, posição do diagnóstico
+    int next;
+} TypeEdge;
+
+// Parâmetros de uma função definida no arquivo, em nós seguidos
+typedef struct TypeFunction {
+    int first_param;
+    int param_count;
+} TypeFunction;
+
+// Argumento de uma chamada, ligado ao parâmetro quando todas as funções do
+// arquivo são conhecidas
+typedef struct TypeCall {
+    int function; // Token do nome na chamada
+    int argument;
+    int node;
+    int token;
+} TypeCall;
+
+typedef struct TypeGraph {
+    TypeNode *nodes;
+    int node_count;
+    int node_capacity;
+    TypeEdge *edges;
+    int edge_count;
+    int edge_capacity;
+    int *declared; // Por token de declaração: o nó da variável ou do parâmetro, ou,
+                   // no nome de uma função, a posição dela em functions
+    int declared_capacity;
+    TypeFunction *functions;
+    int function_count;
+    int function_capacity;
+    TypeCall *calls;
+    int call_count;
+    int call_capacity;
+    int *worklist;
+    int worklist_capacity;
+    int constants[TYPE_UNKNOWN]; // Nós fixos dos literais de cada tipo
+} TypeGraph;
+
+// Nome visível no ponto da resolução; `shadowed` é a declaração de mesmo
+// nome que ele esconde, devolvida à tabela quando o escopo fecha
+typedef struct NameBinding {
+    const char *name;
+    int length;
+    int token;
+    int shadowed;
+    int slot;
+} NameBinding;
+
+// Função definida no arquivo, pelo token do nome
+typedef struct NameFunction {
+    const char *name;
+    int token;
+} NameFunction;
+
+// Ligações entre usos e declarações, refeitas a cada arquivo por
+// resolve_names(). Uma declaração é identificada pelo token do nome
+// declarado; os usos de cada uma formam uma lista encadeada, na ordem do
+// arquivo, nos próprios vetores.
+typedef struct NameLinks {
+    int *declaration; // Por token: a declaração a que o nome se liga (o próprio token numa declaração), ou -1
+    int *first_use;   // Por token de declaração: o primeiro uso, ou -1
+    int *next_use;    // Por token de uso: o próximo uso da mesma declaração, ou -1. Numa
+                      // declaração guarda o último uso, para a lista crescer pelo fim.
+    int capacity;
+    NameBinding *bindings; // Pilha dos nomes visíveis
+    int binding_count;
+    int binding_capacity;
+    int scope_start; // Primeira declaração do escopo atual na pilha
+    int *slots; // Espalhamento dos nomes para a declaração mais interna; -1 é vazio
+    int slot_capacity;
+    NameFunction *functions; // Ordenadas pelo nome, e pela posição entre nomes iguais
+    int function_count;
+    int function_capacity;
+    int *calls; // Tokens das chamadas, ligadas depois de conhecidas todas as funções
+    int call_count;
+    int call_capacity;
+} NameLinks;
+
+// Aberturas e, três posições adiante, os fechamentos correspondentes
+static const char BRACKET_CHARS[] = "([{)]}";
+
+typedef enum {
+    BRACKET_NONE,
+    BRACKET_OPEN,
+    BRACKET_CLOSE
+} BracketType;
+
+// Desencontro de delimitadores achado ao montar o índice de pares
+typedef struct BracketError {
+    int token;
+    char open;  // Abertura envolvida, ou 0 para um fechamento sem abertura
+    char close; // Fechamento encontrado, ou 0 para uma abertura que não fechou
+} BracketError;
+
+// 'funcao __nome' achada na passada de índice. O fim segue a regra de
+// sempre: a primeira '}' depois da primeira '{' que volta ao nível de chaves
+// que havia logo depois do nome.
+typedef struct FunctionDefinition {
+    const char *name;
+    int start; // Token 'funcao'
+    int end;   // '}' que fecha o corpo, ou -1
+    int level; // Nível de chaves no nome
+    int next;  // Próxima definição esperando a mesma '{' ou o mesmo nível
+} FunctionDefinition;
+
+// Função fechada sem 'retorno', relatada por check_return_statement()
+typedef struct MissingReturn {
+    int token;
+    const char *name;
+} MissingReturn;
+
+// Função aberta na classificação: quando a '}' do corpo passa, o escopo dos
+// parâmetros fecha junto
+typedef struct FunctionScope {
+    int close; // '}' do corpo
+    int scope; // Escopo dos parâmetros
+    int token; // 'funcao'
+    int line;  // Linha da classificação no 'funcao'
+} FunctionScope;
+
+// Corpo de função de primeiro nível separado pela passada principal e
+// validado num contexto próprio (ver validate_function_bodies())
+typedef struct FunctionBody {
+    int open;         // '{' do corpo
+    int close;        // '}' correspondente
+    int scope;        // Escopo dos parâmetros
+    int line;         // Linha da classificação na '{'
+    int visible;      // Símbolos do arquivo com ordem menor que esta são visíveis
+    Symbol *params;   // Parâmetros, tirados da tabela do arquivo, na ordem de declaração
+    size_t insert_at; // Posição no relatório da passada principal
+    struct AnalysisContext *worker; // Contexto que validou o corpo, ou NULL
+    size_t out_start; // Trecho do relatório desse contexto
+    size_t out_end;
+} FunctionBody;
+
+// Função de primeiro nível de algum arquivo, no índice do modo projeto
+typedef struct ProjectFunction {
+    char *name;
+    uint64_t hash;
+    int param_count;
+    int file;         // Posição do arquivo na entrada; vale a do primeiro que define
+    int line;
+    const char *path;
+    struct ProjectFunction *next; // Próxima no mesmo balde
+} ProjectFunction;
+
+#define PROJECT_SHARDS 64
+
+// Fatia do índice com o seu próprio lock: threads que inserem nomes de
+// fatias diferentes não disputam nada
+typedef struct ProjectShard {
+    pthread_mutex_t lock;
+    ProjectFunction **buckets;
+    int bucket_count; // Potência de 2
+    int count;
+} ProjectShard;
+
+// Funções de todos os arquivos do projeto. A primeira fase escreve, com um
+// lock por fatia; na segunda o índice só é lido, sem lock.
+typedef struct ProjectIndex {
+    ProjectShard shards[PROJECT_SHARDS];
+} ProjectIndex;
+
+// Fases da análise medidas com --stats
+typedef enum {
+    PHASE_READ,        // read_file(), ou a parte do arquivo na leitura antecipada
+    PHASE_LEX,         // string_tokens(), ou os caches
+    PHASE_INDEX,       // Pares de delimitadores, árvore sintática e resolução de nomes
+    PHASE_CLASSIFY,    // classify_tokens() e corpos de função
+    PHASE_LEVENSHTEIN, // Comparação com as keywords, dentro da classificação
+    PHASE_CHECKS,      // Verificações finais, tipos e tabela de símbolos
+    NUM_PHASES,
+    PHASE_IDLE = NUM_PHASES // Contexto parado: o tempo não vai para fase nenhuma
+} Phase;
+
+static const char *PHASE_NAMES[NUM_PHASES] = {
+    "leitura", "lexer", "índice", "classificação", "levenshtein", "verificações"
+};
+
+// Contadores de hardware abertos com perf_event_open, num grupo por thread
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    NUM_COUNTERS
+} Counter;
+
+typedef struct PhaseStats {
+    long long nanoseconds;
+    long long counters[NUM_COUNTERS];
+} PhaseStats;
+
+// Medidas de um arquivo. O tempo das threads de corpos de função se soma ao
+// da thread do arquivo.
+typedef struct FileStats {
+    const char *path;
+    PhaseStats phases[NUM_PHASES];
+    long long bytes;
+    long long tokens;
+    bool counted; // Os contadores valeram em todos os trechos medidos
+} FileStats;
 
-// Variável global da tabela de símbolos
-SymbolTable symbol_table = {0};
+// Fase atual de um contexto, desde quando e os contadores da thread naquele
+// momento. O grupo de contadores é da thread que o abriu; quando o contexto
+// passa para outra thread (pipeline, corpos de função), é aberto de novo.
+typedef struct PhaseClock {
+    FileStats *stats; // Medidas do arquivo atual, ou NULL sem --stats
+    Phase phase;
+    long long start;
+    long long counters[NUM_COUNTERS];
+    bool counted;     // `counters` foi lido
+    bool bound;       // perf_fds foram abertos para `thread`
+    pthread_t thread;
+    int perf_fds[NUM_COUNTERS]; // -1 quando a máquina não tem os contadores
+} PhaseClock;
+
+// Estado de uma análise. Cada arquivo é analisado com o seu próprio contexto,
+// então vários arquivos podem ser processados ao mesmo tempo em threads.
+typedef struct AnalysisContext {
+    SymbolTable symbol_table;
+    PendingFunctionCall *pending_calls; // Lista de chamadas pendentes
+    bool principal_func;
+    size_t memory;
+    Verbosity verbosity;
+    OutputFormat format;
+    ReportBuffer out; // Relatório do arquivo
+    int error_count;
+    int warning_count;
+    TokenSpan *spans; // Posição de cada token, preenchida pelo lexer
+    int span_capacity;
+    int current_token; // Token em análise, usado como posição dos diagnósticos
+    int max_errors;    // Erros relatados por arquivo; 0 é sem limite
+    int max_diagnostics; // Diagnósticos escritos por arquivo; 0 é sem limite
+    DiagnosticRecord *diagnostics; // Diagnósticos do arquivo, escritos por flush_diagnostics()
+    int diagnostic_count;
+    int diagnostic_capacity;
+    ReportBuffer diagnostic_text; // Argumentos e sugestões dos diagnósticos
+    ReportBuffer diagnostic_message; // Mensagem montada para os formatos estruturados
+    int *diagnostic_slots; // Tabela de espalhamento dos diagnósticos; -1 é vazio
+    int diagnostic_slot_capacity;
+    int diagnostic_code_counts[NUM_DIAGNOSTIC_CODES];
+    NameLinks links; // Refeito a cada arquivo por resolve_names()
+    TypeGraph types; // Refeito a cada arquivo por infer_types()
+    const char *cache_dir; // Diretório do cache de tokens, ou NULL
+    void *cache_map; // Arquivo do cache mapeado para o arquivo atual
+    size_t cache_map_size;
+    const int *cancel; // Quando aponta para um valor diferente de zero, a análise para
+    jmp_buf *memory_error; // Na biblioteca, estourar o limite volta para cá em vez de sair
+    char *content; // Conteúdo e tokens em uso, liberados se a análise for abandonada
+    char **tokens;
+    int token_count;
+    TokenKind *token_kinds; // Tipo de cada token, mais a sentinela KIND_END
+    int kind_capacity;
+    size_t content_length;
+    uint64_t content_hash; // Chave dos caches, quando há diretório de cache
+    size_t body_start;     // Onde começa, no relatório, a parte guardada no cache
+    Arena ast_arena;       // Nós da árvore sintática do arquivo atual
+    AstNode *ast;          // Raiz, montada no início de analysis_check()
+    AstNode **command_nodes; // Nó de cada leia, escreva, se e para, pelo token da palavra-chave
+    int command_capacity;
+    int *bracket_match;    // Par de cada '(', '[', '{' e '"' (e do seu fechamento), ou -1
+    int *bracket_stack;    // Pilha da passada que monta bracket_match
+    int bracket_capacity;
+    BracketError *bracket_errors; // Relatados depois por check_brackets_and_quotes()
+    int bracket_error_count;
+    int bracket_error_capacity;
+    FunctionDefinition *functions; // Na ordem do arquivo
+    int function_count;
+    int function_capacity;
+    int *level_waiting; // Definições abertas esperando cada nível de chaves
+    int level_capacity;
+    MissingReturn *missing_returns;
+    int missing_return_count;
+    int missing_return_capacity;
+    FunctionScope *function_scopes; // Funções abertas na classificação, a mais interna no fim
+    int function_scope_count;
+    int function_scope_capacity;
+    int function_jobs;     // Threads para os corpos de função de um arquivo; 0 ou 1 é sem threads
+    FunctionBody *bodies;  // Corpos separados pela passada principal, na ordem do arquivo
+    int body_count;
+    int body_capacity;
+    int next_body;         // Próximo corpo a validar, disputado pelas threads
+    struct AnalysisContext **body_workers; // Contextos dos corpos, criados quando preciso
+    int body_worker_count;
+    struct AnalysisContext *owner; // Num contexto de corpo, o contexto do arquivo
+    int visible_symbols;   // Num contexto de corpo, quantos símbolos do arquivo ele enxerga
+    bool body_failed;      // O corpo estourou o limite de memória
+    ProjectIndex *project; // No modo projeto, as funções dos outros arquivos
+    PhaseClock phase_clock; // Medidas de --stats
+    FileStats body_stats;  // Num contexto de corpo, as medidas dos corpos que validou
+} AnalysisContext;
 
 // Declarações de função
-void* safe_malloc(size_t size);
-Symbol* lookup_symbol_current_scope(const char *name);
-Symbol* lookup_symbol(const char *name);
-bool add_symbol(const char *name, SymbolType symbol_type, DataType data_type, int line);
-void enter_scope();
-void exit_scope();
-DataType string_to_data_type(const char *type_str);
-bool validate_function_call(const char *func_name, int provided_params, int line);
-bool validate_function_declaration(const char *func_name);
-int is_variable(const char *token);
-bool validate_leia_command(char **tokens, int start_idx, int *end_idx, int current_line);
-bool validate_escreva_command(char **tokens, int start_idx, int *end_idx, int current_line);
-bool validate_se_command(char **tokens, int start_idx, int *end_idx, int current_line);
-bool validate_para_command(char **tokens, int start_idx, int *end_idx, int current_line);
-
-// Função para validar duplo balanceamento em qualquer contexto
-bool validate_double_balancing(char **tokens, int start_idx, int end_idx, bool check_quotes) {
-    int paren_count = 0;
-    int brace_count = 0;
-    int bracket_count = 0;
-    bool in_string = false;
-    int quote_count = 0;
+static void* safe_malloc(AnalysisContext *ctx, size_t size);
+static void analysis_out_of_memory(AnalysisContext *ctx);
+static Phase stats_phase(AnalysisContext *ctx, Phase phase);
+static uint64_t content_hash(const char *data, size_t length);
+static void analyze_content(AnalysisContext *ctx, const char *path, char *content);
+static bool analysis_lex(AnalysisContext *ctx, const char *path, char *content);
+static void lex_content(AnalysisContext *ctx, char *content);
+static void analysis_check(AnalysisContext *ctx, const char *path);
+static void release_body_worker(AnalysisContext *worker);
+static AstNode* ast_leading(AstNode *node);
+static AstNode* command_node(AnalysisContext *ctx, int index);
+static int bracket_end_before(AnalysisContext *ctx, int index, int limit);
+static BracketType bracket_type(const char *token);
+static Symbol* lookup_symbol_current_scope(AnalysisContext *ctx, const char *name);
+static Symbol* lookup_symbol(AnalysisContext *ctx, const char *name);
+static bool add_symbol(AnalysisContext *ctx, const char *name, int token, SymbolType symbol_type, DataType data_type, int line);
+static void insert_symbol(AnalysisContext *ctx, Symbol *symbol);
+static bool symbol_used(AnalysisContext *ctx, Symbol *symbol);
+static void enter_scope(AnalysisContext *ctx);
+static void exit_scope(AnalysisContext *ctx);
+static void pop_trail_symbol(AnalysisContext *ctx);
+static SymbolSnapshot symbol_table_snapshot(AnalysisContext *ctx);
+static void symbol_table_rollback(AnalysisContext *ctx, SymbolSnapshot snapshot);
+static DataType string_to_data_type(const char *type_str);
+static bool validate_function_call(AnalysisContext *ctx, const char *func_name, int provided_params, int line);
+static bool validate_function_declaration(AnalysisContext *ctx, const char *func_name);
+static int is_variable(const char *token);
+static TokenKind token_kind(const char *token, size_t length);
+static void reserve_token_kinds(AnalysisContext *ctx, int count);
+static bool validate_leia_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line);
+static bool validate_escreva_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line);
+static bool validate_se_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line);
+static bool validate_para_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line);
+
+// Funções do relatório. O texto é montado à mão no buffer do contexto, sem
+// passar pelo stdio; o que está abaixo do nível pedido nem é formatado.
+static void report_reserve(ReportBuffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return;
     
-    for (int i = start_idx; i <= end_idx; i++) {
-        if (tokens[i] == NULL) continue;
-        
-        // Balanceamento de aspas duplas (se solicitado)
-        if (check_quotes && strcmp(tokens[i], "\"") == 0) {
-            in_string = !in_string;
-            quote_count++;
-            continue;
+    size_t capacity = buffer->capacity ? buffer->capacity : REPORT_BUFFER_INITIAL;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        if (buffer->owner != NULL) {
+            analysis_out_of_memory(buffer->owner);
         }
-        
-        // Se estiver dentro de string, ignora outros balanceamentos
-        if (in_string) continue;
-        
-        // Balanceamento de parênteses
-        if (strcmp(tokens[i], "(") == 0) {
-            paren_count++;
-        } else if (strcmp(tokens[i], ")") == 0) {
-            paren_count--;
-            if (paren_count < 0) return false; // Fechamento sem abertura
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+}
+
+// Liga os buffers do contexto a ele, para que a falta de memória num relatório
+// volte pela análise (na biblioteca, como -1) em vez de terminar o programa
+static void report_buffers_init(AnalysisContext *ctx) {
+    ctx->out.owner = ctx;
+    ctx->diagnostic_text.owner = ctx;
+    ctx->diagnostic_message.owner = ctx;
+}
+
+static void report_append(ReportBuffer *buffer, const char *text, size_t length) {
+    report_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+}
+
+static void report_append_int(ReportBuffer *buffer, int value) {
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = value < 0 ? -(unsigned int)value : (unsigned int)value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    
+    report_reserve(buffer, n + 1);
+    if (value < 0) buffer->data[buffer->length++] = '-';
+    while (n > 0) {
+        buffer->data[buffer->length++] = digits[--n];
+    }
+}
+
+static void report_vprintf(AnalysisContext *ctx, const char *format, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    size_t available = ctx->out.capacity - ctx->out.length;
+    int needed = vsnprintf(ctx->out.data ? ctx->out.data + ctx->out.length : NULL, available, format, copy);
+    va_end(copy);
+    if (needed < 0) return;
+    
+    if ((size_t)needed >= available) {
+        report_reserve(&ctx->out, needed + 1);
+        vsnprintf(ctx->out.data + ctx->out.length, needed + 1, format, args);
+    }
+    ctx->out.length += needed;
+}
+
+// Texto livre, escrito apenas se o nível do relatório for pelo menos `level`
+static void report_printf(AnalysisContext *ctx, Verbosity level, const char *format, ...) {
+    if (ctx->format != FORMAT_TEXT || ctx->verbosity < level) return;
+    va_list args;
+    va_start(args, format);
+    report_vprintf(ctx, format, args);
+    va_end(args);
+}
+
+// Trecho constante, com o tamanho calculado em tempo de compilação
+#define report_literal(buffer, text) report_append(buffer, text, sizeof(text) - 1)
+
+// Escrita little-endian para o formato binário
+static void report_append_u8(ReportBuffer *buffer, unsigned int value) {
+    report_reserve(buffer, 1);
+    buffer->data[buffer->length++] = (char)(value & 0xFF);
+}
+
+static void report_append_u16(ReportBuffer *buffer, unsigned int value) {
+    report_append_u8(buffer, value);
+    report_append_u8(buffer, value >> 8);
+}
+
+static void report_append_u32(ReportBuffer *buffer, unsigned int value) {
+    report_append_u16(buffer, value & 0xFFFF);
+    report_append_u16(buffer, value >> 16);
+}
+
+// Abre um registro binário; o tamanho é preenchido por record_end()
+static size_t record_begin(ReportBuffer *buffer, RecordType type) {
+    size_t start = buffer->length;
+    report_append_u32(buffer, 0);
+    report_append_u8(buffer, type);
+    return start;
+}
+
+static void record_end(ReportBuffer *buffer, size_t start) {
+    unsigned int size = buffer->length - start - 4;
+    for (int b = 0; b < 4; b++) {
+        buffer->data[start + b] = (char)((size >> (8 * b)) & 0xFF);
+    }
+}
+
+// Texto entre aspas com os escapes do JSON
+static void report_append_json_string(ReportBuffer *buffer, const char *text, size_t length) {
+    const char hex[] = "0123456789abcdef";
+    report_reserve(buffer, length + 2);
+    buffer->data[buffer->length++] = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            report_reserve(buffer, 2);
+            buffer->data[buffer->length++] = '\\';
+            buffer->data[buffer->length++] = c;
+        } else if (c < 0x20) {
+            report_reserve(buffer, 6);
+            report_literal(buffer, "\\u00");
+            buffer->data[buffer->length++] = hex[c >> 4];
+            buffer->data[buffer->length++] = hex[c & 0xF];
+        } else {
+            report_reserve(buffer, 1);
+            buffer->data[buffer->length++] = c;
+        }
+    }
+    report_reserve(buffer, 1);
+    buffer->data[buffer->length++] = '"';
+}
+
+// Procura na tabela de repetições um diagnóstico com o mesmo código, o mesmo
+// formato e os mesmos argumentos. Devolve o índice dele, ou -1 com *slot na
+// posição livre.
+static int find_diagnostic(AnalysisContext *ctx, DiagnosticCode code, const char *format, uint64_t hash,
+                           const char *args, int args_length, int *slot) {
+    int mask = ctx->diagnostic_slot_capacity - 1;
+    int s = (int)(hash & mask);
+    while (ctx->diagnostic_slots[s] != -1) {
+        DiagnosticRecord *other = &ctx->diagnostics[ctx->diagnostic_slots[s]];
+        if (other->hash == hash && other->code == code && other->format == format &&
+            other->args_length == args_length &&
+            memcmp(ctx->diagnostic_text.data + other->args, args, args_length) == 0) {
+            return ctx->diagnostic_slots[s];
+        }
+        s = (s + 1) & mask;
+    }
+    *slot = s;
+    return -1;
+}
+
+// Mantém a tabela de repetições com no máximo metade das posições ocupadas
+static void grow_diagnostic_slots(AnalysisContext *ctx) {
+    if ((ctx->diagnostic_count + 1) * 2 <= ctx->diagnostic_slot_capacity) return;
+    int capacity = ctx->diagnostic_slot_capacity > 0 ? ctx->diagnostic_slot_capacity * 2 : 64;
+    int *slots = realloc(ctx->diagnostic_slots, capacity * sizeof(int));
+    if (slots == NULL) {
+        analysis_out_of_memory(ctx);
+    }
+    ctx->diagnostic_slots = slots;
+    ctx->diagnostic_slot_capacity = capacity;
+    memset(slots, -1, capacity * sizeof(int));
+    for (int d = 0; d < ctx->diagnostic_count; d++) {
+        DiagnosticRecord *record = &ctx->diagnostics[d];
+        int s = (int)(record->hash & (capacity - 1));
+        while (slots[s] != -1) {
+            s = (s + 1) & (capacity - 1);
+        }
+        slots[s] = d;
+        record->slot = s;
+    }
+}
+
+// Copia os argumentos de um diagnóstico para o fim do bloco de texto, sem
+// avançar o fim. Os formatos dos diagnósticos só usam %d, %c e %s: números e
+// caracteres vão como int, textos com o '\0'. Devolve o tamanho copiado.
+static int pack_diagnostic_args(ReportBuffer *text, const char *format, va_list args) {
+    size_t start = text->length;
+    for (const char *f = strchr(format, '%'); f != NULL; f = strchr(f + 1, '%')) {
+        f++;
+        if (*f == '%') continue;
+        if (*f == 's') {
+            const char *value = va_arg(args, const char *);
+            report_append(text, value, strlen(value) + 1);
+        } else {
+            int value = va_arg(args, int);
+            report_append(text, (const char *)&value, sizeof(value));
+        }
+    }
+    int length = (int)(text->length - start);
+    text->length = start;
+    return length;
+}
+
+// Conta `count` vezes o diagnóstico cujos argumentos já estão copiados logo
+// depois do fim do bloco de texto e o guarda. Se ele repete um já guardado
+// (fora do relatório completo), só as contagens daquele aumentam. Devolve o
+// diagnóstico guardado, ou NULL para uma repetição.
+static DiagnosticRecord* store_diagnostic(AnalysisContext *ctx, DiagnosticCode code, int token_index,
+                                          const char *format, int args_length, const char *suggestion, int count) {
+    const DiagnosticInfo *info = &DIAGNOSTIC_INFO[code];
+    ReportBuffer *text = &ctx->diagnostic_text;
+    size_t args = text->length;
+    if (info->severity == SEVERITY_WARNING) {
+        ctx->warning_count += count;
+    } else if (info->severity == SEVERITY_ERROR) {
+        ctx->error_count += count;
+    }
+    ctx->diagnostic_code_counts[code] += count;
+    uint64_t hash = 0;
+    int slot = -1;
+    // No relatório completo cada diagnóstico sai na hora, repetido ou não
+    if (ctx->verbosity < VERBOSITY_TOKENS) {
+        hash = content_hash(text->data + args, args_length) + code * 31 + (uintptr_t)format * 1031;
+        grow_diagnostic_slots(ctx);
+        int found = find_diagnostic(ctx, code, format, hash, text->data + args, args_length, &slot);
+        if (found != -1) {
+            ctx->diagnostics[found].count += count;
+            return NULL;
+        }
+    }
+    text->length = args + args_length;
+    
+    if (ctx->diagnostic_count == ctx->diagnostic_capacity) {
+        int capacity = ctx->diagnostic_capacity > 0 ? ctx->diagnostic_capacity * 2 : 64;
+        DiagnosticRecord *records = realloc(ctx->diagnostics, capacity * sizeof(DiagnosticRecord));
+        if (records == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->diagnostics = records;
+        ctx->diagnostic_capacity = capacity;
+    }
+    DiagnosticRecord *record = &ctx->diagnostics[ctx->diagnostic_count];
+    record->code = code;
+    record->token = token_index;
+    if (token_index >= 0 && token_index < ctx->token_count) {
+        record->span = ctx->spans[token_index];
+    } else {
+        record->span = (TokenSpan){0, 0, 0};
+    }
+    record->format = format;
+    record->args = args;
+    record->args_length = args_length;
+    record->suggestion = NO_SUGGESTION;
+    if (suggestion != NULL) {
+        record->suggestion = text->length;
+        report_append(text, suggestion, strlen(suggestion) + 1);
+    }
+    record->count = count;
+    record->written = false;
+    record->hash = hash;
+    record->slot = slot;
+    if (slot != -1) ctx->diagnostic_slots[slot] = ctx->diagnostic_count;
+    ctx->diagnostic_count++;
+    return record;
+}
+
+// Monta a mensagem de um diagnóstico guardado no fim de `into`, sem a quebra
+// de linha final
+static void format_diagnostic(AnalysisContext *ctx, DiagnosticRecord *record, ReportBuffer *into) {
+    const char *arg = ctx->diagnostic_text.data + record->args;
+    const char *f = record->format;
+    while (*f != '\0') {
+        size_t run = strcspn(f, "%");
+        report_append(into, f, run);
+        f += run;
+        if (*f == '\0') break;
+        f++;
+        if (*f == '%') {
+            report_append(into, "%", 1);
+        } else if (*f == 's') {
+            size_t length = strlen(arg);
+            report_append(into, arg, length);
+            arg += length + 1;
+        } else {
+            int value;
+            memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            if (*f == 'c') {
+                char c = (char)value;
+                report_append(into, &c, 1);
+            } else {
+                report_append_int(into, value);
+            }
         }
-        // Balanceamento de chaves
-        else if (strcmp(tokens[i], "{") == 0) {
-            brace_count++;
-        } else if (strcmp(tokens[i], "}") == 0) {
-            brace_count--;
-            if (brace_count < 0) return false; // Fechamento sem abertura
+        f++;
+    }
+    if (into->length > 0 && into->data[into->length - 1] == '\n') into->length--;
+    if (record->count > 1) {
+        report_literal(into, " (repetido ");
+        report_append_int(into, record->count);
+        report_literal(into, " vezes)");
+    }
+}
+
+// Escreve um diagnóstico guardado no formato da saída
+static void write_diagnostic(AnalysisContext *ctx, DiagnosticRecord *record) {
+    const DiagnosticInfo *info = &DIAGNOSTIC_INFO[record->code];
+    ReportBuffer *buffer = &ctx->out;
+    const char *suggestion = NULL;
+    size_t suggestion_length = 0;
+    if (record->suggestion != NO_SUGGESTION) {
+        suggestion = ctx->diagnostic_text.data + record->suggestion;
+        suggestion_length = strlen(suggestion);
+    }
+    record->written = true;
+    
+    if (ctx->format == FORMAT_TEXT) {
+        format_diagnostic(ctx, record, buffer);
+        report_append(buffer, "\n", 1);
+        return;
+    }
+    ReportBuffer *message = &ctx->diagnostic_message;
+    message->length = 0;
+    format_diagnostic(ctx, record, message);
+    if (ctx->format == FORMAT_NDJSON) {
+        report_literal(buffer, "{\"type\":\"diagnostic\",\"code\":\"");
+        report_append(buffer, info->id, strlen(info->id));
+        report_literal(buffer, "\",\"severity\":");
+        if (info->severity == SEVERITY_WARNING) {
+            report_literal(buffer, "\"warning\"");
+        } else {
+            report_literal(buffer, "\"error\"");
+        }
+        report_literal(buffer, ",\"span\":");
+        if (record->token < 0) {
+            report_literal(buffer, "null");
+        } else {
+            report_literal(buffer, "{\"token\":");
+            report_append_int(buffer, record->token);
+            report_literal(buffer, ",\"offset\":");
+            report_append_int(buffer, record->span.offset);
+            report_literal(buffer, ",\"length\":");
+            report_append_int(buffer, record->span.length);
+            report_literal(buffer, ",\"line\":");
+            report_append_int(buffer, record->span.line);
+            report_literal(buffer, "}");
+        }
+        report_literal(buffer, ",\"suggestion\":");
+        if (suggestion != NULL) {
+            report_append_json_string(buffer, suggestion, suggestion_length);
+        } else {
+            report_literal(buffer, "null");
+        }
+        report_literal(buffer, ",\"message\":");
+        report_append_json_string(buffer, message->data, message->length);
+        report_literal(buffer, "}\n");
+    } else {
+        size_t start = record_begin(buffer, RECORD_DIAGNOSTIC);
+        report_append_u16(buffer, record->code);
+        report_append_u8(buffer, info->severity);
+        report_append_u32(buffer, (unsigned int)record->token);
+        report_append_u32(buffer, record->span.offset);
+        report_append_u32(buffer, record->span.length);
+        report_append_u32(buffer, record->span.line);
+        report_append_u16(buffer, suggestion_length);
+        report_append(buffer, suggestion != NULL ? suggestion : "", suggestion_length);
+        report_append_u32(buffer, message->length);
+        report_append(buffer, message->data, message->length);
+        record_end(buffer, start);
+    }
+}
+
+// Diagnóstico: conta o erro ou aviso e guarda o código, o token e os
+// argumentos; a mensagem só é montada quando é escrita. No relatório completo
+// ele sai na hora, no meio da listagem dos tokens. Nos outros níveis sai no
+// fim do arquivo, por flush_diagnostics(), e um diagnóstico igual a outro já
+// guardado (mesmo código, formato e argumentos) conta como erro ou aviso mas
+// não é escrito de novo: o guardado sai com o número de repetições.
+static void report_diagnostic(AnalysisContext *ctx, DiagnosticCode code, int token_index,
+                              const char *suggestion, const char *format, ...) {
+    const DiagnosticInfo *info = &DIAGNOSTIC_INFO[code];
+    // Passado o limite do arquivo, os erros não são relatados nem contados
+    if (info->severity == SEVERITY_ERROR && ctx->max_errors > 0 && ctx->error_count >= ctx->max_errors) return;
+    
+    va_list args;
+    va_start(args, format);
+    int args_length = pack_diagnostic_args(&ctx->diagnostic_text, format, args);
+    va_end(args);
+    DiagnosticRecord *record = store_diagnostic(ctx, code, token_index, format, args_length, suggestion, 1);
+    if (record == NULL || ctx->verbosity < VERBOSITY_TOKENS) return;
+    if (info->severity == SEVERITY_NOTE && ctx->format != FORMAT_TEXT) return;
+    write_diagnostic(ctx, record);
+}
+
+// Ordem do relatório: pela posição do token, e na ordem em que foram
+// relatados quando a posição é a mesma. Sem token, vão para o fim.
+static int compare_diagnostics(const void *a, const void *b) {
+    const DiagnosticRecord *x = a;
+    const DiagnosticRecord *y = b;
+    unsigned int token_x = (unsigned int)x->token;
+    unsigned int token_y = (unsigned int)y->token;
+    if (token_x != token_y) return token_x < token_y ? -1 : 1;
+    return x->args < y->args ? -1 : (x->args > y->args);
+}
+
+// Esvazia os diagnósticos guardados, limpando só as posições usadas da tabela
+static void clear_diagnostics(AnalysisContext *ctx) {
+    for (int d = 0; d < ctx->diagnostic_count; d++) {
+        if (ctx->diagnostics[d].slot != -1) ctx->diagnostic_slots[ctx->diagnostics[d].slot] = -1;
+    }
+    ctx->diagnostic_count = 0;
+    ctx->diagnostic_text.length = 0;
+    memset(ctx->diagnostic_code_counts, 0, sizeof(ctx->diagnostic_code_counts));
+}
+
+// Escreve em ordem os diagnósticos do arquivo que ainda não saíram, até o
+// limite por arquivo; só esses são formatados, e dos que passam do limite
+// fica só a contagem por código
+static void flush_diagnostics(AnalysisContext *ctx) {
+    if (ctx->diagnostic_count == 0) return;
+    if (ctx->verbosity >= VERBOSITY_DIAGNOSTICS) {
+        qsort(ctx->diagnostics, ctx->diagnostic_count, sizeof(DiagnosticRecord), compare_diagnostics);
+        
+        int written = 0;
+        int omitted[NUM_DIAGNOSTIC_CODES] = {0};
+        bool any_omitted = false;
+        for (int d = 0; d < ctx->diagnostic_count; d++) {
+            DiagnosticRecord *record = &ctx->diagnostics[d];
+            bool is_note = DIAGNOSTIC_INFO[record->code].severity == SEVERITY_NOTE;
+            if (record->written || (is_note && ctx->format != FORMAT_TEXT)) continue;
+            if (ctx->max_diagnostics > 0 && written >= ctx->max_diagnostics) {
+                if (!is_note) {
+                    omitted[record->code] += record->count;
+                    any_omitted = true;
+                }
+                continue;
+            }
+            write_diagnostic(ctx, record);
+            written++;
         }
-        // Balanceamento de colchetes
-        else if (strcmp(tokens[i], "[") == 0) {
-            bracket_count++;
-        } else if (strcmp(tokens[i], "]") == 0) {
-            bracket_count--;
-            if (bracket_count < 0) return false; // Fechamento sem abertura
+        if (any_omitted) {
+            report_printf(ctx, VERBOSITY_DIAGNOSTICS, "Diagnósticos omitidos (limite de %d por arquivo):\n", ctx->max_diagnostics);
+            for (int code = 0; code < NUM_DIAGNOSTIC_CODES; code++) {
+                if (omitted[code] == 0) continue;
+                report_printf(ctx, VERBOSITY_DIAGNOSTICS, "  %s: %d de %d\n", DIAGNOSTIC_INFO[code].id,
+                              omitted[code], ctx->diagnostic_code_counts[code]);
+            }
         }
     }
+    clear_diagnostics(ctx);
+}
+
+// Registro estruturado de um token classificado
+static void report_token_record(AnalysisContext *ctx, int index, const char *token, TokenClass token_class) {
+    ReportBuffer *buffer = &ctx->out;
+    TokenSpan *span = &ctx->spans[index];
+    
+    if (ctx->format == FORMAT_NDJSON) {
+        const char *name = TOKEN_CLASS_NAMES[token_class];
+        report_literal(buffer, "{\"type\":\"token\",\"index\":");
+        report_append_int(buffer, index);
+        report_literal(buffer, ",\"kind\":\"");
+        report_append(buffer, name, strlen(name));
+        report_literal(buffer, "\",\"offset\":");
+        report_append_int(buffer, span->offset);
+        report_literal(buffer, ",\"length\":");
+        report_append_int(buffer, span->length);
+        report_literal(buffer, ",\"line\":");
+        report_append_int(buffer, span->line);
+        report_literal(buffer, ",\"text\":");
+        report_append_json_string(buffer, token, strlen(token));
+        report_literal(buffer, "}\n");
+    } else {
+        size_t record = record_begin(buffer, RECORD_TOKEN);
+        report_append_u32(buffer, index);
+        report_append_u16(buffer, token_class);
+        report_append_u32(buffer, span->offset);
+        report_append_u32(buffer, span->length);
+        report_append_u32(buffer, span->line);
+        record_end(buffer, record);
+    }
+}
+
+// Linha de classificação: tokens[i] = "token" -> KIND
+static void report_token(AnalysisContext *ctx, int index, const char *token, TokenClass token_class) {
+    if (ctx->verbosity < VERBOSITY_TOKENS) return;
+    if (ctx->format != FORMAT_TEXT) {
+        report_token_record(ctx, index, token, token_class);
+        return;
+    }
+    ReportBuffer *buffer = &ctx->out;
+    const char *kind = TOKEN_CLASS_NAMES[token_class];
+    size_t token_length = strlen(token);
+    size_t kind_length = strlen(kind);
+    
+    report_reserve(buffer, token_length + kind_length + 32);
+    report_literal(buffer, "tokens[");
+    report_append_int(buffer, index);
+    report_literal(buffer, "] = \"");
+    report_append(buffer, token, token_length);
+    report_literal(buffer, "\" -> ");
+    report_append(buffer, kind, kind_length);
+    buffer->data[buffer->length++] = '\n';
+}
+
+// Chamada de função: no texto inclui a quantidade de parâmetros
+static void report_call_token(AnalysisContext *ctx, int index, const char *token, TokenClass token_class, int param_count) {
+    if (ctx->verbosity < VERBOSITY_TOKENS) return;
+    if (ctx->format != FORMAT_TEXT) {
+        report_token_record(ctx, index, token, token_class);
+        return;
+    }
+    report_printf(ctx, VERBOSITY_TOKENS, "tokens[%d] = \"%s\" -> %s (%d parâmetros)\n",
+                  index, token, TOKEN_CLASS_NAMES[token_class], param_count);
+}
+
+// Início do relatório de um arquivo
+static void report_file_begin(AnalysisContext *ctx, const char *path) {
+    ReportBuffer *buffer = &ctx->out;
+    size_t path_length = strlen(path);
+    
+    if (ctx->format == FORMAT_NDJSON) {
+        report_literal(buffer, "{\"type\":\"file\",\"path\":");
+        report_append_json_string(buffer, path, path_length);
+        report_literal(buffer, "}\n");
+    } else if (ctx->format == FORMAT_BINARY) {
+        size_t record = record_begin(buffer, RECORD_FILE_BEGIN);
+        report_append_u32(buffer, path_length);
+        report_append(buffer, path, path_length);
+        record_end(buffer, record);
+    } else {
+        report_printf(ctx, VERBOSITY_DIAGNOSTICS, "\n==============================\n");
+        report_printf(ctx, VERBOSITY_DIAGNOSTICS, "Processando arquivo: %s\n", path);
+    }
+}
+
+// Fim do relatório de um arquivo, com as contagens
+static void report_file_end(AnalysisContext *ctx, const char *path, int token_count) {
+    ReportBuffer *buffer = &ctx->out;
+    // Arquivos que não chegaram à análise ainda têm diagnósticos guardados
+    flush_diagnostics(ctx);
+    if (ctx->phase_clock.stats != NULL) ctx->phase_clock.stats->tokens = token_count;
+    
+    if (ctx->format == FORMAT_NDJSON) {
+        report_literal(buffer, "{\"type\":\"summary\",\"path\":");
+        report_append_json_string(buffer, path, strlen(path));
+        report_literal(buffer, ",\"tokens\":");
+        report_append_int(buffer, token_count);
+        report_literal(buffer, ",\"errors\":");
+        report_append_int(buffer, ctx->error_count);
+        report_literal(buffer, ",\"warnings\":");
+        report_append_int(buffer, ctx->warning_count);
+        report_literal(buffer, "}\n");
+        return;
+    }
+    if (ctx->format == FORMAT_BINARY) {
+        size_t record = record_begin(buffer, RECORD_FILE_END);
+        report_append_u32(buffer, token_count);
+        report_append_u32(buffer, ctx->error_count);
+        report_append_u32(buffer, ctx->warning_count);
+        record_end(buffer, record);
+        return;
+    }
     
-    // Verifica se todos estão balanceados
-    if (check_quotes && quote_count % 2 != 0) return false; // Aspas não balanceadas
-    return (paren_count == 0 && brace_count == 0 && bracket_count == 0);
+    // Linha única por arquivo do relatório resumido
+    if (ctx->verbosity != VERBOSITY_SUMMARY) return;
+    report_append(buffer, path, strlen(path));
+    report_literal(buffer, ": ");
+    report_append_int(buffer, token_count);
+    report_literal(buffer, " tokens, ");
+    report_append_int(buffer, ctx->error_count);
+    report_literal(buffer, " erros, ");
+    report_append_int(buffer, ctx->warning_count);
+    report_literal(buffer, " avisos\n");
+}
+
+// Cabeçalho do fluxo binário: tabelas de nomes das classes de token e dos
+// códigos de diagnóstico, para que o consumidor não precise deste código
+static void write_binary_header(FILE *stream) {
+    ReportBuffer header = {0};
+    report_append(&header, BINARY_MAGIC, 4);
+    report_append_u32(&header, BINARY_VERSION);
+    report_append_u32(&header, NUM_TOKEN_CLASSES);
+    for (int c = 0; c < NUM_TOKEN_CLASSES; c++) {
+        report_append_u16(&header, strlen(TOKEN_CLASS_NAMES[c]));
+        report_append(&header, TOKEN_CLASS_NAMES[c], strlen(TOKEN_CLASS_NAMES[c]));
+    }
+    report_append_u32(&header, NUM_DIAGNOSTIC_CODES);
+    for (int c = 0; c < NUM_DIAGNOSTIC_CODES; c++) {
+        report_append_u16(&header, strlen(DIAGNOSTIC_INFO[c].id));
+        report_append(&header, DIAGNOSTIC_INFO[c].id, strlen(DIAGNOSTIC_INFO[c].id));
+        report_append_u8(&header, DIAGNOSTIC_INFO[c].severity);
+    }
+    fwrite(header.data, 1, header.length, stream);
+    free(header.data);
+}
+
+// Função para validar duplo balanceamento em qualquer contexto: cada
+// abertura (ou aspas) do trecho precisa fechar dentro dele, e o que está
+// entre o par é pulado de uma vez pelo índice de pares
+static bool validate_double_balancing(AnalysisContext *ctx, int start_idx, int end_idx) {
+    for (int i = start_idx; i <= end_idx; i++) {
+        BracketType type = strcmp(ctx->tokens[i], "\"") == 0 ? BRACKET_OPEN : bracket_type(ctx->tokens[i]);
+        if (type == BRACKET_NONE) continue;
+        
+        int match = ctx->bracket_match[i];
+        if (type == BRACKET_CLOSE || match < i || match > end_idx) {
+            return false; // Fechamento sem abertura no trecho, ou abertura sem fechamento
+        }
+        i = match;
+    }
+    return true;
 }
 
 // Adiciona uma chamada de função pendente
-void add_pending_function_call(const char *func_name, int param_count, int line_number) {
-    PendingFunctionCall *new_call = safe_malloc(sizeof(PendingFunctionCall));
-    new_call->function_name = safe_malloc(strlen(func_name) + 1);
+static void add_pending_function_call(AnalysisContext *ctx, const char *func_name, int param_count, int line_number) {
+    PendingFunctionCall *new_call = safe_malloc(ctx, sizeof(PendingFunctionCall));
+    new_call->function_name = safe_malloc(ctx, strlen(func_name) + 1);
     strcpy(new_call->function_name, func_name);
     new_call->param_count = param_count;
     new_call->line_number = line_number;
-    new_call->next = pending_calls;
-    pending_calls = new_call;
+    new_call->token_index = ctx->current_token;
+    new_call->next = ctx->pending_calls;
+    ctx->pending_calls = new_call;
 }
 
-// Procura uma função em todo o arquivo de tokens
-bool find_function_definition(char **tokens, int length, const char *func_name, int *func_start, int *func_end) {
-    for (int i = 0; i < length - 1; i++) {
-        if (strcmp(tokens[i], "funcao") == 0 && i + 1 < length && 
-            strcmp(tokens[i + 1], func_name) == 0) {
-            
-            *func_start = i;
-            
-            // Procura o final da função (fechamento da chave)
-            int brace_count = 0;
-            bool found_opening = false;
-            
-            for (int j = i + 2; j < length; j++) {
-                if (strcmp(tokens[j], "{") == 0) {
-                    if (!found_opening) found_opening = true;
-                    brace_count++;
-                } else if (strcmp(tokens[j], "}") == 0) {
-                    brace_count--;
-                    if (found_opening && brace_count == 0) {
-                        *func_end = j;
-                        return true;
-                    }
-                }
-            }
+// Primeira definição completa da função, entre as que index_tokens() achou
+static bool find_function_definition(AnalysisContext *ctx, const char *func_name, int *func_start, int *func_end) {
+    for (int i = 0; i < ctx->function_count; i++) {
+        FunctionDefinition *function = &ctx->functions[i];
+        if (function->end != -1 && strcmp(function->name, func_name) == 0) {
+            *func_start = function->start;
+            *func_end = function->end;
+            return true;
         }
     }
     return false;
 }
 
-// Valida uma função específica encontrada no arquivo
-bool validate_found_function(char **tokens, int func_start, int func_end, int current_line) {
-    // Salva o estado atual da tabela de símbolos
-    int original_scope = symbol_table.current_scope;
-    
-    // Cria um novo escopo para a função
-    enter_scope();
-    
+// Função de primeiro nível de outro arquivo do projeto, ou NULL
+static ProjectFunction* project_index_find(ProjectIndex *index, const char *name) {
+    uint64_t hash = content_hash(name, strlen(name));
+    ProjectShard *shard = &index->shards[hash >> 58];
+    if (shard->bucket_count == 0) return NULL;
+    for (ProjectFunction *function = shard->buckets[hash & (shard->bucket_count - 1)];
+         function != NULL; function = function->next) {
+        if (function->hash == hash && strcmp(function->name, name) == 0) return function;
+    }
+    return NULL;
+}
+
+// Valida uma função específica encontrada no arquivo.
+// A validação é especulativa: quem chama deve tirar um snapshot da tabela de
+// símbolos antes e desfazê-lo com symbol_table_rollback(ctx) depois.
+static bool validate_found_function(AnalysisContext *ctx, char **tokens, int func_start, int func_end, int current_line) {
     // Processa a declaração da função
     int i = func_start;
     if (strcmp(tokens[i], "funcao") == 0) {
         i++; // Pula "funcao"
         
         if (i < func_end && strncmp(tokens[i], "__", 2) == 0) {
-            if (!validate_function_declaration(tokens[i])) {
-                exit_scope();
-                symbol_table.current_scope = original_scope;
+            if (!validate_function_declaration(ctx, tokens[i])) {
                 return false;
             }
             
             // Adiciona a função à tabela de símbolos se ainda não existe
-            Symbol *existing = lookup_symbol(tokens[i]);
+            Symbol *existing = lookup_symbol(ctx, tokens[i]);
             if (existing == NULL) {
-                if (!add_symbol(tokens[i], SYMBOL_FUNCTION, TYPE_VOID, current_line)) {
-                    exit_scope();
-                    symbol_table.current_scope = original_scope;
+                if (!add_symbol(ctx, tokens[i], i, SYMBOL_FUNCTION, TYPE_VOID, current_line)) {
                     return false;
                 }
             }
             
+            // Cria um novo escopo para os parâmetros da função
+            enter_scope(ctx);
+            
             i++; // Pula nome da função
             
             // Processa parâmetros se houver
             if (i < func_end && strcmp(tokens[i], "(") == 0) {
                 i++; // Pula "("
                 
-                Symbol *func_symbol = lookup_symbol(tokens[func_start + 1]);
+                Symbol *func_symbol = lookup_symbol(ctx, tokens[func_start + 1]);
                 if (func_symbol != NULL) {
                     // Processa parâmetros
                     while (i < func_end && strcmp(tokens[i], ")") != 0) {
@@ -213,9 +1540,7 @@ bool validate_found_function(char **tokens, int func_start, int func_end, int cu
                             
                             if (i < func_end && is_variable(tokens[i])) {
                                 // Adiciona parâmetro à tabela de símbolos
-                                if (!add_symbol(tokens[i], SYMBOL_PARAMETER, param_type, current_line)) {
-                                    exit_scope();
-                                    symbol_table.current_scope = original_scope;
+                                if (!add_symbol(ctx, tokens[i], i, SYMBOL_PARAMETER, param_type, current_line)) {
                                     return false;
                                 }
                                 
@@ -227,16 +1552,16 @@ bool validate_found_function(char **tokens, int func_start, int func_end, int cu
                                                                    func_symbol->param_count * sizeof(DataType));
                                 
                                 func_symbol->param_names[func_symbol->param_count - 1] = 
-                                    safe_malloc(strlen(tokens[i]) + 1);
+                                    safe_malloc(ctx, strlen(tokens[i]) + 1);
                                 strcpy(func_symbol->param_names[func_symbol->param_count - 1], tokens[i]);
                                 func_symbol->param_types[func_symbol->param_count - 1] = param_type;
                                 
                                 i++; // Pula nome do parâmetro
                             }
-                        }
-                        
-                        if (i < func_end && strcmp(tokens[i], ",") == 0) {
+                        } else if (strcmp(tokens[i], ",") == 0) {
                             i++; // Pula vírgula
+                        } else {
+                            i++; // Ignora tokens inesperados na lista de parâmetros
                         }
                     }
                 }
@@ -244,43 +1569,56 @@ bool validate_found_function(char **tokens, int func_start, int func_end, int cu
         }
     }
     
-    // Restaura o escopo original
-    exit_scope();
-    symbol_table.current_scope = original_scope;
     return true;
 }
 
 // Valida todas as chamadas pendentes
-bool validate_pending_function_calls(char **tokens, int length) {
-    PendingFunctionCall *current = pending_calls;
+static bool validate_pending_function_calls(AnalysisContext *ctx) {
+    PendingFunctionCall *current = ctx->pending_calls;
     bool all_valid = true;
     
     while (current != NULL) {
-        Symbol *func = lookup_symbol(current->function_name);
+        // Os diagnósticos desta chamada apontam para o token da chamada
+        ctx->current_token = current->token_index;
+        Symbol *func = lookup_symbol(ctx, current->function_name);
         
         if (func == NULL) {
-            // 1.10. Procura a função em todo o arquivo
+            // 1.10. Procura a função em todo o arquivo e, no modo projeto,
+            // nos outros arquivos
             int func_start, func_end;
-            if (find_function_definition(tokens, length, current->function_name, &func_start, &func_end)) {
-                // Valida a função encontrada
-                if (validate_found_function(tokens, func_start, func_end, current->line_number)) {
+            ProjectFunction *exported;
+            if (find_function_definition(ctx, current->function_name, &func_start, &func_end)) {
+                // Valida a função encontrada de forma especulativa sobre a
+                // tabela base; o rollback descarta tudo o que foi inserido
+                SymbolSnapshot base = symbol_table_snapshot(ctx);
+                if (validate_found_function(ctx, ctx->tokens, func_start, func_end, current->line_number)) {
                     // Revalida a chamada agora que a função foi processada
-                    if (!validate_function_call(current->function_name, current->param_count, current->line_number)) {
+                    if (!validate_function_call(ctx, current->function_name, current->param_count, current->line_number)) {
                         all_valid = false;
                     }
                 } else {
-                    printf("SEMANTIC ERROR (linha %d): Erro na validação da função '%s'\n", 
+                    report_diagnostic(ctx, DIAG_INVALID_CALL, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): Erro na validação da função '%s'\n", 
                            current->line_number, current->function_name);
                     all_valid = false;
                 }
+                symbol_table_rollback(ctx, base);
+            } else if (ctx->project != NULL &&
+                       (exported = project_index_find(ctx->project, current->function_name)) != NULL) {
+                // Definida em outro arquivo do projeto
+                if (exported->param_count != current->param_count) {
+                    report_diagnostic(ctx, DIAG_ARGUMENT_COUNT, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): Função '%s' (%s, linha %d) espera %d parâmetros, mas %d foram fornecidos\n",
+                           current->line_number, current->function_name, exported->path, exported->line,
+                           exported->param_count, current->param_count);
+                    all_valid = false;
+                }
             } else {
-                printf("SEMANTIC ERROR (linha %d): Função '%s' não encontrada em todo o arquivo\n", 
-                       current->line_number, current->function_name);
+                report_diagnostic(ctx, DIAG_UNDECLARED_FUNCTION, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): Função '%s' não encontrada em todo o %s\n", 
+                       current->line_number, current->function_name, ctx->project != NULL ? "projeto" : "arquivo");
                 all_valid = false;
             }
         } else {
             // Função já existe, apenas valida a chamada
-            if (!validate_function_call(current->function_name, current->param_count, current->line_number)) {
+            if (!validate_function_call(ctx, current->function_name, current->param_count, current->line_number)) {
                 all_valid = false;
             }
         }
@@ -292,19 +1630,19 @@ bool validate_pending_function_calls(char **tokens, int length) {
 }
 
 // Limpa a lista de chamadas pendentes
-void clear_pending_function_calls() {
-    PendingFunctionCall *current = pending_calls;
+static void clear_pending_function_calls(AnalysisContext *ctx) {
+    PendingFunctionCall *current = ctx->pending_calls;
     while (current != NULL) {
         PendingFunctionCall *next = current->next;
         free(current->function_name);
         free(current);
         current = next;
     }
-    pending_calls = NULL;
+    ctx->pending_calls = NULL;
 }
 
 // Funções da tabela de símbolos
-unsigned int hash_function(const char *name) {
+static unsigned int hash_function(const char *name) {
     unsigned int hash = 0;
     for (int i = 0; name[i] != '\0'; i++) {
         hash = hash * 31 + name[i];
@@ -312,23 +1650,29 @@ unsigned int hash_function(const char *name) {
     return hash % MAX_SYMBOLS;
 }
 
-void init_symbol_table() {
-    symbol_table.count = 0;
-    symbol_table.current_scope = 0;
+static void init_symbol_table(AnalysisContext *ctx) {
+    // Libera os símbolos que sobraram da análise anterior
+    while (ctx->symbol_table.trail_top > 0) {
+        pop_trail_symbol(ctx);
+    }
+    ctx->symbol_table.count = 0;
+    ctx->symbol_table.current_scope = 0;
+    ctx->symbol_table.inserted = 0;
     for (int i = 0; i < MAX_SYMBOLS; i++) {
-        symbol_table.symbols[i] = NULL;
+        ctx->symbol_table.symbols[i] = NULL;
     }
 }
 
-Symbol* create_symbol(const char *name, SymbolType symbol_type, DataType data_type, int line) {
-    Symbol *new_symbol = safe_malloc(sizeof(Symbol));
-    new_symbol->name = safe_malloc(strlen(name) + 1);
+static Symbol* create_symbol(AnalysisContext *ctx, const char *name, int token, SymbolType symbol_type, DataType data_type, int line) {
+    Symbol *new_symbol = safe_malloc(ctx, sizeof(Symbol));
+    new_symbol->name = safe_malloc(ctx, strlen(name) + 1);
     strcpy(new_symbol->name, name);
     new_symbol->symbol_type = symbol_type;
     new_symbol->data_type = data_type;
-    new_symbol->scope_level = symbol_table.current_scope;
+    new_symbol->scope_level = ctx->symbol_table.current_scope;
     new_symbol->line_declared = line;
-    new_symbol->is_used = false;
+    new_symbol->token_declared = ctx->current_token;
+    new_symbol->name_token = token;
     new_symbol->param_count = 0;
     new_symbol->param_names = NULL;
     new_symbol->param_types = NULL;
@@ -336,46 +1680,65 @@ Symbol* create_symbol(const char *name, SymbolType symbol_type, DataType data_ty
     return new_symbol;
 }
 
-bool add_symbol(const char *name, SymbolType symbol_type, DataType data_type, int line) {
+static bool add_symbol(AnalysisContext *ctx, const char *name, int token, SymbolType symbol_type, DataType data_type, int line) {
     // Verifica se o símbolo já existe no escopo atual
-    Symbol *existing = lookup_symbol_current_scope(name);
+    Symbol *existing = lookup_symbol_current_scope(ctx, name);
     if (existing != NULL) {
-        printf("SEMANTIC ERROR: Símbolo '%s' já declarado na linha %d\n", name, existing->line_declared);
+        report_diagnostic(ctx, DIAG_REDECLARED_SYMBOL, ctx->current_token, NULL, "SEMANTIC ERROR: Símbolo '%s' já declarado na linha %d\n", name, existing->line_declared);
         return false;
     }
     
-    unsigned int index = hash_function(name);
-    Symbol *new_symbol = create_symbol(name, symbol_type, data_type, line);
+    insert_symbol(ctx, create_symbol(ctx, name, token, symbol_type, data_type, line));
+    return true;
+}
+
+// Liga um símbolo já criado à tabela, no escopo que ele guarda
+static void insert_symbol(AnalysisContext *ctx, Symbol *symbol) {
+    unsigned int index = hash_function(symbol->name);
     
     // Inserção no início da lista ligada (tratamento de colisão)
-    new_symbol->next = symbol_table.symbols[index];
-    symbol_table.symbols[index] = new_symbol;
-    symbol_table.count++;
+    symbol->next = ctx->symbol_table.symbols[index];
+    ctx->symbol_table.symbols[index] = symbol;
+    ctx->symbol_table.count++;
+    symbol->order = ctx->symbol_table.inserted++;
     
-    return true;
+    // Registra a nova versão na trilha
+    if (ctx->symbol_table.trail_top == ctx->symbol_table.trail_capacity) {
+        ctx->symbol_table.trail_capacity = ctx->symbol_table.trail_capacity ? ctx->symbol_table.trail_capacity * 2 : 64;
+        ctx->symbol_table.trail = realloc(ctx->symbol_table.trail, ctx->symbol_table.trail_capacity * sizeof(Symbol*));
+    }
+    ctx->symbol_table.trail[ctx->symbol_table.trail_top++] = symbol;
 }
 
-Symbol* lookup_symbol(const char *name) {
+// No contexto de um corpo de função, o que não está nos escopos do corpo
+// vem da tabela do arquivo, vista como estava quando o corpo começou
+static Symbol* lookup_symbol(AnalysisContext *ctx, const char *name) {
     unsigned int index = hash_function(name);
-    Symbol *current = symbol_table.symbols[index];
+    Symbol *current = ctx->symbol_table.symbols[index];
     
     while (current != NULL) {
         if (strcmp(current->name, name) == 0) {
-            current->is_used = true;
             return current;
         }
         current = current->next;
     }
+    if (ctx->owner == NULL) return NULL;
+    
+    for (current = ctx->owner->symbol_table.symbols[index]; current != NULL; current = current->next) {
+        if (current->order < ctx->visible_symbols && strcmp(current->name, name) == 0) {
+            return current;
+        }
+    }
     return NULL;
 }
 
-Symbol* lookup_symbol_current_scope(const char *name) {
+static Symbol* lookup_symbol_current_scope(AnalysisContext *ctx, const char *name) {
     unsigned int index = hash_function(name);
-    Symbol *current = symbol_table.symbols[index];
+    Symbol *current = ctx->symbol_table.symbols[index];
     
     while (current != NULL) {
         if (strcmp(current->name, name) == 0 && 
-            current->scope_level == symbol_table.current_scope) {
+            current->scope_level == ctx->symbol_table.current_scope) {
             return current;
         }
         current = current->next;
@@ -383,89 +1746,120 @@ Symbol* lookup_symbol_current_scope(const char *name) {
     return NULL;
 }
 
-void enter_scope() {
-    symbol_table.current_scope++;
+static void enter_scope(AnalysisContext *ctx) {
+    ctx->symbol_table.current_scope++;
 }
 
-void exit_scope() {
-    // Remove símbolos do escopo atual
-    for (int i = 0; i < MAX_SYMBOLS; i++) {
-        Symbol *current = symbol_table.symbols[i];
-        Symbol *prev = NULL;
-        
-        while (current != NULL) {
-            if (current->scope_level == symbol_table.current_scope) {
-                if (prev == NULL) {
-                    symbol_table.symbols[i] = current->next;
-                } else {
-                    prev->next = current->next;
-                }
-                
-                if (!current->is_used) {
-                    printf("WARNING: Símbolo '%s' declarado mas não utilizado (linha %d)\n", 
-                           current->name, current->line_declared);
-                }
-                
-                free(current->name);
-                Symbol *to_delete = current;
-                current = current->next;
-                free(to_delete);
-                symbol_table.count--;
-            } else {
-                prev = current;
-                current = current->next;
-            }
-        }
-    }
+// Tira o símbolo mais recente da trilha sem liberá-lo. Como inserções e
+// remoções seguem a ordem LIFO da trilha, ele está sempre no início do seu
+// bucket.
+static Symbol* unlink_trail_symbol(AnalysisContext *ctx) {
+    Symbol *top = ctx->symbol_table.trail[--ctx->symbol_table.trail_top];
+    unsigned int index = hash_function(top->name);
     
-    if (symbol_table.current_scope > 0) {
-        symbol_table.current_scope--;
+    if (ctx->symbol_table.symbols[index] == top) {
+        ctx->symbol_table.symbols[index] = top->next;
+    } else {
+        Symbol *prev = ctx->symbol_table.symbols[index];
+        while (prev != NULL && prev->next != top) {
+            prev = prev->next;
+        }
+        if (prev != NULL) prev->next = top->next;
     }
+    ctx->symbol_table.count--;
+    return top;
 }
 
-const char* symbol_type_to_string(SymbolType type) {
-    switch (type) {
-        case SYMBOL_VARIABLE: return "VARIABLE";
-        case SYMBOL_FUNCTION: return "FUNCTION";
-        case SYMBOL_PARAMETER: return "PARAMETER";
-        default: return "UNKNOWN";
+static void free_symbol(Symbol *symbol) {
+    for (int i = 0; i < symbol->param_count; i++) {
+        free(symbol->param_names[i]);
     }
+    free(symbol->param_names);
+    free(symbol->param_types);
+    free(symbol->name);
+    free(symbol);
 }
 
-const char* data_type_to_string(DataType type) {
-    switch (type) {
-        case TYPE_INTEGER: return "INTEGER";
-        case TYPE_STRING: return "STRING";
-        case TYPE_FLOAT: return "FLOAT";
-        case TYPE_VOID: return "VOID";
+// Remove o símbolo mais recente da trilha
+static void pop_trail_symbol(AnalysisContext *ctx) {
+    free_symbol(unlink_trail_symbol(ctx));
+}
+
+static void exit_scope(AnalysisContext *ctx) {
+    // Os símbolos do escopo atual formam o sufixo da trilha
+    int scope_start = ctx->symbol_table.trail_top;
+    while (scope_start > 0 && 
+           ctx->symbol_table.trail[scope_start - 1]->scope_level == ctx->symbol_table.current_scope) {
+        scope_start--;
+    }
+    
+    // Avisos na ordem de declaração
+    for (int i = scope_start; i < ctx->symbol_table.trail_top; i++) {
+        Symbol *current = ctx->symbol_table.trail[i];
+        if (!symbol_used(ctx, current)) {
+            report_diagnostic(ctx, DIAG_UNUSED_SYMBOL, current->token_declared, NULL, "WARNING: Símbolo '%s' declarado mas não utilizado (linha %d)\n", 
+                   current->name, current->line_declared);
+        }
+    }
+    
+    while (ctx->symbol_table.trail_top > scope_start) {
+        pop_trail_symbol(ctx);
+    }
+    
+    if (ctx->symbol_table.current_scope > 0) {
+        ctx->symbol_table.current_scope--;
+    }
+}
+
+static SymbolSnapshot symbol_table_snapshot(AnalysisContext *ctx) {
+    SymbolSnapshot snapshot;
+    snapshot.trail_top = ctx->symbol_table.trail_top;
+    snapshot.count = ctx->symbol_table.count;
+    snapshot.current_scope = ctx->symbol_table.current_scope;
+    return snapshot;
+}
+
+// Volta a tabela para a versão do snapshot, descartando apenas o que foi
+// inserido depois dele (sem varrer os buckets e sem emitir avisos)
+static void symbol_table_rollback(AnalysisContext *ctx, SymbolSnapshot snapshot) {
+    while (ctx->symbol_table.trail_top > snapshot.trail_top) {
+        pop_trail_symbol(ctx);
+    }
+    ctx->symbol_table.count = snapshot.count;
+    ctx->symbol_table.current_scope = snapshot.current_scope;
+}
+
+static const char* symbol_type_to_string(SymbolType type) {
+    switch (type) {
+        case SYMBOL_VARIABLE: return "VARIABLE";
+        case SYMBOL_FUNCTION: return "FUNCTION";
+        case SYMBOL_PARAMETER: return "PARAMETER";
         default: return "UNKNOWN";
     }
 }
 
-void infer_parameter_types() {
-    // Percorre a tabela de símbolos para inferir tipos de parâmetros baseado no uso
-    for (int i = 0; i < MAX_SYMBOLS; i++) {
-        Symbol *current = symbol_table.symbols[i];
-        while (current != NULL) {
-            if (current->symbol_type == SYMBOL_PARAMETER && current->data_type == TYPE_UNKNOWN) {
-                // Por padrão, assume que parâmetros são inteiros se usados em operações aritméticas
-                // Esta é uma simplificação - em um compilador real, faria análise mais sofisticada
-                current->data_type = TYPE_INTEGER;
-            }
-            current = current->next;
-        }
+static const char* data_type_to_string(DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: return "INTEGER";
+        case TYPE_STRING: return "STRING";
+        case TYPE_FLOAT: return "FLOAT";
+        case TYPE_VOID: return "VOID";
+        default: return "UNKNOWN";
     }
 }
 
-void update_parameter_type(const char *param_name, DataType new_type) {
-    Symbol *param = lookup_symbol(param_name);
-    if (param != NULL && param->symbol_type == SYMBOL_PARAMETER) {
-        param->data_type = new_type;
+// Nome do tipo na linguagem, usado nas mensagens
+static const char* data_type_keyword(DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: return "inteiro";
+        case TYPE_STRING: return "texto";
+        case TYPE_FLOAT: return "decimal";
+        default: return "desconhecido";
     }
 }
 
-void add_function_parameter(const char *func_name, const char *param_name, DataType param_type) {
-    Symbol *func = lookup_symbol(func_name);
+static void add_function_parameter(AnalysisContext *ctx, const char *func_name, const char *param_name, DataType param_type) {
+    Symbol *func = lookup_symbol(ctx, func_name);
     if (func != NULL && func->symbol_type == SYMBOL_FUNCTION) {
         func->param_count++;
         
@@ -474,61 +1868,60 @@ void add_function_parameter(const char *func_name, const char *param_name, DataT
         func->param_types = realloc(func->param_types, func->param_count * sizeof(DataType));
         
         // Adiciona o novo parâmetro
-        func->param_names[func->param_count - 1] = safe_malloc(strlen(param_name) + 1);
+        func->param_names[func->param_count - 1] = safe_malloc(ctx, strlen(param_name) + 1);
         strcpy(func->param_names[func->param_count - 1], param_name);
         func->param_types[func->param_count - 1] = param_type;
     }
 }
 
-bool validate_function_call(const char *func_name, int provided_params, int line) {
-    Symbol *func = lookup_symbol(func_name);
+static bool validate_function_call(AnalysisContext *ctx, const char *func_name, int provided_params, int line) {
+    Symbol *func = lookup_symbol(ctx, func_name);
     if (func == NULL) {
-        printf("SEMANTIC ERROR (linha %d): Função '%s' não declarada\n", line, func_name);
+        report_diagnostic(ctx, DIAG_UNDECLARED_FUNCTION, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): Função '%s' não declarada\n", line, func_name);
         return false;
     }
     
     if (func->symbol_type != SYMBOL_FUNCTION) {
-        printf("SEMANTIC ERROR (linha %d): '%s' não é uma função\n", line, func_name);
+        report_diagnostic(ctx, DIAG_NOT_A_FUNCTION, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): '%s' não é uma função\n", line, func_name);
         return false;
     }
     
     if (func->param_count != provided_params) {
-        printf("SEMANTIC ERROR (linha %d): Função '%s' espera %d parâmetros, mas %d foram fornecidos\n", 
+        report_diagnostic(ctx, DIAG_ARGUMENT_COUNT, ctx->current_token, NULL, "SEMANTIC ERROR (linha %d): Função '%s' espera %d parâmetros, mas %d foram fornecidos\n", 
                line, func_name, func->param_count, provided_params);
         return false;
     }
     
-    func->is_used = true;
     return true;
 }
 
-bool validate_function_declaration(const char *func_name) {
+static bool validate_function_declaration(AnalysisContext *ctx, const char *func_name) {
     // Verifica se o nome da função segue o padrão (deve começar com __)
     if (strncmp(func_name, "__", 2) != 0) {
-        printf("SEMANTIC ERROR: Nome de função '%s' deve começar com '__'\n", func_name);
+        report_diagnostic(ctx, DIAG_BAD_FUNCTION_NAME, ctx->current_token, NULL, "SEMANTIC ERROR: Nome de função '%s' deve começar com '__'\n", func_name);
         return false;
     }
     
     // Verifica se não é apenas "__"
     if (strlen(func_name) <= 2) {
-        printf("SEMANTIC ERROR: Nome de função '%s' é inválido (muito curto)\n", func_name);
+        report_diagnostic(ctx, DIAG_BAD_FUNCTION_NAME, ctx->current_token, NULL, "SEMANTIC ERROR: Nome de função '%s' é inválido (muito curto)\n", func_name);
         return false;
     }
     
     return true;
 }
 
-bool is_parameter_redeclaration(const char *var_name) {
+static bool is_parameter_redeclaration(AnalysisContext *ctx, const char *var_name) {
     // Verifica se a variável é um parâmetro no escopo atual
-    Symbol *existing = lookup_symbol(var_name);
+    Symbol *existing = lookup_symbol(ctx, var_name);
     if (existing != NULL && existing->symbol_type == SYMBOL_PARAMETER && 
-        existing->scope_level == symbol_table.current_scope) {
+        existing->scope_level == ctx->symbol_table.current_scope) {
         return true;
     }
     return false;
 }
 
-bool validate_parameter_list(char **tokens, int start_idx, int end_idx) {
+static bool validate_parameter_list(AnalysisContext *ctx, char **tokens, int start_idx, int end_idx) {
     // Valida se os parâmetros estão corretamente separados por vírgulas
     bool expecting_param = true;
     bool expecting_comma = false;
@@ -539,7 +1932,7 @@ bool validate_parameter_list(char **tokens, int start_idx, int end_idx) {
                 expecting_param = false;
                 expecting_comma = true;
             } else {
-                printf("SYNTAX ERROR: Esperado parâmetro na posição %d, encontrado '%s'\n", i, tokens[i]);
+                report_diagnostic(ctx, DIAG_BAD_PARAMETER_LIST, i, NULL, "SYNTAX ERROR: Esperado parâmetro na posição %d, encontrado '%s'\n", i, tokens[i]);
                 return false;
             }
         } else if (expecting_comma) {
@@ -549,107 +1942,96 @@ bool validate_parameter_list(char **tokens, int start_idx, int end_idx) {
             } else if (strcmp(tokens[i], ")") == 0) {
                 break; // Final da lista de parâmetros
             } else {
-                printf("SYNTAX ERROR: Esperada vírgula após parâmetro, encontrado '%s'\n", tokens[i]);
+                report_diagnostic(ctx, DIAG_BAD_PARAMETER_LIST, i, NULL, "SYNTAX ERROR: Esperada vírgula após parâmetro, encontrado '%s'\n", tokens[i]);
                 return false;
             }
         }
     }
     
     if (expecting_param) {
-        printf("SYNTAX ERROR: Lista de parâmetros incompleta - esperado parâmetro após vírgula\n");
+        report_diagnostic(ctx, DIAG_BAD_PARAMETER_LIST, ctx->current_token, NULL, "SYNTAX ERROR: Lista de parâmetros incompleta - esperado parâmetro após vírgula\n");
         return false;
     }
     
     return true;
 }
 
-bool validate_leia_command(char **tokens, int start_idx, int *end_idx, int current_line) {
+static bool validate_leia_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line) {
+    char **tokens = ctx->tokens;
+    int open = node->token + 1;
+    AstNode *list = node->child;
+    
     // 4.3. Haverá sempre um duplo balanceamento utilizando os parênteses
-    if (start_idx >= *end_idx || strcmp(tokens[start_idx], "(") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'leia' deve ser seguido por '('\n", current_line);
+    if (open >= *end_idx || list == NULL) {
+        report_diagnostic(ctx, DIAG_EXPECTED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'leia' deve ser seguido por '('\n", current_line);
         return false;
     }
     
-    int i = start_idx + 1;
-    int paren_count = 1;
-    int close_paren_pos = -1;
-    bool expecting_variable = true;
-    bool expecting_comma = false;
-    int var_count = 0;
-    
-    // Procura o fechamento dos parênteses e valida o conteúdo
-    while (i < *end_idx && paren_count > 0) {
-        if (strcmp(tokens[i], "(") == 0) {
-            paren_count++;
-        } else if (strcmp(tokens[i], ")") == 0) {
-            paren_count--;
-            if (paren_count == 0) {
-                close_paren_pos = i;
-                break;
-            }
-        } else if (paren_count == 1) { // Apenas no nível principal dos parênteses
-            if (expecting_variable) {
-                if (is_variable(tokens[i])) {
-                    // 4.1. Variáveis devem ser declaradas anteriormente
-                    char *var_name = safe_malloc(strlen(tokens[i]) + 1);
-                    strcpy(var_name, tokens[i]);
-                    char *comma = strchr(var_name, ',');
-                    if (comma) *comma = '\0';
-                    
-                    Symbol *var = lookup_symbol(var_name);
-                    if (var == NULL) {
-                        printf("SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, var_name);
-                        free(var_name);
-                        return false;
-                    }
-                    
-                    // 4.2. Não podem ser feitas declarações dentro da estrutura de leitura
-                    if (var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
-                        printf("SEMANTIC ERROR (linha %d): '%s' não é uma variável válida para leitura\n", current_line, var_name);
-                        free(var_name);
-                        return false;
-                    }
-                    
-                    var->is_used = true;
-                    var_count++;
-                    expecting_variable = false;
-                    expecting_comma = true;
-                    free(var_name);
-                } else {
-                    printf("SYNTAX ERROR (linha %d): Esperada variável no comando 'leia', encontrado '%s'\n", current_line, tokens[i]);
-                    return false;
-                }
-            } else if (expecting_comma) {
-                if (strcmp(tokens[i], ",") == 0) {
-                    expecting_variable = true;
-                    expecting_comma = false;
-                } else {
-                    printf("SYNTAX ERROR (linha %d): Esperada vírgula entre variáveis no comando 'leia', encontrado '%s'\n", current_line, tokens[i]);
-                    return false;
-                }
-            }
+    // A lista já foi conferida pelo parser; a regra quebrada só vale dentro do trecho
+    CommandCheck *check = node->check;
+    int close_paren_pos = bracket_end_before(ctx, open, *end_idx);
+    int scan_end = close_paren_pos != -1 ? close_paren_pos : *end_idx;
+    int broken = (check->rule == CHECK_EXPECTED_ITEM || check->rule == CHECK_EXPECTED_COMMA) &&
+                 check->token < scan_end ? check->token : -1;
+    int stop = broken != -1 ? broken : scan_end;
+    
+    for (AstNode *item = list->child; item != NULL; item = item->next) {
+        AstNode *lead = ast_leading(item);
+        if (lead->token >= stop) break;
+        if (lead->kind == AST_GROUP) {
+            if (lead->end == -1) break;
+            continue;
         }
-        i++;
+        
+        // 4.1. Variáveis devem ser declaradas anteriormente
+        char *var_name = safe_malloc(ctx, strlen(tokens[lead->token]) + 1);
+        strcpy(var_name, tokens[lead->token]);
+        char *comma = strchr(var_name, ',');
+        if (comma) *comma = '\0';
+        
+        Symbol *var = lookup_symbol(ctx, var_name);
+        if (var == NULL) {
+            report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, lead->token, NULL, "SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, var_name);
+            free(var_name);
+            return false;
+        }
+        
+        // 4.2. Não podem ser feitas declarações dentro da estrutura de leitura
+        if (var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
+            report_diagnostic(ctx, DIAG_NOT_A_VARIABLE, lead->token, NULL, "SEMANTIC ERROR (linha %d): '%s' não é uma variável válida para leitura\n", current_line, var_name);
+            free(var_name);
+            return false;
+        }
+        free(var_name);
+    }
+    
+    if (broken != -1 && check->rule == CHECK_EXPECTED_ITEM) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, broken, NULL, "SYNTAX ERROR (linha %d): Esperada variável no comando 'leia', encontrado '%s'\n", current_line, tokens[broken]);
+        return false;
+    }
+    if (broken != -1) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, broken, NULL, "SYNTAX ERROR (linha %d): Esperada vírgula entre variáveis no comando 'leia', encontrado '%s'\n", current_line, tokens[broken]);
+        return false;
     }
     
     if (close_paren_pos == -1) {
-        printf("SYNTAX ERROR (linha %d): Comando 'leia' sem fechamento de parênteses\n", current_line);
+        report_diagnostic(ctx, DIAG_UNCLOSED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'leia' sem fechamento de parênteses\n", current_line);
         return false;
     }
     
-    if (expecting_variable && var_count > 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'leia' termina com vírgula sem variável\n", current_line);
+    if (check->rule == CHECK_TRAILING_COMMA) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, check->token, NULL, "SYNTAX ERROR (linha %d): Comando 'leia' termina com vírgula sem variável\n", current_line);
         return false;
     }
     
-    if (var_count == 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'leia' deve ter pelo menos uma variável\n", current_line);
+    if (check->rule == CHECK_EMPTY) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, open, NULL, "SYNTAX ERROR (linha %d): Comando 'leia' deve ter pelo menos uma variável\n", current_line);
         return false;
     }
     
     // 4.4. A linha deve ser finalizada com ponto e vírgula
-    if (close_paren_pos + 1 < *end_idx && strcmp(tokens[close_paren_pos + 1], ";") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'leia' deve ser finalizado com ';'\n", current_line);
+    if (close_paren_pos + 1 < *end_idx && ctx->token_kinds[close_paren_pos + 1] != KIND_SEMICOLON) {
+        report_diagnostic(ctx, DIAG_MISSING_SEMICOLON, close_paren_pos + 1, NULL, "SYNTAX ERROR (linha %d): Comando 'leia' deve ser finalizado com ';'\n", current_line);
         return false;
     }
     
@@ -657,559 +2039,338 @@ bool validate_leia_command(char **tokens, int start_idx, int *end_idx, int curre
     return true;
 }
 
-bool validate_escreva_command(char **tokens, int start_idx, int *end_idx, int current_line) {
+static bool validate_escreva_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line) {
+    char **tokens = ctx->tokens;
+    int open = node->token + 1;
+    AstNode *list = node->child;
+    
     // 5.9. Haverá sempre um duplo balanceamento utilizando os parênteses
-    if (start_idx >= *end_idx || strcmp(tokens[start_idx], "(") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'escreva' deve ser seguido por '('\n", current_line);
+    if (open >= *end_idx || list == NULL) {
+        report_diagnostic(ctx, DIAG_EXPECTED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'escreva' deve ser seguido por '('\n", current_line);
         return false;
     }
     
-    int i = start_idx + 1;
-    int paren_count = 1;
-    int close_paren_pos = -1;
-    bool expecting_content = true;
-    bool expecting_comma = false;
-    int content_count = 0;
-    bool in_string = false;
+    // A lista já foi conferida pelo parser; a regra quebrada só vale dentro do trecho
+    CommandCheck *check = node->check;
+    int close_paren_pos = bracket_end_before(ctx, open, *end_idx);
+    int scan_end = close_paren_pos != -1 ? close_paren_pos : *end_idx;
+    int broken = (check->rule == CHECK_EXPECTED_ITEM || check->rule == CHECK_EXPECTED_COMMA) &&
+                 check->token < scan_end ? check->token : -1;
+    int stop = broken != -1 ? broken : scan_end;
+    int open_string = -1;
     
-    // Procura o fechamento dos parênteses e valida o conteúdo
-    while (i < *end_idx && paren_count > 0) {
-        if (tokens[i] == NULL) break; // Proteção contra tokens nulos
-        
-        if (strcmp(tokens[i], "(") == 0 && !in_string) {
-            paren_count++;
-        } else if (strcmp(tokens[i], ")") == 0 && !in_string) {
-            paren_count--;
-            if (paren_count == 0) {
-                close_paren_pos = i;
+    for (AstNode *item = list->child; item != NULL; item = item->next) {
+        AstNode *lead = ast_leading(item);
+        if (lead->token >= stop) break;
+        if (lead->kind == AST_GROUP) {
+            if (lead->end == -1) break;
+            continue;
+        }
+        if (lead->kind == AST_STRING) {
+            // 5.9. Balanceamento de aspas duplas para texto
+            if (lead->end == -1 || lead->end >= scan_end) {
+                open_string = lead->token;
                 break;
             }
-        } else if (paren_count == 1) { // Apenas no nível principal dos parênteses
-            if (strcmp(tokens[i], "\"") == 0) {
-                // 5.9. Balanceamento de aspas duplas para texto
-                if (!in_string) {
-                    in_string = true;
-                    if (expecting_content) {
-                        expecting_content = false;
-                        expecting_comma = true;
-                        content_count++;
-                    }
-                } else {
-                    in_string = false;
-                }
-            } else if (in_string) {
-                // 5.4. Textos dentro de aspas duplas - aceita qualquer conteúdo
-                // Não faz nada, apenas continua
-            } else if (expecting_content) {
-                if (is_variable(tokens[i])) {
-                    // 5.3, 5.6. Variáveis devem ser declaradas anteriormente
-                    Symbol *var = lookup_symbol(tokens[i]);
-                    if (var == NULL) {
-                        printf("SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, tokens[i]);
-                        return false;
-                    }
-                    
-                    // 5.8. Não podem ser feitas declarações dentro da estrutura de escrita
-                    if (var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
-                        printf("SEMANTIC ERROR (linha %d): '%s' não é uma variável válida para escrita\n", current_line, tokens[i]);
-                        return false;
-                    }
-                    
-                    var->is_used = true;
-                    content_count++;
-                    expecting_content = false;
-                    expecting_comma = true;
-                } else if (strcmp(tokens[i], "\n") == 0) {
-                    // Ignora quebras de linha
-                    i++;
-                    continue;
-                } else {
-                    printf("SYNTAX ERROR (linha %d): Esperado texto (entre aspas) ou variável no comando 'escreva', encontrado '%s'\n", current_line, tokens[i]);
-                    return false;
-                }
-            } else if (expecting_comma) {
-                if (strcmp(tokens[i], ",") == 0) {
-                    // 5.2, 5.6. Vírgula para separar conteúdo
-                    expecting_content = true;
-                    expecting_comma = false;
-                } else if (strcmp(tokens[i], "\n") == 0) {
-                    // Ignora quebras de linha
-                    i++;
-                    continue;
-                } else {
-                    printf("SYNTAX ERROR (linha %d): Esperada vírgula entre elementos no comando 'escreva', encontrado '%s'\n", current_line, tokens[i]);
-                    return false;
-                }
-            }
+            continue;
+        }
+        
+        // 5.3, 5.6. Variáveis devem ser declaradas anteriormente
+        Symbol *var = lookup_symbol(ctx, tokens[lead->token]);
+        if (var == NULL) {
+            report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, lead->token, NULL, "SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, tokens[lead->token]);
+            return false;
+        }
+        
+        // 5.8. Não podem ser feitas declarações dentro da estrutura de escrita
+        if (var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
+            report_diagnostic(ctx, DIAG_NOT_A_VARIABLE, lead->token, NULL, "SEMANTIC ERROR (linha %d): '%s' não é uma variável válida para escrita\n", current_line, tokens[lead->token]);
+            return false;
         }
-        i++;
+    }
+    
+    if (broken != -1 && open_string == -1) {
+        if (check->rule == CHECK_EXPECTED_ITEM) {
+            report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, broken, NULL, "SYNTAX ERROR (linha %d): Esperado texto (entre aspas) ou variável no comando 'escreva', encontrado '%s'\n", current_line, tokens[broken]);
+        } else {
+            report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, broken, NULL, "SYNTAX ERROR (linha %d): Esperada vírgula entre elementos no comando 'escreva', encontrado '%s'\n", current_line, tokens[broken]);
+        }
+        return false;
     }
     
     if (close_paren_pos == -1) {
-        printf("SYNTAX ERROR (linha %d): Comando 'escreva' sem fechamento de parênteses\n", current_line);
+        report_diagnostic(ctx, DIAG_UNCLOSED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'escreva' sem fechamento de parênteses\n", current_line);
         return false;
     }
     
-    if (in_string) {
-        printf("SYNTAX ERROR (linha %d): String não fechada no comando 'escreva'\n", current_line);
+    if (open_string != -1) {
+        report_diagnostic(ctx, DIAG_UNCLOSED_STRING, open_string, NULL, "SYNTAX ERROR (linha %d): String não fechada no comando 'escreva'\n", current_line);
         return false;
     }
     
-    if (expecting_content && content_count > 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'escreva' termina com vírgula sem conteúdo\n", current_line);
+    if (check->rule == CHECK_TRAILING_COMMA) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, check->token, NULL, "SYNTAX ERROR (linha %d): Comando 'escreva' termina com vírgula sem conteúdo\n", current_line);
         return false;
     }
     
-    if (content_count == 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'escreva' deve ter pelo menos um elemento\n", current_line);
+    if (check->rule == CHECK_EMPTY) {
+        report_diagnostic(ctx, DIAG_BAD_COMMAND_ARGUMENTS, open, NULL, "SYNTAX ERROR (linha %d): Comando 'escreva' deve ter pelo menos um elemento\n", current_line);
         return false;
     }
     
     // Verifica se há ponto e vírgula após o fechamento dos parênteses
-    if (close_paren_pos + 1 < *end_idx && tokens[close_paren_pos + 1] != NULL && strcmp(tokens[close_paren_pos + 1], ";") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'escreva' deve ser finalizado com ';'\n", current_line);
+    bool has_semicolon = close_paren_pos + 1 < *end_idx && ctx->token_kinds[close_paren_pos + 1] == KIND_SEMICOLON;
+    if (close_paren_pos + 1 < *end_idx && !has_semicolon) {
+        report_diagnostic(ctx, DIAG_MISSING_SEMICOLON, close_paren_pos + 1, NULL, "SYNTAX ERROR (linha %d): Comando 'escreva' deve ser finalizado com ';'\n", current_line);
         return false;
     }
     
-    *end_idx = (close_paren_pos + 1 < *end_idx && tokens[close_paren_pos + 1] != NULL && strcmp(tokens[close_paren_pos + 1], ";") == 0) 
-               ? close_paren_pos + 1 : close_paren_pos;
+    *end_idx = has_semicolon ? close_paren_pos + 1 : close_paren_pos;
     return true;
 }
 
-bool validate_se_command(char **tokens, int start_idx, int *end_idx, int current_line) {
-    // 6.1. Deve conter obrigatoriamente um teste e uma condição de verdadeiro
-    if (start_idx >= *end_idx || strcmp(tokens[start_idx], "(") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'se' deve ser seguido por '(' para o teste\n", current_line);
-        return false;
+// Último token do corpo conferido pelo parser, dentro de `limit`, ou -1
+// depois de relatar a regra que ele quebra com as mensagens do comando
+static int command_branch_end(AnalysisContext *ctx, const CommandBranch *branch, int limit, int current_line,
+                              const char *unclosed, const char *declaration, const char *unterminated) {
+    if (ctx->token_kinds[branch->start] == KIND_LEFT_BRACE) {
+        int close = bracket_end_before(ctx, branch->start, limit);
+        if (close == -1) {
+            report_diagnostic(ctx, DIAG_UNCLOSED_BRACE, branch->start, NULL, unclosed, current_line);
+        }
+        return close;
     }
     
-    int i = start_idx + 1;
-    int paren_count = 1;
-    int close_test_paren = -1;
+    // 6.2. Linha única: não pode conter declaração de variáveis
+    if (branch->declaration != -1 && branch->declaration < limit) {
+        report_diagnostic(ctx, DIAG_DECLARATION_IN_BLOCK, branch->declaration, NULL, declaration, current_line);
+        return -1;
+    }
     
-    // Procura o fechamento do teste (condição)
-    while (i < *end_idx && paren_count > 0) {
-        if (tokens[i] == NULL) break;
-        
-        if (strcmp(tokens[i], "(") == 0) {
-            paren_count++;
-        } else if (strcmp(tokens[i], ")") == 0) {
-            paren_count--;
-            if (paren_count == 0) {
-                close_test_paren = i;
-                break;
-            }
-        }
-        i++;
+    // 6.3. Deve terminar com ponto e vírgula
+    if (branch->semicolon == -1 || branch->semicolon >= limit) {
+        report_diagnostic(ctx, DIAG_MISSING_SEMICOLON, branch->start, NULL, unterminated, current_line);
+        return -1;
     }
+    return branch->semicolon;
+}
+
+static bool validate_se_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line) {
+    int open = node->token + 1;
+    AstNode *test = node->child;
     
-    if (close_test_paren == -1) {
-        printf("SYNTAX ERROR (linha %d): Teste do comando 'se' sem fechamento de parênteses\n", current_line);
+    // 6.1. Deve conter obrigatoriamente um teste e uma condição de verdadeiro
+    if (open >= *end_idx || test == NULL || test->kind != AST_GROUP) {
+        report_diagnostic(ctx, DIAG_EXPECTED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'se' deve ser seguido por '(' para o teste\n", current_line);
         return false;
     }
     
-    // Verifica se há conteúdo no teste
-    bool has_test_content = false;
-    for (int j = start_idx + 1; j < close_test_paren; j++) {
-        if (tokens[j] != NULL && strcmp(tokens[j], "\n") != 0) {
-            has_test_content = true;
-            break;
-        }
+    // Fechamento do teste (condição)
+    int close_test_paren = bracket_end_before(ctx, open, *end_idx);
+    if (close_test_paren == -1) {
+        report_diagnostic(ctx, DIAG_UNCLOSED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Teste do comando 'se' sem fechamento de parênteses\n", current_line);
+        return false;
     }
     
-    if (!has_test_content) {
-        printf("SYNTAX ERROR (linha %d): Teste do comando 'se' não pode estar vazio\n", current_line);
+    if (close_test_paren == open + 1) {
+        report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, open, NULL, "SYNTAX ERROR (linha %d): Teste do comando 'se' não pode estar vazio\n", current_line);
         return false;
     }
     
     // 6.3. A linha do teste (se) não conterá finalização de linha (ponto e vírgula)
-    if (close_test_paren + 1 < *end_idx && tokens[close_test_paren + 1] != NULL && strcmp(tokens[close_test_paren + 1], ";") == 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'se' não deve ter ';' após o teste\n", current_line);
+    int i = close_test_paren + 1;
+    if (i < *end_idx && ctx->token_kinds[i] == KIND_SEMICOLON) {
+        report_diagnostic(ctx, DIAG_UNEXPECTED_SEMICOLON, i, NULL, "SYNTAX ERROR (linha %d): Comando 'se' não deve ter ';' após o teste\n", current_line);
         return false;
     }
     
-    i = close_test_paren + 1;
-    
-    // Pula quebras de linha
-    while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], "\n") == 0) {
-        i++;
-    }
-    
-    if (i >= *end_idx || tokens[i] == NULL) {
-        printf("SYNTAX ERROR (linha %d): Comando 'se' deve ter uma condição verdadeira\n", current_line);
+    if (i >= *end_idx) {
+        report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, node->token, NULL, "SYNTAX ERROR (linha %d): Comando 'se' deve ter uma condição verdadeira\n", current_line);
         return false;
     }
     
-    // 6.1, 6.2. Processa bloco verdadeiro (obrigatório)
-    bool true_block_multiline = false;
-    int true_block_start = i;
-    int true_block_end = i;
+    // 6.1, 6.2. Bloco verdadeiro (obrigatório), em bloco ou numa linha
+    CommandCheck *check = node->check;
+    i = command_branch_end(ctx, &check->branches[0], *end_idx, current_line,
+                           "SYNTAX ERROR (linha %d): Bloco verdadeiro do 'se' sem fechamento de '{'\n",
+                           "SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'se'\n",
+                           "SYNTAX ERROR (linha %d): Bloco verdadeiro do 'se' deve terminar com ';'\n");
+    if (i == -1) return false;
+    i++;
     
-    if (strcmp(tokens[i], "{") == 0) {
-        // 6.2. Bloco com múltiplas linhas
-        true_block_multiline = true;
-        int brace_count = 1;
-        i++;
-        
-        while (i < *end_idx && brace_count > 0) {
-            if (tokens[i] == NULL) break;
-            
-            if (strcmp(tokens[i], "{") == 0) {
-                brace_count++;
-            } else if (strcmp(tokens[i], "}") == 0) {
-                brace_count--;
-                if (brace_count == 0) {
-                    true_block_end = i;
-                    break;
-                }
-            }
-            i++;
-        }
-        
-        if (brace_count > 0) {
-            printf("SYNTAX ERROR (linha %d): Bloco verdadeiro do 'se' sem fechamento de '{'\n", current_line);
-            return false;
-        }
-    } else {
-        // 6.2. Linha única - deve terminar com ponto e vírgula
-        while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], ";") != 0 && strcmp(tokens[i], "\n") != 0) {
-            // 6.2. Não pode conter declaração de variáveis
-            if (strcmp(tokens[i], "inteiro") == 0 || strcmp(tokens[i], "texto") == 0 || 
-                strcmp(tokens[i], "decimal") == 0 || strcmp(tokens[i], "flutuante") == 0) {
-                printf("SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'se'\n", current_line);
-                return false;
-            }
-            i++;
-        }
-        
-        // 6.3. Deve terminar com ponto e vírgula
-        if (i >= *end_idx || tokens[i] == NULL || strcmp(tokens[i], ";") != 0) {
-            printf("SYNTAX ERROR (linha %d): Bloco verdadeiro do 'se' deve terminar com ';'\n", current_line);
+    // 6.1. Bloco 'senao' (opcional), logo depois do verdadeiro
+    if (check->branch_count == 2 && i < *end_idx) {
+        i++; // Pula 'senao'
+        if (i >= *end_idx) {
+            report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, i - 1, NULL, "SYNTAX ERROR (linha %d): 'senao' deve ter uma condição falsa\n", current_line);
             return false;
         }
         
-        true_block_end = i;
-    }
-    
-    i = true_block_end + 1;
-    
-    // Pula quebras de linha
-    while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], "\n") == 0) {
-        i++;
+        i = command_branch_end(ctx, &check->branches[1], *end_idx, current_line,
+                               "SYNTAX ERROR (linha %d): Bloco falso do 'senao' sem fechamento de '{'\n",
+                               "SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'senao'\n",
+                               "SYNTAX ERROR (linha %d): Bloco falso do 'senao' deve terminar com ';'\n");
+        if (i == -1) return false;
     }
     
-    // 6.1. Verifica se há bloco 'senao' (opcional)
-    if (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], "senao") == 0) {
-        i++; // Pula 'senao'
-        
-        // Pula quebras de linha
-        while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], "\n") == 0) {
-            i++;
-        }
-        
-        if (i >= *end_idx || tokens[i] == NULL) {
-            printf("SYNTAX ERROR (linha %d): 'senao' deve ter uma condição falsa\n", current_line);
-            return false;
+    *end_idx = i;
+    return true;
+}
+
+// Primeira variável do trecho da árvore, em ordem de texto, que não está na
+// tabela (ou, com `variables_only`, que não é variável nem parâmetro); -1 se
+// não há. `assignment` passa a true quando o trecho usa '='.
+static int header_bad_variable(AnalysisContext *ctx, AstNode *node, bool variables_only, bool *assignment) {
+    for (; node != NULL; node = node->next) {
+        if (ctx->token_kinds[node->token] == KIND_ASSIGN) {
+            *assignment = true;
         }
-        
-        // 6.2. Processa bloco falso
-        if (strcmp(tokens[i], "{") == 0) {
-            // Bloco com múltiplas linhas
-            int brace_count = 1;
-            i++;
-            
-            while (i < *end_idx && brace_count > 0) {
-                if (tokens[i] == NULL) break;
-                
-                if (strcmp(tokens[i], "{") == 0) {
-                    brace_count++;
-                } else if (strcmp(tokens[i], "}") == 0) {
-                    brace_count--;
-                    if (brace_count == 0) {
-                        break;
-                    }
-                }
-                i++;
-            }
-            
-            if (brace_count > 0) {
-                printf("SYNTAX ERROR (linha %d): Bloco falso do 'senao' sem fechamento de '{'\n", current_line);
-                return false;
-            }
-        } else {
-            // Linha única - deve terminar com ponto e vírgula
-            while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], ";") != 0 && strcmp(tokens[i], "\n") != 0) {
-                // 6.2. Não pode conter declaração de variáveis
-                if (strcmp(tokens[i], "inteiro") == 0 || strcmp(tokens[i], "texto") == 0 || 
-                    strcmp(tokens[i], "decimal") == 0 || strcmp(tokens[i], "flutuante") == 0) {
-                    printf("SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'senao'\n", current_line);
-                    return false;
-                }
-                i++;
-            }
-            
-            // 6.3. Deve terminar com ponto e vírgula
-            if (i >= *end_idx || tokens[i] == NULL || strcmp(tokens[i], ";") != 0) {
-                printf("SYNTAX ERROR (linha %d): Bloco falso do 'senao' deve terminar com ';'\n", current_line);
-                return false;
+        if (is_variable(ctx->tokens[node->token])) {
+            Symbol *var = lookup_symbol(ctx, ctx->tokens[node->token]);
+            if (var == NULL) return node->token;
+            if (variables_only && var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
+                return node->token;
             }
         }
+        int bad = header_bad_variable(ctx, node->child, variables_only, assignment);
+        if (bad != -1) return bad;
     }
-    
-    *end_idx = i;
-    return true;
+    return -1;
 }
 
-bool validate_para_command(char **tokens, int start_idx, int *end_idx, int current_line) {
+static bool validate_para_command(AnalysisContext *ctx, AstNode *node, int *end_idx, int current_line) {
+    char **tokens = ctx->tokens;
+    int open = node->token + 1;
+    AstNode *header = node->child;
+    
     // 7.1. O laço de repetição – para possui a seguinte estrutura for (x1; x2; x3)
-    if (start_idx >= *end_idx || strcmp(tokens[start_idx], "(") != 0) {
-        printf("SYNTAX ERROR (linha %d): Comando 'para' deve ser seguido por '('\n", current_line);
+    if (open >= *end_idx || header == NULL || header->kind != AST_GROUP) {
+        report_diagnostic(ctx, DIAG_EXPECTED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'para' deve ser seguido por '('\n", current_line);
         return false;
     }
     
-    int i = start_idx + 1;
-    int paren_count = 1;
-    int close_paren_pos = -1;
-    int semicolon_count = 0;
-    int x1_start = i, x1_end = -1;
-    int x2_start = -1, x2_end = -1;
-    int x3_start = -1, x3_end = -1;
-    
-    // Procura os três segmentos separados por ponto e vírgula
-    while (i < *end_idx && paren_count > 0) {
-        if (tokens[i] == NULL) break;
-        
-        if (strcmp(tokens[i], "(") == 0) {
-            paren_count++;
-        } else if (strcmp(tokens[i], ")") == 0) {
-            paren_count--;
-            if (paren_count == 0) {
-                close_paren_pos = i;
-                // Define o final do terceiro segmento
-                if (semicolon_count == 2) {
-                    x3_end = i - 1;
-                } else if (semicolon_count == 1) {
-                    x2_end = i - 1;
-                } else {
-                    x1_end = i - 1;
-                }
-                break;
-            }
-        } else if (paren_count == 1 && strcmp(tokens[i], ";") == 0) {
-            semicolon_count++;
-            if (semicolon_count == 1) {
-                x1_end = i - 1;
-                x2_start = i + 1;
-            } else if (semicolon_count == 2) {
-                x2_end = i - 1;
-                x3_start = i + 1;
-            }
+    // Segmentos do cabeçalho, separados por ponto e vírgula
+    int close_paren_pos = bracket_end_before(ctx, open, *end_idx);
+    int semicolon_count = -1;
+    AstNode *segments[3] = {NULL, NULL, NULL};
+    for (AstNode *segment = header->child; segment != NULL; segment = segment->next) {
+        semicolon_count++;
+        if (semicolon_count < 3) {
+            segments[semicolon_count] = segment;
         }
-        i++;
     }
     
     if (close_paren_pos == -1) {
-        printf("SYNTAX ERROR (linha %d): Comando 'para' sem fechamento de parênteses\n", current_line);
+        report_diagnostic(ctx, DIAG_UNCLOSED_PAREN, open, NULL, "SYNTAX ERROR (linha %d): Comando 'para' sem fechamento de parênteses\n", current_line);
         return false;
     }
     
     if (semicolon_count != 2) {
-        printf("SYNTAX ERROR (linha %d): Comando 'para' deve ter exatamente 2 pontos e vírgulas (x1; x2; x3)\n", current_line);
+        report_diagnostic(ctx, DIAG_BAD_FOR_HEADER, open, NULL, "SYNTAX ERROR (linha %d): Comando 'para' deve ter exatamente 2 pontos e vírgulas (x1; x2; x3)\n", current_line);
         return false;
     }
     
-    // 7.1.1. Validação de x1 (inicialização)
-    if (x1_start <= x1_end) {
+    // 7.1.1. Validação de x1 (inicialização); pode estar vazio
+    AstNode *x1 = segments[0];
+    if (x1->token <= x1->end) {
+        // 7.1.1.4. As variáveis já devem ter sido declaradas anteriormente
         bool has_assignment = false;
-        for (int j = x1_start; j <= x1_end; j++) {
-            if (tokens[j] == NULL || strcmp(tokens[j], "\n") == 0) continue;
-            
-            // 7.1.1.4. As variáveis já devem ter sido declaradas anteriormente
-            if (is_variable(tokens[j])) {
-                Symbol *var = lookup_symbol(tokens[j]);
-                if (var == NULL) {
-                    printf("SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, tokens[j]);
-                    return false;
-                }
-                if (var->symbol_type != SYMBOL_VARIABLE && var->symbol_type != SYMBOL_PARAMETER) {
-                    printf("SEMANTIC ERROR (linha %d): '%s' não é uma variável válida\n", current_line, tokens[j]);
-                    return false;
-                }
-                var->is_used = true;
-            }
-            
-            // 7.1.1.2. Utilizar comando de atribuição
-            if (strcmp(tokens[j], "=") == 0) {
-                has_assignment = true;
-            }
-            
-            // 7.1.1.5. Múltiplas variáveis separadas por vírgula
-            if (strcmp(tokens[j], ",") == 0) {
-                // Aceita vírgulas para múltiplas inicializações
-            }
+        int bad = header_bad_variable(ctx, x1->child, true, &has_assignment);
+        if (bad != -1 && lookup_symbol(ctx, tokens[bad]) == NULL) {
+            report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, bad, NULL, "SEMANTIC ERROR (linha %d): Variável '%s' não foi declarada\n", current_line, tokens[bad]);
+            return false;
+        }
+        if (bad != -1) {
+            report_diagnostic(ctx, DIAG_NOT_A_VARIABLE, bad, NULL, "SEMANTIC ERROR (linha %d): '%s' não é uma variável válida\n", current_line, tokens[bad]);
+            return false;
         }
         
-        // x1 pode estar vazio (7.1.1.1. ou ainda não a iniciar)
-        if (x1_start <= x1_end && has_assignment == false) {
-            // Verifica se há conteúdo que não seja espaço/newline
-            bool has_content = false;
-            for (int j = x1_start; j <= x1_end; j++) {
-                if (tokens[j] != NULL && strcmp(tokens[j], "\n") != 0) {
-                    has_content = true;
-                    break;
-                }
-            }
-            if (has_content) {
-                printf("SYNTAX ERROR (linha %d): Inicialização x1 deve usar comando de atribuição '='\n", current_line);
-                return false;
-            }
+        // 7.1.1.2. Utilizar comando de atribuição
+        if (!has_assignment) {
+            report_diagnostic(ctx, DIAG_BAD_FOR_HEADER, x1->token, NULL, "SYNTAX ERROR (linha %d): Inicialização x1 deve usar comando de atribuição '='\n", current_line);
+            return false;
         }
     }
     
     // 7.1.2. Validação de x2 (teste/condição)
-    if (x2_start == -1 || x2_start > x2_end) {
-        printf("SYNTAX ERROR (linha %d): Comando 'para' deve ter uma condição de teste x2\n", current_line);
+    AstNode *x2 = segments[1];
+    if (x2->token > x2->end) {
+        report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, x2->token, NULL, "SYNTAX ERROR (linha %d): Comando 'para' deve ter uma condição de teste x2\n", current_line);
         return false;
     }
     
-    bool has_test_content = false;
-    for (int j = x2_start; j <= x2_end; j++) {
-        if (tokens[j] == NULL || strcmp(tokens[j], "\n") == 0) continue;
-        
-        has_test_content = true;
-        
-        // Verifica se usa variáveis declaradas
-        if (is_variable(tokens[j])) {
-            Symbol *var = lookup_symbol(tokens[j]);
-            if (var == NULL) {
-                printf("SEMANTIC ERROR (linha %d): Variável '%s' usada na condição não foi declarada\n", current_line, tokens[j]);
-                return false;
-            }
-            var->is_used = true;
-        }
-    }
-    
-    if (!has_test_content) {
-        printf("SYNTAX ERROR (linha %d): Condição de teste x2 não pode estar vazia\n", current_line);
+    bool has_assignment = false;
+    int bad = header_bad_variable(ctx, x2->child, false, &has_assignment);
+    if (bad != -1) {
+        report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, bad, NULL, "SEMANTIC ERROR (linha %d): Variável '%s' usada na condição não foi declarada\n", current_line, tokens[bad]);
         return false;
     }
     
-    // 7.1.3. Validação de x3 (operação matemática)
-    if (x3_start != -1 && x3_start <= x3_end) {
-        for (int j = x3_start; j <= x3_end; j++) {
-            if (tokens[j] == NULL || strcmp(tokens[j], "\n") == 0) continue;
-            
-            // 7.1.3.1. Variáveis devem estar declaradas
-            if (is_variable(tokens[j])) {
-                Symbol *var = lookup_symbol(tokens[j]);
-                if (var == NULL) {
-                    printf("SEMANTIC ERROR (linha %d): Variável '%s' usada na operação não foi declarada\n", current_line, tokens[j]);
-                    return false;
-                }
-                var->is_used = true;
-            }
-            
-            // 7.1.3.2. Aceita operações matemáticas (+, -, *, /, %, ++, --)
-            if (strcmp(tokens[j], "+") == 0 || strcmp(tokens[j], "-") == 0 || 
-                strcmp(tokens[j], "*") == 0 || strcmp(tokens[j], "/") == 0 || 
-                strcmp(tokens[j], "%") == 0 || strcmp(tokens[j], "++") == 0 || 
-                strcmp(tokens[j], "--") == 0 || strcmp(tokens[j], "=") == 0) {
-                // Operações matemáticas válidas
-            }
-        }
-    }
-    // x3 pode estar vazio
-    
-    // Processa o bloco do laço
-    i = close_paren_pos + 1;
-    
-    // Pula quebras de linha
-    while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], "\n") == 0) {
-        i++;
+    // 7.1.3. Validação de x3 (operação matemática); pode estar vazio
+    bad = header_bad_variable(ctx, segments[2]->child, false, &has_assignment);
+    if (bad != -1) {
+        report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, bad, NULL, "SEMANTIC ERROR (linha %d): Variável '%s' usada na operação não foi declarada\n", current_line, tokens[bad]);
+        return false;
     }
     
-    if (i >= *end_idx || tokens[i] == NULL) {
-        printf("SYNTAX ERROR (linha %d): Comando 'para' deve ter um bloco de execução\n", current_line);
+    // Bloco do laço, em bloco ou numa linha
+    int i = close_paren_pos + 1;
+    if (i >= *end_idx) {
+        report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, node->token, NULL, "SYNTAX ERROR (linha %d): Comando 'para' deve ter um bloco de execução\n", current_line);
         return false;
     }
     
-    // Processa bloco do laço
-    if (strcmp(tokens[i], "{") == 0) {
-        // Bloco com múltiplas linhas
-        int brace_count = 1;
-        i++;
-        
-        while (i < *end_idx && brace_count > 0) {
-            if (tokens[i] == NULL) break;
-            
-            if (strcmp(tokens[i], "{") == 0) {
-                brace_count++;
-            } else if (strcmp(tokens[i], "}") == 0) {
-                brace_count--;
-                if (brace_count == 0) {
-                    break;
-                }
-            }
-            i++;
-        }
-        
-        if (brace_count > 0) {
-            printf("SYNTAX ERROR (linha %d): Bloco do 'para' sem fechamento de '{'\n", current_line);
-            return false;
-        }
-    } else {
-        // Linha única - deve terminar com ponto e vírgula
-        while (i < *end_idx && tokens[i] != NULL && strcmp(tokens[i], ";") != 0 && strcmp(tokens[i], "\n") != 0) {
-            // Não pode conter declaração de variáveis no bloco
-            if (strcmp(tokens[i], "inteiro") == 0 || strcmp(tokens[i], "texto") == 0 || 
-                strcmp(tokens[i], "decimal") == 0 || strcmp(tokens[i], "flutuante") == 0) {
-                printf("SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'para'\n", current_line);
-                return false;
-            }
-            i++;
-        }
-        
-        if (i >= *end_idx || tokens[i] == NULL || strcmp(tokens[i], ";") != 0) {
-            printf("SYNTAX ERROR (linha %d): Bloco do 'para' deve terminar com ';'\n", current_line);
-            return false;
-        }
-    }
+    i = command_branch_end(ctx, &node->check->branches[0], *end_idx, current_line,
+                           "SYNTAX ERROR (linha %d): Bloco do 'para' sem fechamento de '{'\n",
+                           "SEMANTIC ERROR (linha %d): Não é permitido declarar variáveis dentro do bloco 'para'\n",
+                           "SYNTAX ERROR (linha %d): Bloco do 'para' deve terminar com ';'\n");
+    if (i == -1) return false;
     
     *end_idx = i;
     return true;
 }
 
-void print_symbol_table() {
-    printf("\n======== TABELA DE SÍMBOLOS ========\n");
-    printf("%-20s %-12s %-10s %-8s %-8s %-8s %-15s\n", 
+static void print_symbol_table(AnalysisContext *ctx) {
+    if (ctx->verbosity < VERBOSITY_TOKENS) return;
+    
+    report_printf(ctx, VERBOSITY_TOKENS, "\n======== TABELA DE SÍMBOLOS ========\n");
+    report_printf(ctx, VERBOSITY_TOKENS, "%-20s %-12s %-10s %-8s %-8s %-8s %-15s\n", 
            "NOME", "TIPO_SIMBOLO", "TIPO_DADO", "ESCOPO", "LINHA", "USADO", "PARÂMETROS");
-    printf("--------------------------------------------------------------------------------\n");
+    report_printf(ctx, VERBOSITY_TOKENS, "--------------------------------------------------------------------------------\n");
     
     for (int i = 0; i < MAX_SYMBOLS; i++) {
-        Symbol *current = symbol_table.symbols[i];
+        Symbol *current = ctx->symbol_table.symbols[i];
         while (current != NULL) {
             char param_info[100] = "";
             
             if (current->symbol_type == SYMBOL_FUNCTION && current->param_count > 0) {
-                snprintf(param_info, sizeof(param_info), "(%d params)", current->param_count);
+                // Quantidade e tipo de cada parâmetro, já com os tipos inferidos
+                int used = snprintf(param_info, sizeof(param_info), "(%d params:", current->param_count);
+                for (int k = 0; k < current->param_count && used < (int)sizeof(param_info); k++) {
+                    used += snprintf(param_info + used, sizeof(param_info) - used, "%s %s",
+                                     k > 0 ? "," : "", data_type_keyword(current->param_types[k]));
+                }
+                if (used < (int)sizeof(param_info)) {
+                    snprintf(param_info + used, sizeof(param_info) - used, ")");
+                }
             }
             
-            printf("%-20s %-12s %-10s %-8d %-8d %-8s %-15s\n",
+            report_printf(ctx, VERBOSITY_TOKENS, "%-20s %-12s %-10s %-8d %-8d %-8s %-15s\n",
                    current->name,
                    symbol_type_to_string(current->symbol_type),
                    data_type_to_string(current->data_type),
                    current->scope_level,
                    current->line_declared,
-                   current->is_used ? "SIM" : "NAO",
+                   symbol_used(ctx, current) ? "SIM" : "NAO",
                    param_info);
             current = current->next;
         }
     }
-    printf("====================================\n");
-    printf("Total de símbolos: %d\n\n", symbol_table.count);
+    report_printf(ctx, VERBOSITY_TOKENS, "====================================\n");
+    report_printf(ctx, VERBOSITY_TOKENS, "Total de símbolos: %d\n\n", ctx->symbol_table.count);
 }
 
-DataType string_to_data_type(const char *type_str) {
+static DataType string_to_data_type(const char *type_str) {
     if (strcmp(type_str, "inteiro") == 0) return TYPE_INTEGER;
     if (strcmp(type_str, "texto") == 0) return TYPE_STRING;
     if (strcmp(type_str, "decimal") == 0) return TYPE_FLOAT;
@@ -1217,29 +2378,35 @@ DataType string_to_data_type(const char *type_str) {
 }
 
 // Arrays globais para evitar repetição
-const char* const KEYWORDS[] = {"principal", "inteiro", "retorno", "escreva", "leia", "funcao", "senao", "se", "para"};
-const int NUM_KEYWORDS = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
-// const char DELIMITERS[] = " ()\\{};\n\r";
-const char DELIMITERS[] = " ";
-const char SPECIAL_TOKENS[] = "()\\{};\n\r\"";
-const char* MULTI_TOKENS[] = {"==", "<=", ">=", "&&", "||", "<>"};
+static const char* const KEYWORDS[] = {"principal", "inteiro", "retorno", "escreva", "leia", "funcao", "senao", "se", "para"};
+static const int NUM_KEYWORDS = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+static const char SPECIAL_TOKENS[] = "()\\{};\n\r\"";
+static const char* MULTI_TOKENS[] = {"==", "<=", ">=", "&&", "||", "<>"};
 #define NUM_MULTI_TOKENS (sizeof(MULTI_TOKENS) / sizeof(MULTI_TOKENS[0]))
-bool PRINCIPAL_FUNC = false;
 
-void* safe_malloc(size_t size) {
-    if (memory + size > MAX_MEMORY) {
-        printf("ERRO: Memória Insuficiente\n");
-        exit(1);
+// Limite de memória estourado: o programa termina, mas quem usa a biblioteca
+// recebe o erro de volta
+static void analysis_out_of_memory(AnalysisContext *ctx) {
+    if (ctx->memory_error != NULL) {
+        longjmp(*ctx->memory_error, 1);
+    }
+    printf("ERRO: Memória Insuficiente\n");
+    exit(1);
+}
+
+static void* safe_malloc(AnalysisContext *ctx, size_t size) {
+    if (ctx->memory + size > MAX_MEMORY) {
+        analysis_out_of_memory(ctx);
     }
     void *ptr = malloc(size);
     if (ptr != NULL) {
-        memory += size;
-        // printf("Memória ocupada: %zu bytes\n", memory); 
+        ctx->memory += size;
+        // printf("Memória ocupada: %zu bytes\n", ctx->memory); 
     }
     return ptr;
 }
 
-char* clear_token(char *token) {
+static char* clear_token(char *token) {
     if (token == NULL) return NULL;
     if (strlen(token) >= 3 &&
         (unsigned char)token[0] == 0xEF &&
@@ -1250,14 +2417,14 @@ char* clear_token(char *token) {
     return token;
 }
 
-char* read_file(char *file_path){
+static char* read_file(AnalysisContext *ctx, const char *file_path){
     FILE *file_ptr;
     char *buffer = NULL;
     long file_size;
 
     file_ptr = fopen(file_path,"r");
     if (file_ptr == NULL){
-        printf("Erro ao tentar abrir o arquivo!");
+        report_diagnostic(ctx, DIAG_IO_ERROR, ctx->current_token, NULL, "Erro ao tentar abrir o arquivo!");
         return NULL;
     }
     
@@ -1267,9 +2434,9 @@ char* read_file(char *file_path){
     fseek(file_ptr, 0, SEEK_SET);
     
     // Aloca memória para o buffer
-    buffer = safe_malloc(file_size + 1);
+    buffer = safe_malloc(ctx, file_size + 1);
     if (buffer == NULL) {
-        printf("Erro ao alocar memória!");
+        report_diagnostic(ctx, DIAG_IO_ERROR, ctx->current_token, NULL, "Erro ao alocar memória!");
         fclose(file_ptr);
         return NULL;
     }
@@ -1282,16 +2449,25 @@ char* read_file(char *file_path){
     return buffer;
 }
 
-int is_variable(const char *token) {
+static int is_variable(const char *token) {
     // Verifica se começa com '!' e tem mais de 1 caractere
     return token && token[0] == '!' && strlen(token) > 1;
 }
-char** string_tokens(char *content, int *length) {
+static char** string_tokens(AnalysisContext *ctx, char *content, int *length) {
     if (content == NULL || length == NULL) return NULL;
 
     int count = 0;
     int i = 0;
 
+    // Aspas tipográficas (“ e ”) viram aspas comuns. Basta uma passada: a
+    // troca não muda nenhum dos casos da contagem abaixo.
+    for (int k = 0; content[k] != '\0'; k++) {
+        if ((unsigned char)content[k] == 0xE2  && (unsigned char)content[k+1] == 0x80 && 
+            ((unsigned char)content[k+2] == 0x9C || (unsigned char)content[k+2] == 0x9D)) {
+            content[k] = '"';
+        }
+    }
+
     // contar tokens
     while (content[i] != '\0') {
         int matched = 0;
@@ -1319,13 +2495,6 @@ char** string_tokens(char *content, int *length) {
             continue;
         }
 
-        for (int i = 0; content[i] != '\0'; i++) {
-            if ((unsigned char)content[i] == 0xE2  && (unsigned char)content[i+1] == 0x80 && 
-                ((unsigned char)content[i+2] == 0x9C || (unsigned char)content[i+2] == 0x9D)) {
-                content[i] = '"';
-            }
-        }
-        
         // if (strchr(0xE2, (unsigned char)content[i]) != NULL && strchr(0x80, (unsigned char)content[i+1]) != NULL && (strchr(0x9C, (unsigned char)content[i+2]) != NULL || strchr(0x9D, (unsigned char)content[i+2]) != NULL)) {
         //     content[i] = '"';
         // }
@@ -1353,9 +2522,25 @@ char** string_tokens(char *content, int *length) {
     }
 
     // armazenar tokens 
-    char **tokens = safe_malloc(count * sizeof(char*));
+    char **tokens = safe_malloc(ctx, count * sizeof(char*));
+    memset(tokens, 0, count * sizeof(char*));
+    ctx->tokens = tokens;
+    ctx->token_count = count;
+    
+    // Posições no arquivo, fora do limite de memória da análise
+    if (ctx->span_capacity < count) {
+        TokenSpan *spans = realloc(ctx->spans, count * sizeof(TokenSpan));
+        if (spans == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->spans = spans;
+        ctx->span_capacity = count;
+    }
+    reserve_token_kinds(ctx, count);
+    
     i = 0;
     int idx = 0;
+    int line = 1;
     while (content[i] != '\0' && idx < count) {
         if (content[i] == ' ' || content[i] == '\t') {
             i++;
@@ -1363,17 +2548,22 @@ char** string_tokens(char *content, int *length) {
         }
 
         if (content[i] == '\n') {
-            tokens[idx] = safe_malloc(3); // espaço para "\\n" e '\0'
+            tokens[idx] = safe_malloc(ctx, 3); // espaço para "\\n" e '\0'
             strcpy(tokens[idx], "\\n");   // representação visual
+            ctx->spans[idx] = (TokenSpan){i, 1, line}; // a quebra pertence à linha que termina
+            ctx->token_kinds[idx] = KIND_NEWLINE;
+            line++;
             idx++;
             i++;
             continue;
         }
 
         if (strchr(SPECIAL_TOKENS, content[i]) != NULL) {
-            tokens[idx] = safe_malloc(2);
+            tokens[idx] = safe_malloc(ctx, 2);
             tokens[idx][0] = content[i];
             tokens[idx][1] = '\0';
+            ctx->spans[idx] = (TokenSpan){i, 1, line};
+            ctx->token_kinds[idx] = token_kind(tokens[idx], 1);
             idx++;
             i++;
             continue;
@@ -1387,7 +2577,8 @@ char** string_tokens(char *content, int *length) {
             i++;
         }
         int len = i - start;
-        tokens[idx] = safe_malloc(len + 1);
+        ctx->spans[idx] = (TokenSpan){start, len, line};
+        tokens[idx] = safe_malloc(ctx, len + 1);
         strncpy(tokens[idx], &content[start], len);
         tokens[idx][len] = '\0';
 
@@ -1401,14 +2592,19 @@ char** string_tokens(char *content, int *length) {
                 p++;
             }
         }
+        ctx->token_kinds[idx] = token_kind(tokens[idx], p - tokens[idx]);
         idx++;
     }
+    ctx->token_kinds[idx] = KIND_END;
 
-    *length = count;
+    // A contagem trata alguns operadores compostos de outra forma; só os
+    // tokens realmente armazenados são devolvidos
+    *length = idx;
+    ctx->token_count = idx;
     return tokens;
 }
 
-int is_keyword(char *token) {
+static int is_keyword(char *token) {
     if (token == NULL) {
         return 0;
     }
@@ -1427,7 +2623,7 @@ int is_keyword(char *token) {
 }
 
 // Função para calcular a distância de Levenshtein (similaridade entre strings)
-int levenshtein_distance(char *s1, char *s2) {
+static int levenshtein_distance(char *s1, char *s2) {
     int len1 = strlen(s1);
     int len2 = strlen(s2);
     
@@ -1461,7 +2657,7 @@ int levenshtein_distance(char *s1, char *s2) {
     return matrix[len1][len2];
 }
 
-int has_lexical_error(char *token) {
+static int has_lexical_error(AnalysisContext *ctx, char *token) {
     if (token == NULL) {
         return 0;
     }
@@ -1480,38 +2676,39 @@ int has_lexical_error(char *token) {
     }
     
     // Converte o token para minúsculas para comparação
-    char *token_lower = safe_malloc(strlen(cleaned) + 1);
+    char *token_lower = safe_malloc(ctx, strlen(cleaned) + 1);
     strcpy(token_lower, cleaned);
     for (int i = 0; token_lower[i]; i++) {
         token_lower[i] = tolower(token_lower[i]);
     }
     
     // Verifica similaridade com cada keyword
-    for (int i = 0; i < NUM_KEYWORDS; i++) {
+    Phase outer = stats_phase(ctx, PHASE_LEVENSHTEIN);
+    int found = 0;
+    for (int i = 0; i < NUM_KEYWORDS && !found; i++) {
         int distance = levenshtein_distance(token_lower, (char*)KEYWORDS[i]);
         int keyword_len = strlen(KEYWORDS[i]);
         int token_len = strlen(token_lower);
         
         // Se a distância é pequena em relação ao tamanho da palavra (erro léxico)
         if (distance > 0 && distance <= 2 && keyword_len > 3) {
-            free(token_lower);
-            return 1; // Erro léxico detectado
+            found = 1; // Erro léxico detectado
         }
         
         // Se é um prefixo muito próximo da keyword (como "escrev" para "escreva")
         if (strncmp(token_lower, KEYWORDS[i], token_len) == 0 && 
             token_len >= keyword_len - 2 && token_len < keyword_len) {
-            free(token_lower);
-            return 1; // Erro léxico detectado
+            found = 1; // Erro léxico detectado
         }
     }
+    stats_phase(ctx, outer);
     
     free(token_lower);
-    return 0; // Não é erro léxico
+    return found;
 }
 
 // Função para sugerir a keyword mais próxima
-char* suggest_keyword(char *token) {
+static char* suggest_keyword(AnalysisContext *ctx, char *token) {
     if (token == NULL) {
         return NULL;
     }
@@ -1525,7 +2722,7 @@ char* suggest_keyword(char *token) {
     }
     
     // Converte o token para minúsculas para comparação
-    char *token_lower = safe_malloc(strlen(cleaned) + 1);
+    char *token_lower = safe_malloc(ctx, strlen(cleaned) + 1);
     strcpy(token_lower, cleaned);
     for (int i = 0; token_lower[i]; i++) {
         token_lower[i] = tolower(token_lower[i]);
@@ -1535,6 +2732,7 @@ char* suggest_keyword(char *token) {
     char *best_match = NULL;
     
     // Encontra a keyword com menor distância
+    Phase outer = stats_phase(ctx, PHASE_LEVENSHTEIN);
     for (int i = 0; i < NUM_KEYWORDS; i++) {
         int distance = levenshtein_distance(token_lower, (char*)KEYWORDS[i]);
         int keyword_len = strlen(KEYWORDS[i]);
@@ -1554,712 +2752,5700 @@ char* suggest_keyword(char *token) {
         }
     }
     
+    stats_phase(ctx, outer);
+    
     free(token_lower);
     return best_match;
 }
 
-int check_brackets_and_quotes(char **tokens, int length) {
-    char stack[length]; 
+// '(', '[' e '{' abrem; ')', ']' e '}' fecham. As aspas são tratadas à parte.
+static BracketType bracket_type(const char *token) {
+    if (token[0] == '\0' || token[1] != '\0') return BRACKET_NONE;
+    const char *found = strchr(BRACKET_CHARS, token[0]);
+    if (found == NULL) return BRACKET_NONE;
+    return found - BRACKET_CHARS < 3 ? BRACKET_OPEN : BRACKET_CLOSE;
+}
+
+static void add_bracket_error(AnalysisContext *ctx, int token, char open, char close) {
+    if (ctx->bracket_error_count == ctx->bracket_error_capacity) {
+        int capacity = ctx->bracket_error_capacity > 0 ? ctx->bracket_error_capacity * 2 : 16;
+        BracketError *errors = realloc(ctx->bracket_errors, capacity * sizeof(BracketError));
+        if (errors == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->bracket_errors = errors;
+        ctx->bracket_error_capacity = capacity;
+    }
+    BracketError *error = &ctx->bracket_errors[ctx->bracket_error_count++];
+    error->token = token;
+    error->open = open;
+    error->close = close;
+}
+
+static void add_missing_return(AnalysisContext *ctx, int token, const char *name) {
+    if (ctx->missing_return_count == ctx->missing_return_capacity) {
+        int capacity = ctx->missing_return_capacity > 0 ? ctx->missing_return_capacity * 2 : 16;
+        MissingReturn *missing = realloc(ctx->missing_returns, capacity * sizeof(MissingReturn));
+        if (missing == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->missing_returns = missing;
+        ctx->missing_return_capacity = capacity;
+    }
+    ctx->missing_returns[ctx->missing_return_count].token = token;
+    ctx->missing_returns[ctx->missing_return_count].name = name;
+    ctx->missing_return_count++;
+}
+
+static void add_function_definition(AnalysisContext *ctx, int start, int level, int next) {
+    if (ctx->function_count == ctx->function_capacity) {
+        int capacity = ctx->function_capacity > 0 ? ctx->function_capacity * 2 : 16;
+        FunctionDefinition *functions = realloc(ctx->functions, capacity * sizeof(FunctionDefinition));
+        if (functions == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->functions = functions;
+        ctx->function_capacity = capacity;
+    }
+    FunctionDefinition *function = &ctx->functions[ctx->function_count++];
+    function->name = ctx->tokens[start + 1];
+    function->start = start;
+    function->end = -1;
+    function->level = level;
+    function->next = next;
+}
+
+// Fatos das funções, juntados token a token dentro de index_tokens(). Como as
+// verificações antigas, esta parte não pula textos entre aspas.
+typedef struct FunctionScan {
+    int level;            // Nível de chaves até o token atual
+    int waiting_brace;    // Definições que ainda não viram a primeira '{'
+    bool inside_function; // Entre 'funcao' e a próxima '}', para o 'retorno'
+    bool has_return;
+    const char *name;
+    int name_token;
+} FunctionScan;
+
+static void scan_function_token(AnalysisContext *ctx, FunctionScan *scan, int i) {
+    const char *tok = ctx->tokens[i];
+    int *waiting = ctx->level_waiting + ctx->token_count; // Níveis vão de -token_count a token_count
+    switch (ctx->token_kinds[i]) {
+        case KIND_FUNCAO:
+            if (strcmp(tok, "funcao") != 0) break;
+            scan->inside_function = true;
+            scan->has_return = false;
+            if (i + 1 < ctx->token_count && strncmp(ctx->tokens[i + 1], "__", 2) == 0) {
+                scan->name = ctx->tokens[i + 1];
+                scan->name_token = i + 1;
+                // Só nomes com '__' podem ser chamados, então só eles viram definição
+                add_function_definition(ctx, i, scan->level, scan->waiting_brace);
+                scan->waiting_brace = ctx->function_count - 1;
+            } else {
+                scan->name = "funcao sem nome";
+                scan->name_token = i;
+            }
+            break;
+        case KIND_WORD:
+            if (scan->inside_function && strcmp(tok, "retorno") == 0) {
+                scan->has_return = true;
+            }
+            break;
+        case KIND_LEFT_BRACE:
+            scan->level++;
+            // A primeira '{' abre todas as definições que esperavam por ela
+            while (scan->waiting_brace != -1) {
+                FunctionDefinition *function = &ctx->functions[scan->waiting_brace];
+                scan->waiting_brace = function->next;
+                function->next = waiting[function->level];
+                waiting[function->level] = function - ctx->functions;
+            }
+            break;
+        case KIND_RIGHT_BRACE:
+            scan->level--;
+            for (int f = waiting[scan->level]; f != -1; f = ctx->functions[f].next) {
+                ctx->functions[f].end = i;
+            }
+            waiting[scan->level] = -1;
+            if (scan->inside_function) {
+                if (strcmp(scan->name, "__principal") != 0 && !scan->has_return) {
+                    add_missing_return(ctx, scan->name_token, scan->name);
+                }
+                scan->inside_function = false;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Passada única sobre os tokens, no início de analysis_check(). Monta o
+// índice de pares e junta o que as verificações do fim precisam saber das
+// funções (definições, para as chamadas pendentes, e as que não têm
+// 'retorno'), então nenhuma delas percorre os tokens de novo.
+//
+// Índice de pares: textos entre aspas são pulados. Cada fechamento casa com a abertura mais próxima do mesmo tipo
+// ainda aberta (a lista dessas aberturas fica encadeada no próprio
+// bracket_match enquanto a passada anda), como na contagem de cada tipo
+// feita pelas verificações. A pilha, com aberturas de todos os tipos, só
+// serve para achar os desencontros de aninhamento.
+static void index_tokens(AnalysisContext *ctx) {
+    int length = ctx->token_count;
+    if (ctx->bracket_capacity < length + 1) {
+        int *match = realloc(ctx->bracket_match, (length + 1) * sizeof(int));
+        if (match == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->bracket_match = match;
+        int *stack = realloc(ctx->bracket_stack, (length + 1) * sizeof(int));
+        if (stack == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->bracket_stack = stack;
+        ctx->bracket_capacity = length + 1;
+    }
+    if (ctx->level_capacity < 2 * length + 1) {
+        int *waiting = realloc(ctx->level_waiting, (2 * length + 1) * sizeof(int));
+        if (waiting == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->level_waiting = waiting;
+        ctx->level_capacity = 2 * length + 1;
+    }
+    memset(ctx->level_waiting, -1, (2 * length + 1) * sizeof(int));
+    ctx->function_count = 0;
+    ctx->missing_return_count = 0;
+    FunctionScan functions = {0, -1, false, false, NULL, -1};
+    int *match = ctx->bracket_match;
+    int *stack = ctx->bracket_stack;
     int top = -1;
-    int inside_quote = 0;
+    int open_by_kind[3] = {-1, -1, -1}; // Última abertura sem par de cada tipo
+    int open_quote = -1;
+    ctx->bracket_error_count = 0;
 
     for (int i = 0; i < length; i++) {
-        char *tok = tokens[i];
+        const char *tok = ctx->tokens[i];
+        scan_function_token(ctx, &functions, i);
+        match[i] = -1;
         if (strcmp(tok, "\"") == 0) {
-            if (!inside_quote) {
-                inside_quote = 1; 
+            if (open_quote == -1) {
+                open_quote = i;
             } else {
-                inside_quote = 0;
+                match[open_quote] = i;
+                match[i] = open_quote;
+                open_quote = -1;
             }
             continue;
         }
-        if (inside_quote) continue;
-        if (strcmp(tok, "(") == 0 || strcmp(tok, "[") == 0 || strcmp(tok, "{") == 0) {
-            stack[++top] = tok[0];
-        }
-        else if (strcmp(tok, ")") == 0 || strcmp(tok, "]") == 0 || strcmp(tok, "}") == 0) {
-            if (top < 0) {
-                printf("Erro: encontrou '%s' sem abertura correspondente\n", tok);
-                return 0;
-            }
+        if (open_quote != -1) continue;
 
-            char open = stack[top--]; 
+        int type = bracket_type(tok);
+        if (type == BRACKET_NONE) continue;
+        int kind = strchr(BRACKET_CHARS, tok[0]) - BRACKET_CHARS;
+        if (type == BRACKET_OPEN) {
+            match[i] = open_by_kind[kind];
+            open_by_kind[kind] = i;
+            stack[++top] = i;
+            continue;
+        }
 
-            if ((strcmp(tok, ")") == 0 && open != '(') ||
-                (strcmp(tok, "]") == 0 && open != '[') ||
-                (strcmp(tok, "}") == 0 && open != '{')) {
-                printf("Erro: '%c' não combina com '%s'\n", open, tok);
-                return 0; 
+        kind -= 3;
+        int open = open_by_kind[kind];
+        if (open != -1) {
+            open_by_kind[kind] = match[open];
+            match[open] = i;
+            match[i] = open;
+        }
+        if (top < 0) {
+            add_bracket_error(ctx, i, 0, tok[0]);
+        } else {
+            char open_char = ctx->tokens[stack[top--]][0];
+            if (open_char != BRACKET_CHARS[kind]) {
+                add_bracket_error(ctx, i, open_char, tok[0]);
             }
         }
     }
 
-    if (inside_quote) {
-        printf("Erro: string aberta sem fechamento (\")\n");
-        return 0;
+    // O que ficou aberto não tem par
+    for (int kind = 0; kind < 3; kind++) {
+        for (int open = open_by_kind[kind]; open != -1; ) {
+            int previous = match[open];
+            match[open] = -1;
+            open = previous;
+        }
     }
+    if (open_quote != -1) {
+        add_bracket_error(ctx, open_quote, '"', 0);
+    }
+    for (; top >= 0; top--) {
+        add_bracket_error(ctx, stack[top], ctx->tokens[stack[top]][0], 0);
+    }
+    match[length] = -1;
+}
 
-    if (top != -1) {
-        char open = stack[top];
-        char expected;
-        if (open == '(') expected = ')';
-        else if (open == '[') expected = ']';
-        else expected = '}';
-        printf("Faltou fechar com '%c'\n", expected);
-        return 0;
+// Relata os desencontros achados por index_tokens(), todos, cada um
+// na sua posição
+static int check_brackets_and_quotes(AnalysisContext *ctx) {
+    for (int i = 0; i < ctx->bracket_error_count; i++) {
+        BracketError *error = &ctx->bracket_errors[i];
+        // Linha do fechamento encontrado ou, quando nada fechou, da abertura
+        int line = ctx->spans[error->token].line;
+        if (error->open == 0) {
+            report_diagnostic(ctx, DIAG_UNBALANCED, error->token, NULL, "Erro (linha %d): encontrou '%c' sem abertura correspondente\n", line, error->close);
+        } else if (error->close != 0) {
+            report_diagnostic(ctx, DIAG_UNBALANCED, error->token, NULL, "Erro (linha %d): '%c' não combina com '%c'\n", line, error->open, error->close);
+        } else if (error->open == '"') {
+            report_diagnostic(ctx, DIAG_UNCLOSED_STRING, error->token, NULL, "Erro (linha %d): string aberta sem fechamento (\")\n", line);
+        } else {
+            char expected = BRACKET_CHARS[strchr(BRACKET_CHARS, error->open) - BRACKET_CHARS + 3];
+            report_diagnostic(ctx, DIAG_UNBALANCED, error->token, NULL, "Faltou fechar com '%c' (linha %d, onde '%c' abriu)\n", expected, line, error->open);
+        }
     }
+    return ctx->bracket_error_count == 0;
+}
 
-    return 1; 
+// Relata as funções sem 'retorno' achadas por index_tokens()
+static int check_return_statement(AnalysisContext *ctx) {
+    for (int i = 0; i < ctx->missing_return_count; i++) {
+        MissingReturn *missing = &ctx->missing_returns[i];
+        report_diagnostic(ctx, DIAG_MISSING_RETURN, missing->token, NULL, "SEMANTIC ERROR: Funcao '%s' sem 'retorno'.\n", missing->name);
+    }
+    return ctx->missing_return_count == 0;
 }
 
-int check_return_statement(char **tokens, int length) {
-    bool inside_function = false;
-    bool has_return = false;
-    int error_count = 0;
-    char *current_function_name = NULL; 
+// Token só com caracteres de operador. Chamada por token_kind() depois que os
+// operadores da gramática já foram reconhecidos, então o que sobra é inválido.
+static int is_invalid_operator(const char *token, size_t length) {
+    return strspn(token, "<>!=&|+-*/^") == length;
+}
 
-    for (int i = 0; i < length; i++) {
-        char *token = tokens[i];
-        if (strcmp(token, "funcao") == 0) {
-            inside_function = true;
-            has_return = false;
-            if (i + 1 < length && strncmp(tokens[i + 1], "__", 2) == 0) {
-                current_function_name = tokens[i + 1];
-            } else {
-                current_function_name = "funcao sem nome"; 
+// Tipo de um token pelo texto e tamanho. O primeiro caractere escolhe o caso;
+// só então o texto é comparado com as palavras reservadas que começam com ele.
+static TokenKind token_kind(const char *token, size_t length) {
+    switch (token[0]) {
+        case '\0': return KIND_INVALID_OPERATOR; // Vazio: nada fora dos caracteres de operador
+        case '\\': if (length == 2 && token[1] == 'n') return KIND_NEWLINE; break;
+        case '"': return KIND_QUOTED;
+        case (char)0xEF:
+            // "funcao" e "principal" também valem logo depois do BOM do arquivo
+            if (length >= 3 && (unsigned char)token[1] == 0xBB && (unsigned char)token[2] == 0xBF) {
+                if (strcmp(token + 3, "funcao") == 0) return KIND_FUNCAO;
+                if (strcmp(token + 3, "principal") == 0) return KIND_PRINCIPAL;
             }
+            break;
+        case ';': if (length == 1) return KIND_SEMICOLON; break;
+        case ',': if (length == 1) return KIND_COMMA; break;
+        case '(': if (length == 1) return KIND_LEFT_PAREN; break;
+        case ')': if (length == 1) return KIND_RIGHT_PAREN; break;
+        case '{': if (length == 1) return KIND_LEFT_BRACE; break;
+        case '}': if (length == 1) return KIND_RIGHT_BRACE; break;
+        case '+': if (length == 1) return KIND_PLUS; goto operator;
+        case '-': if (length == 1) return KIND_MINUS; goto operator;
+        case '*': if (length == 1) return KIND_MULTIPLY; goto operator;
+        case '/': if (length == 1) return KIND_DIVIDE; goto operator;
+        case '^': if (length == 1) return KIND_POWER; goto operator;
+        case '=':
+            if (length == 1) return KIND_ASSIGN;
+            if (length == 2 && token[1] == '=') return KIND_EQUALS;
+            goto operator;
+        case '<':
+            if (length == 1) return KIND_LESS;
+            if (length == 2 && token[1] == '>') return KIND_NOT_EQUALS;
+            if (length == 2 && token[1] == '=') return KIND_LESS_EQUAL;
+            goto operator;
+        case '>':
+            if (length == 1) return KIND_GREATER;
+            if (length == 2 && token[1] == '=') return KIND_GREATER_EQUAL;
+            goto operator;
+        case '&': if (length == 2 && token[1] == '&') return KIND_AND; goto operator;
+        case '|': if (length == 2 && token[1] == '|') return KIND_OR; goto operator;
+        case '!':
+        operator:
+            // Só caracteres de operador, mas nenhum operador da gramática
+            if (is_invalid_operator(token, length)) return KIND_INVALID_OPERATOR;
+            if (token[0] == '!') return KIND_VARIABLE;
+            break;
+        case 'f': if (length == 6 && strcmp(token, "funcao") == 0) return KIND_FUNCAO; break;
+        case 'p':
+            if (length == 4 && strcmp(token, "para") == 0) return KIND_PARA;
+            if (length == 9 && strcmp(token, "principal") == 0) return KIND_PRINCIPAL;
+            break;
+        case 'l': if (length == 4 && strcmp(token, "leia") == 0) return KIND_LEIA; break;
+        case 'e': if (length == 7 && strcmp(token, "escreva") == 0) return KIND_ESCREVA; break;
+        case 's': if (length == 2 && token[1] == 'e') return KIND_SE; break;
+        case 'i': if (length == 7 && strcmp(token, "inteiro") == 0) return KIND_TYPE; break;
+        case 't': if (length == 5 && strcmp(token, "texto") == 0) return KIND_TYPE; break;
+        case 'd': if (length == 7 && strcmp(token, "decimal") == 0) return KIND_TYPE; break;
+        default:
+            if (isdigit((unsigned char)token[0])) return KIND_NUMBER;
+            break;
+    }
+    return KIND_WORD;
+}
+
+// Garante espaço para o tipo de `count` tokens e a sentinela. O vetor fica
+// fora do limite de memória da análise, como as posições, e é reaproveitado
+// entre arquivos.
+static void reserve_token_kinds(AnalysisContext *ctx, int count) {
+    if (ctx->kind_capacity < count + 1) {
+        TokenKind *kinds = realloc(ctx->token_kinds, (count + 1) * sizeof(TokenKind));
+        if (kinds == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->token_kinds = kinds;
+        ctx->kind_capacity = count + 1;
+    }
+}
+
+// Arena dos nós da árvore sintática, fora do limite de memória da análise
+static void* arena_alloc(AnalysisContext *ctx, Arena *arena, size_t size) {
+    const size_t header = (sizeof(ArenaBlock) + 15) & ~(size_t)15;
+    size = (size + 15) & ~(size_t)15;
+    ArenaBlock *block = arena->current;
+    while (block == NULL || block->used + size > block->size) {
+        if (block != NULL && block->next != NULL) {
+            block = block->next;
+            block->used = 0;
+            continue;
         }
-        if (inside_function && strcmp(token, "retorno") == 0) {
-            has_return = true;
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *fresh = malloc(header + block_size);
+        if (fresh == NULL) {
+            analysis_out_of_memory(ctx);
         }
-        if (strcmp(token, "}") == 0) {
-            if (inside_function) {
-                if (current_function_name != NULL && strcmp(current_function_name, "__principal") != 0) {
-                    if (!has_return) {
-                        printf("SEMANTIC ERROR: Funcao '%s' sem 'retorno'.\n", current_function_name);
-                        error_count++;
-                    }
-                }
-                inside_function = false;
-                has_return = false;
-                current_function_name = NULL;
-            }
+        fresh->next = NULL;
+        fresh->used = 0;
+        fresh->size = block_size;
+        if (block != NULL) {
+            block->next = fresh;
+        } else {
+            arena->first = fresh;
         }
+        block = fresh;
     }
+    arena->current = block;
+    void *ptr = (char*)block + header + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static void reset_arena(Arena *arena) {
+    arena->current = arena->first;
+    if (arena->first != NULL) {
+        arena->first->used = 0;
+    }
+}
 
-    if (error_count > 0) {
-        return 0; 
+static void free_arena(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
     }
-    return 1; 
+    arena->first = NULL;
+    arena->current = NULL;
 }
 
-int is_invalid_operator(const char *token) {
-    // Lista de caracteres válidos de operadores
-    const char valid_chars[] = "<>!=&|+-*/^";
-    int len = strlen(token);
+// Analisador sintático descendente recursivo. Percorre os tokens uma vez,
+// montando comandos, blocos e expressões com precedência. A árvore alimenta
+// a resolução de nomes, a inferência de tipos e as validações de leia,
+// escreva, se e para: as regras de estrutura desses comandos são conferidas
+// aqui, ao montá-los, e guardadas no CommandCheck do nó. Não emite
+// diagnósticos: o que não cabe na gramática vira AST_ERROR e os fechamentos
+// ausentes ficam com end = -1.
+// Parênteses, chaves e aspas terminam no par dado por bracket_match.
+// Abaixo de PARSER_MAX_DEPTH níveis a descida para e os tokens viram
+// AST_ERROR, um de cada vez, até o fechamento do nível de cima.
+#define PARSER_MAX_DEPTH 512
 
-    // Tokens válidos de múltiplos caracteres (válidos na gramática)
-    const char* valid_multi_tokens[] = {
-        "==", "<>", "<=", ">=", "&&", "||", "+", "-", "*", "/", "^", "<", ">", "="
-    };
-    int num_valid_multi = sizeof(valid_multi_tokens)/sizeof(valid_multi_tokens[0]);
+typedef struct Parser {
+    AnalysisContext *ctx;
+    char **tokens;
+    TokenKind *kinds; // Termina com KIND_END, então olhar o token atual é sempre seguro
+    const int *match; // Índice de pares do arquivo
+    int length;
+    int pos;
+    int depth;
+    AstNode **commands; // Onde registrar os comandos conferidos; NULL fora da passada principal
+} Parser;
 
-    for (int i = 0; i < num_valid_multi; i++) {
-        if (strcmp(token, valid_multi_tokens[i]) == 0) {
-            return 0; 
-        }
+static AstNode* parse_statement(Parser *p);
+static AstNode* parse_expression(Parser *p);
+
+static AstNode* ast_node(Parser *p, AstKind kind, int token) {
+    AstNode *node = arena_alloc(p->ctx, &p->ctx->ast_arena, sizeof(AstNode));
+    node->kind = kind;
+    node->token = token;
+    node->end = token;
+    node->child = NULL;
+    node->last_child = NULL;
+    node->next = NULL;
+    node->check = NULL;
+    return node;
+}
+
+static void ast_add_child(AstNode *parent, AstNode *child) {
+    if (parent->last_child != NULL) {
+        parent->last_child->next = child;
+    } else {
+        parent->child = child;
+    }
+    parent->last_child = child;
+}
+
+static void parser_skip_newlines(Parser *p) {
+    while (p->kinds[p->pos] == KIND_NEWLINE) {
+        p->pos++;
+    }
+}
+
+static bool parser_at_quote(Parser *p) {
+    return p->kinds[p->pos] == KIND_QUOTED && p->tokens[p->pos][1] == '\0';
+}
+
+// Onde o laço de um grupo ou bloco aberto em `open` para: no fechamento, ou
+// no fim dos tokens quando não há
+static int parser_limit(Parser *p, int open) {
+    int close = p->match[open];
+    return close > open ? close : p->length;
+}
+
+// Termina um grupo ou bloco no fechamento dado pelo índice de pares
+static void parser_close(Parser *p, AstNode *node) {
+    int close = p->match[node->token];
+    node->end = close > node->token ? close : -1;
+    if (node->end == -1) {
+        p->pos = p->length;
+    } else if (p->pos <= node->end) {
+        p->pos = node->end + 1;
+    }
+}
+
+// Texto entre aspas, até as aspas que fecham. Aspas que o índice de pares vê
+// como fechamento de um texto anterior ficam sozinhas, sem fim.
+static AstNode* parse_string(Parser *p) {
+    AstNode *node = ast_node(p, AST_STRING, p->pos);
+    if (p->match[p->pos] != -1 && p->match[p->pos] < p->pos) {
+        node->end = -1;
+        p->pos++;
+        return node;
     }
+    parser_close(p, node);
+    return node;
+}
 
-    for (int i = 0; i < len; i++) {
-        if (strchr(valid_chars, token[i]) == NULL) {
-            return 0; 
+// Parênteses com expressões separadas por vírgula. Tokens que não começam
+// uma expressão (chaves, ';', palavras-chave) entram como AST_ERROR, até o
+// ')' correspondente.
+static AstNode* parse_group(Parser *p) {
+    AstNode *node = ast_node(p, AST_GROUP, p->pos);
+    int limit = parser_limit(p, p->pos);
+    p->pos++;
+    while (p->pos < limit) {
+        TokenKind kind = p->kinds[p->pos];
+        if (kind == KIND_COMMA) {
+            p->pos++;
+            continue;
         }
+        int start = p->pos;
+        AstNode *child = parse_expression(p);
+        if (p->pos == start) {
+            child = ast_node(p, AST_ERROR, p->pos++);
+        }
+        ast_add_child(node, child);
     }
-    return 1;
+    parser_close(p, node);
+    return node;
 }
 
-int main() {
-    DIR *dir;
-    struct dirent *entry;
-    char path[512];
+// Primeira parte de uma expressão, onde ela começa no texto
+static AstNode* ast_leading(AstNode *node) {
+    while ((node->kind == AST_BINARY || node->kind == AST_ASSIGNMENT || node->kind == AST_POSTFIX) &&
+           node->child != NULL) {
+        node = node->child;
+    }
+    return node;
+}
 
-    dir = opendir("./data");
-    if (dir == NULL) {
-        printf("Não foi possível abrir o diretório ./data\n");
-        return 1;
+static CommandCheck* command_check(Parser *p, AstNode *node) {
+    CommandCheck *check = arena_alloc(p->ctx, &p->ctx->ast_arena, sizeof(CommandCheck));
+    memset(check, 0, sizeof(CommandCheck));
+    node->check = check;
+    if (p->commands != NULL) {
+        p->commands[node->token] = node;
     }
+    return check;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+static void check_break(CommandCheck *check, CheckRule rule, int token) {
+    check->rule = rule;
+    check->token = token;
+}
+
+// Lista do leia ou do escreva: a mesma árvore de parse_group(), conferindo
+// que itens e vírgulas se alternam. Com `strings` (escreva), texto entre
+// aspas também é item. Parênteses internos entram inteiros; um parêntese ou
+// texto sem fechamento encerra a conferência.
+static AstNode* parse_io_list(Parser *p, CommandCheck *check, bool strings) {
+    AstNode *node = ast_node(p, AST_GROUP, p->pos);
+    int limit = parser_limit(p, p->pos);
+    p->pos++;
+    bool checking = true;
+    bool expecting_item = true;
+    int last_comma = -1;
+    while (p->pos < limit) {
+        if (p->kinds[p->pos] == KIND_COMMA) {
+            if (checking && expecting_item) {
+                check_break(check, CHECK_EXPECTED_ITEM, p->pos);
+                checking = false;
+            } else if (checking) {
+                expecting_item = true;
+                last_comma = p->pos;
+            }
+            p->pos++;
+            continue;
+        }
+        int start = p->pos;
+        AstNode *child = parse_expression(p);
+        if (p->pos == start) {
+            child = ast_node(p, AST_ERROR, p->pos++);
+        }
+        ast_add_child(node, child);
+        if (!checking) continue;
+        
+        AstNode *lead = ast_leading(child);
+        int lead_end = lead->token;
+        if (lead->kind == AST_GROUP || (strings && lead->kind == AST_STRING)) {
+            if (lead->end == -1) {
+                checking = false;
+                continue;
+            }
+            lead_end = lead->end;
+            if (lead->kind == AST_STRING && expecting_item) {
+                check->items++;
+                expecting_item = false;
+            }
+        } else if (expecting_item && is_variable(p->tokens[lead->token])) {
+            check->items++;
+            expecting_item = false;
+        } else {
+            check_break(check, expecting_item ? CHECK_EXPECTED_ITEM : CHECK_EXPECTED_COMMA, lead->token);
+            checking = false;
             continue;
+        }
+        // A expressão segue depois do item: o operador já quebra a lista
+        if (p->pos > lead_end + 1) {
+            check_break(check, expecting_item ? CHECK_EXPECTED_ITEM : CHECK_EXPECTED_COMMA, lead_end + 1);
+            checking = false;
+        }
+    }
+    if (check->rule == CHECK_OK) {
+        if (expecting_item && check->items > 0) {
+            check_break(check, CHECK_TRAILING_COMMA, last_comma);
+        } else if (check->items == 0) {
+            check_break(check, CHECK_EMPTY, node->token);
+        }
+    }
+    parser_close(p, node);
+    return node;
+}
 
-        snprintf(path, sizeof(path), "./data/%s", entry->d_name);
+// Corpo de uma linha que começa em `start`: procura o ';' que o termina e
+// uma declaração antes dele. Um bloco é conferido pela validação, pelo par
+// do '{'.
+static void parser_branch(Parser *p, int start, CommandBranch *branch) {
+    branch->start = start;
+    branch->semicolon = -1;
+    branch->declaration = -1;
+    if (p->kinds[start] == KIND_LEFT_BRACE) return;
+    for (int k = start; k < p->length; k++) {
+        TokenKind kind = p->kinds[k];
+        if (kind == KIND_SEMICOLON) {
+            branch->semicolon = k;
+            return;
+        }
+        if (kind == KIND_TYPE || (kind == KIND_WORD && strcmp(p->tokens[k], "flutuante") == 0)) {
+            branch->declaration = k;
+            return;
+        }
+    }
+}
 
-        printf("\n==============================\n");
-        printf("Processando arquivo: %s\n", path);
+// Último token do corpo que começa em `start`, ou -1 se ele não termina
+static int parser_branch_end(Parser *p, const CommandBranch *branch) {
+    if (p->kinds[branch->start] == KIND_LEFT_BRACE) {
+        int close = p->match[branch->start];
+        return close > branch->start ? close : -1;
+    }
+    return branch->declaration == -1 ? branch->semicolon : -1;
+}
 
-        // Inicializa a tabela de símbolos para cada arquivo
-        init_symbol_table();
+// Parâmetros de uma função: "tipo !nome" ou só "!nome"
+static AstNode* parse_parameters(Parser *p) {
+    AstNode *node = ast_node(p, AST_GROUP, p->pos);
+    int limit = parser_limit(p, p->pos);
+    p->pos++;
+    while (p->pos < limit) {
+        TokenKind kind = p->kinds[p->pos];
+        if (kind == KIND_COMMA) {
+            p->pos++;
+        } else if (kind == KIND_TYPE || kind == KIND_VARIABLE) {
+            AstNode *parameter = ast_node(p, AST_PARAMETER, p->pos++);
+            if (kind == KIND_TYPE && p->pos < limit && p->kinds[p->pos] == KIND_VARIABLE) {
+                parameter->end = p->pos++;
+            }
+            ast_add_child(node, parameter);
+        } else {
+            ast_add_child(node, ast_node(p, AST_ERROR, p->pos++));
+        }
+    }
+    parser_close(p, node);
+    return node;
+}
 
-        char *content = read_file(path);
-        if (content == NULL) {
-            printf("Erro ao ler o arquivo: %s\n", path);
+// Cabeçalho do para: segmentos separados por ';' no primeiro nível
+static AstNode* parse_for_header(Parser *p) {
+    AstNode *node = ast_node(p, AST_GROUP, p->pos);
+    int limit = parser_limit(p, p->pos);
+    p->pos++;
+    AstNode *segment = ast_node(p, AST_SEGMENT, p->pos);
+    ast_add_child(node, segment);
+    while (p->pos < limit) {
+        TokenKind kind = p->kinds[p->pos];
+        if (kind == KIND_SEMICOLON) {
+            segment->end = p->pos - 1;
+            p->pos++;
+            segment = ast_node(p, AST_SEGMENT, p->pos);
+            ast_add_child(node, segment);
             continue;
         }
+        if (kind == KIND_COMMA) {
+            p->pos++;
+            continue;
+        }
+        int start = p->pos;
+        AstNode *child = parse_expression(p);
+        if (p->pos == start) {
+            child = ast_node(p, AST_ERROR, p->pos++);
+        }
+        ast_add_child(segment, child);
+    }
+    segment->end = limit - 1;
+    parser_close(p, node);
+    return node;
+}
 
-        int length = 0;
-        char **tokens = string_tokens(content, &length);
+static AstNode* parse_primary(Parser *p) {
+    int start = p->pos;
+    switch (p->kinds[start]) {
+        case KIND_NUMBER:
+            p->pos++;
+            return ast_node(p, AST_NUMBER, start);
+        case KIND_VARIABLE:
+            p->pos++;
+            return ast_node(p, AST_VARIABLE, start);
+        case KIND_QUOTED:
+            if (parser_at_quote(p)) return parse_string(p);
+            p->pos++;
+            return ast_node(p, AST_NAME, start);
+        case KIND_LEFT_PAREN:
+            return parse_group(p);
+        case KIND_WORD:
+            p->pos++;
+            if (strncmp(p->tokens[start], "__", 2) == 0 && p->kinds[p->pos] == KIND_LEFT_PAREN) {
+                AstNode *call = ast_node(p, AST_CALL, start);
+                AstNode *arguments = parse_group(p);
+                ast_add_child(call, arguments);
+                call->end = arguments->end;
+                return call;
+            }
+            return ast_node(p, AST_NAME, start);
+        case KIND_INVALID_OPERATOR:
+            p->pos++;
+            return ast_node(p, AST_ERROR, start);
+        default:
+            // Fim da expressão: quem chamou decide o que fazer com o token
+            return ast_node(p, AST_ERROR, start);
+    }
+}
 
-        if (tokens != NULL) {    
-            printf("\nTotal de tokens: %d\n", length);
-            
-            printf("\nClassificação dos tokens:\n");
-            int i = 0;
-            int current_line = 1;
-            
-            while (i < length) {
-                char *cleaned = clear_token(tokens[i]);
-                if (strcmp(tokens[i], "principal") == 0) {
-                    PRINCIPAL_FUNC = true;
-                }
-                if (strcmp(tokens[i], "\\n") == 0) {
-                    current_line++;
-                    if (i == 0) {
-                        printf("tokens[%d] = \"%s\" -> NEWLINE\n", i, tokens[i]);
-                    } else {
-                        char *prev = tokens[i - 1];
-                        if (strcmp(prev, ";") != 0 && strcmp(prev, "{") != 0 && strcmp(prev, "}") != 0 && strcmp(prev, "\\n") != 0) {
-                            printf("tokens[%d] = \"%s\" -> SYNTAX ERROR (ausência de ; após '%s')\n", i, tokens[i], prev);
-                            break;
-                        } else {
-                            printf("tokens[%d] = \"%s\" -> NEWLINE\n", i, tokens[i]);
-                        }
-                    }
-                    i++;
+// Desce um nível. Fundo demais, devolve false: quem chamou produz um
+// AST_ERROR sem consumir o token.
+static bool parser_descend(Parser *p) {
+    if (p->depth >= PARSER_MAX_DEPTH) return false;
+    p->depth++;
+    return true;
+}
+
+static AstNode* parse_unary(Parser *p) {
+    if (!parser_descend(p)) return ast_node(p, AST_ERROR, p->pos);
+    AstNode *node;
+    TokenKind kind = p->kinds[p->pos];
+    if (kind == KIND_PLUS || kind == KIND_MINUS) {
+        node = ast_node(p, AST_UNARY, p->pos++);
+        ast_add_child(node, parse_unary(p));
+    } else {
+        node = parse_primary(p);
+        if (p->kinds[p->pos] == KIND_INVALID_OPERATOR &&
+            (strcmp(p->tokens[p->pos], "++") == 0 || strcmp(p->tokens[p->pos], "--") == 0)) {
+            AstNode *operand = node;
+            node = ast_node(p, AST_POSTFIX, p->pos++);
+            ast_add_child(node, operand);
+        }
+    }
+    p->depth--;
+    return node;
+}
+
+static int binary_precedence(TokenKind kind) {
+    switch (kind) {
+        case KIND_OR: return 1;
+        case KIND_AND: return 2;
+        case KIND_EQUALS:
+        case KIND_NOT_EQUALS: return 3;
+        case KIND_LESS:
+        case KIND_LESS_EQUAL:
+        case KIND_GREATER:
+        case KIND_GREATER_EQUAL: return 4;
+        case KIND_PLUS:
+        case KIND_MINUS: return 5;
+        case KIND_MULTIPLY:
+        case KIND_DIVIDE: return 6;
+        case KIND_POWER: return 7;
+        default: return 0;
+    }
+}
+
+// Operadores binários por precedência; '^' associa à direita
+static AstNode* parse_binary(Parser *p, int min_precedence) {
+    if (!parser_descend(p)) return ast_node(p, AST_ERROR, p->pos);
+    AstNode *left = parse_unary(p);
+    for (;;) {
+        TokenKind op = p->kinds[p->pos];
+        int precedence = binary_precedence(op);
+        if (precedence == 0 || precedence < min_precedence) {
+            p->depth--;
+            return left;
+        }
+        AstNode *node = ast_node(p, AST_BINARY, p->pos++);
+        ast_add_child(node, left);
+        ast_add_child(node, parse_binary(p, op == KIND_POWER ? precedence : precedence + 1));
+        node->end = p->pos - 1;
+        left = node;
+    }
+}
+
+static AstNode* parse_expression(Parser *p) {
+    if (!parser_descend(p)) return ast_node(p, AST_ERROR, p->pos);
+    AstNode *node = parse_binary(p, 1);
+    if (p->kinds[p->pos] == KIND_ASSIGN) {
+        AstNode *target = node;
+        node = ast_node(p, AST_ASSIGNMENT, p->pos++);
+        ast_add_child(node, target);
+        ast_add_child(node, parse_expression(p));
+        node->end = p->pos - 1;
+    }
+    p->depth--;
+    return node;
+}
+
+// Fim de comando: consome o ';' ou marca o comando como não terminado
+static void parse_terminator(Parser *p, AstNode *node) {
+    if (p->kinds[p->pos] == KIND_SEMICOLON) {
+        node->end = p->pos++;
+    } else {
+        node->end = -1;
+    }
+}
+
+static AstNode* parse_block(Parser *p) {
+    AstNode *node = ast_node(p, AST_BLOCK, p->pos);
+    int limit = parser_limit(p, p->pos);
+    p->pos++;
+    for (;;) {
+        parser_skip_newlines(p);
+        if (p->pos >= limit) break;
+        ast_add_child(node, parse_statement(p));
+    }
+    parser_close(p, node);
+    return node;
+}
+
+// Bloco ou comando de uma linha, depois de 'se', 'senao' ou do cabeçalho do para
+static void parse_body(Parser *p, AstNode *node) {
+    parser_skip_newlines(p);
+    if (p->pos < p->length) {
+        AstNode *body = parse_statement(p);
+        ast_add_child(node, body);
+        node->end = body->end;
+    } else {
+        node->end = -1;
+    }
+}
+
+static AstNode* parse_function(Parser *p, AstKind kind) {
+    AstNode *node = ast_node(p, kind, p->pos);
+    p->pos++;
+    TokenKind next = p->kinds[p->pos];
+    if (kind == AST_FUNCTION && next != KIND_LEFT_PAREN && next != KIND_LEFT_BRACE &&
+        next != KIND_NEWLINE && next != KIND_END) {
+        ast_add_child(node, ast_node(p, AST_NAME, p->pos++));
+    }
+    if (p->kinds[p->pos] == KIND_LEFT_PAREN) {
+        ast_add_child(node, parse_parameters(p));
+    }
+    parser_skip_newlines(p);
+    if (p->kinds[p->pos] == KIND_LEFT_BRACE) {
+        AstNode *body = parse_block(p);
+        ast_add_child(node, body);
+        node->end = body->end;
+    } else {
+        node->end = -1;
+    }
+    return node;
+}
+
+static AstNode* parse_command(Parser *p) {
+    int start = p->pos;
+    TokenKind kind = p->kinds[start];
+    AstNode *node;
+    switch (kind) {
+        case KIND_FUNCAO:
+            return parse_function(p, AST_FUNCTION);
+        case KIND_PRINCIPAL:
+            return parse_function(p, AST_PRINCIPAL);
+        case KIND_LEFT_BRACE:
+            return parse_block(p);
+        case KIND_TYPE:
+            node = ast_node(p, AST_DECLARATION, p->pos++);
+            while (p->pos < p->length) {
+                TokenKind next = p->kinds[p->pos];
+                if (next == KIND_SEMICOLON || next == KIND_NEWLINE || next == KIND_RIGHT_BRACE) break;
+                if (next == KIND_COMMA) {
+                    p->pos++;
                     continue;
-                } else if (strncmp(tokens[i], "\"", strlen("\"")) == 0) {
-                    printf("tokens[%d] = \"%s\" -> STRING\n", i, tokens[i]);
-                    i++;
-                    while (i < length) {
-                        size_t len = strlen(tokens[i]);
-                        if (len >= strlen("\"") && strcmp(&tokens[i][len - strlen("\"")], "\"") == 0) {
-                            printf("tokens[%d] = \"%s\" -> STRING\n", i, tokens[i]);
-                            break;
-                        } else {
-                            printf("tokens[%d] = \"%s\" -> STRING\n", i, tokens[i]);
-                            i++;
-                        }
-                    }
-                } else if (strcmp(cleaned, "funcao") == 0) {
-                    if (i + 1 < length && strncmp(tokens[i + 1], "__", 2) == 0) {
-                        printf("tokens[%d] = \"%s\" -> KEYWORD\n", i, tokens[i]);
-                        
-                        // Valida o nome da função
-                        if (!validate_function_declaration(tokens[i + 1])) {
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                        
-                        printf("tokens[%d] = \"%s\" -> FUNC_NAME\n", i + 1, tokens[i + 1]);
-                        
-                        // Adiciona função à tabela de símbolos
-                        add_symbol(tokens[i + 1], SYMBOL_FUNCTION, TYPE_VOID, current_line);
-                        enter_scope(); // Entra no escopo da função
-                        
-                        char *current_function = tokens[i + 1];
-                        
-                        // Processa parâmetros da função se houver
-                        i += 2;
-                        if (i < length && strcmp(tokens[i], "(") == 0) {
-                            int start_params = i + 1;
-                            int end_params = i + 1;
-                            
-                            // Encontra o final da lista de parâmetros
-                            while (end_params < length && strcmp(tokens[end_params], ")") != 0) {
-                                end_params++;
-                            }
-                            
-                            // Valida a lista de parâmetros se não estiver vazia
-                            if (end_params > start_params) {
-                                if (!validate_parameter_list(tokens, start_params, end_params - 1)) {
-                                    printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                                    break;
-                                }
-                            }
-                            
-                            i = start_params; // volta para processar os parâmetros
-                            while (i < length && strcmp(tokens[i], ")") != 0) {
-                                if (is_variable(tokens[i])) {
-                                    // Remove vírgula do nome da variável se presente
-                                    char *param_name = safe_malloc(strlen(tokens[i]) + 1);
-                                    strcpy(param_name, tokens[i]);
-                                    char *comma = strchr(param_name, ',');
-                                    if (comma) *comma = '\0';
-                                    
-                                    // Adiciona parâmetro à tabela de símbolos
-                                    add_symbol(param_name, SYMBOL_PARAMETER, TYPE_INTEGER, current_line);
-                                    // Adiciona parâmetro à função
-                                    add_function_parameter(current_function, param_name, TYPE_INTEGER);
-                                    
-                                    printf("tokens[%d] = \"%s\" -> PARAMETER\n", i, tokens[i]);
-                                    free(param_name);
-                                } else if (strcmp(tokens[i], ",") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> COMMA\n", i, tokens[i]);
-                                }
-                                i++;
-                            }
-                            if (i < length && strcmp(tokens[i], ")") == 0) {
-                                i--; // volta um para o loop principal processar o ')'
-                            }
-                        }
-                        continue;
-                    } else if (i + 1 < length) {
-                        printf("tokens[%d] = \"%s\" -> KEYWORD\n", i, tokens[i]);
-                        printf("tokens[%d] = \"%s\" -> SEMANTIC ERROR (Nome de função deve começar com '__')\n", i + 1, tokens[i + 1]);
-                        printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                        break; 
-                    } else {
-                        printf("tokens[%d] = \"%s\" -> KEYWORD\n", i, tokens[i]);
-                        printf("tokens[%d] = <FIM> -> LEXICAL ERROR\n", i + 1);
-                        printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                        break;
-                    }
-                } else if ((i + 1 < length) && strcmp(tokens[i + 1], "=") == 0) {
-                    if (tokens[i][0] != '!') {
-                        char *suggestion = suggest_keyword(tokens[i]);
-                        if (suggestion != NULL) {
-                            printf("tokens[%d] = \"%s\" -> LEXICAL ERROR (Você quis dizer '%s'?)\n", i, tokens[i], suggestion);
-                        } else {
-                            printf("tokens[%d] = \"%s\" -> LEXICAL ERROR\n", i, tokens[i]);
-                        }
-                        printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                        break;
-                    } else {
-                        // Remove vírgula do nome da variável se presente para busca
-                        char *var_name = safe_malloc(strlen(tokens[i]) + 1);
-                        strcpy(var_name, tokens[i]);
-                        char *comma = strchr(var_name, ',');
-                        if (comma) *comma = '\0';
-                        
-                        // Verifica se a variável já foi declarada
-                        Symbol *var = lookup_symbol(var_name);
-                        if (var == NULL) {
-                            printf("tokens[%d] = \"%s\" -> SEMANTIC ERROR (Variável não declarada)\n", i, tokens[i]);
-                        } else {
-                            printf("tokens[%d] = \"%s\" -> VARIABLE (uso)\n", i, tokens[i]);
-                        }
-                        free(var_name);
+                }
+                int before = p->pos;
+                AstNode *declarator = parse_expression(p);
+                if (p->pos == before) {
+                    declarator = ast_node(p, AST_ERROR, p->pos++);
+                }
+                ast_add_child(node, declarator);
+            }
+            parse_terminator(p, node);
+            return node;
+        case KIND_LEIA:
+        case KIND_ESCREVA:
+            node = ast_node(p, kind == KIND_LEIA ? AST_READ : AST_WRITE, p->pos);
+            p->pos++;
+            if (p->kinds[p->pos] == KIND_LEFT_PAREN) {
+                ast_add_child(node, parse_io_list(p, command_check(p, node), kind == KIND_ESCREVA));
+            }
+            parse_terminator(p, node);
+            return node;
+        case KIND_SE:
+            node = ast_node(p, AST_IF, p->pos);
+            p->pos++;
+            if (p->kinds[p->pos] == KIND_LEFT_PAREN) {
+                AstNode *test = parse_group(p);
+                ast_add_child(node, test);
+                if (test->end != -1) {
+                    // Como a validação os lê: o corpo logo depois do teste e
+                    // o senao logo depois do corpo
+                    CommandCheck *check = command_check(p, node);
+                    check->branch_count = 1;
+                    parser_branch(p, test->end + 1, &check->branches[0]);
+                    int then_end = parser_branch_end(p, &check->branches[0]);
+                    if (then_end != -1 && then_end + 1 < p->length && p->kinds[then_end + 1] == KIND_WORD &&
+                        strcmp(p->tokens[then_end + 1], "senao") == 0) {
+                        check->branch_count = 2;
+                        parser_branch(p, then_end + 2, &check->branches[1]);
                     }
-                } else if (strcmp(cleaned, "principal") == 0) {
-                    printf("tokens[%d] = \"%s\" -> KEYWORD\n", i, tokens[i]);
-                    
-                    // Adiciona função principal à tabela de símbolos
-                    add_symbol("__principal", SYMBOL_FUNCTION, TYPE_VOID, current_line);
-                    enter_scope(); // Entra no escopo da função principal
-                    
-                    i++; 
+                }
+            }
+            parse_body(p, node);
+            // 'senao' pode vir depois de quebras de linha
+            int after_body = p->pos;
+            parser_skip_newlines(p);
+            if (p->kinds[p->pos] == KIND_WORD && strcmp(p->tokens[p->pos], "senao") == 0) {
+                AstNode *otherwise = ast_node(p, AST_ELSE, p->pos++);
+                parse_body(p, otherwise);
+                ast_add_child(node, otherwise);
+                node->end = otherwise->end;
+            } else {
+                p->pos = after_body;
+            }
+            return node;
+        case KIND_PARA:
+            node = ast_node(p, AST_FOR, p->pos);
+            p->pos++;
+            if (p->kinds[p->pos] == KIND_LEFT_PAREN) {
+                AstNode *header = parse_for_header(p);
+                ast_add_child(node, header);
+                if (header->end != -1) {
+                    CommandCheck *check = command_check(p, node);
+                    check->branch_count = 1;
+                    parser_branch(p, header->end + 1, &check->branches[0]);
+                }
+            }
+            parse_body(p, node);
+            return node;
+        case KIND_SEMICOLON:
+            p->pos++;
+            return ast_node(p, AST_EXPRESSION, start);
+        default:
+            break;
+    }
+    if (kind == KIND_WORD && strcmp(p->tokens[start], "retorno") == 0) {
+        node = ast_node(p, AST_RETURN, p->pos++);
+        TokenKind next = p->kinds[p->pos];
+        if (next != KIND_SEMICOLON && next != KIND_NEWLINE && next != KIND_RIGHT_BRACE && next != KIND_END) {
+            ast_add_child(node, parse_expression(p));
+        }
+        parse_terminator(p, node);
+        return node;
+    }
+    
+    node = ast_node(p, AST_EXPRESSION, start);
+    AstNode *expression = parse_expression(p);
+    if (p->pos == start) {
+        // Nada aqui começa um comando: o token é pulado
+        node->kind = AST_ERROR;
+        p->pos++;
+        return node;
+    }
+    ast_add_child(node, expression);
+    parse_terminator(p, node);
+    return node;
+}
 
-                    // Verifica se o próximo token é '('
-                    if (i >= length || strcmp(tokens[i], "(") != 0) {
-                        printf("tokens[%d] = \"%s\" -> SYNTAX ERROR (esperado '(' após 'principal')\n", i, tokens[i]);
-                        break; 
-                    }
-                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", i, tokens[i]);
-                    i++; 
+static AstNode* parse_statement(Parser *p) {
+    if (!parser_descend(p)) {
+        // Fundo demais para descer: o token é pulado como erro
+        return ast_node(p, AST_ERROR, p->pos++);
+    }
+    AstNode *node = parse_command(p);
+    p->depth--;
+    return node;
+}
 
-                    // Verifica se o próximo token é ')'
-                    if (i >= length || strcmp(tokens[i], ")") != 0) {
-                        printf("SYNTAX ERROR: '%s' inesperado dentro da declaração da função 'principal'\n", tokens[i]);
-                        printf("tokens[%d] = \"%s\" -> SYNTAX ERROR (esperado ')' após '(' em 'principal')\n", i, tokens[i]);
-                        break;
-                    }
-                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", i, tokens[i]);
-                    if (tokens[i+1] == NULL || strcmp(tokens[i+1], "{") != 0) {
-                        printf("tokens[%d] = \"%s\" -> ERRO: esperado '{' após 'principal()'\n", i+1, tokens[i+1]);
-                        break;
-                    } 
-                    i++;
-                    printf("tokens[%d] = \"%s\" -> LEFT_BRACE\n", i, tokens[i]);
-                    i++;
-                } else if (strcmp(tokens[i], ";") == 0) {
-                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "+") == 0) {
-                    printf("tokens[%d] = \"%s\" -> PLUS\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "-") == 0) {
-                    printf("tokens[%d] = \"%s\" -> MINUS\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "*") == 0) {
-                    printf("tokens[%d] = \"%s\" -> MULTIPLY\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "/") == 0) {
-                    printf("tokens[%d] = \"%s\" -> DIVIDE\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "^") == 0) {
-                    printf("tokens[%d] = \"%s\" -> POWER\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "==") == 0) {
-                    printf("tokens[%d] = \"%s\" -> EQUALS\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "<>") == 0) {
-                    printf("tokens[%d] = \"%s\" -> NOT_EQUALS\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "<") == 0) {
-                    printf("tokens[%d] = \"%s\" -> LESS\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "<=") == 0) {
-                    printf("tokens[%d] = \"%s\" -> LESS_EQUAL\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], ">") == 0) {
-                    printf("tokens[%d] = \"%s\" -> GREATER\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], ">=") == 0) {
-                    printf("tokens[%d] = \"%s\" -> GREATER_EQUAL\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "&&") == 0) {
-                    printf("tokens[%d] = \"%s\" -> AND\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "||") == 0) {
-                    printf("tokens[%d] = \"%s\" -> OR\n", i, tokens[i]);
-                } else if (is_invalid_operator(tokens[i])) {
-                    printf("tokens[%d] = \"%s\" -> LEXICAL ERROR (Operador inválido)\n", i, tokens[i]);
-                    printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                    break;
-                } else if (strcmp(tokens[i], ",") == 0) {
-                    printf("tokens[%d] = \"%s\" -> COMMA\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "=") == 0) {
-                    printf("tokens[%d] = \"%s\" -> ASSIGNMENT\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], ";") == 0) {
-                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "(") == 0) {
-                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], ")") == 0) {
-                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "{") == 0) {
-                    printf("tokens[%d] = \"%s\" -> LEFT_BRACE\n", i, tokens[i]);
-                    enter_scope(); // Entra em novo escopo
-                } else if (strcmp(tokens[i], "}") == 0) {
-                    printf("tokens[%d] = \"%s\" -> RIGHT_BRACE\n", i, tokens[i]);
-                    exit_scope(); // Sai do escopo atual
-                } else if (isdigit(tokens[i][0])) {
-                    printf("tokens[%d] = \"%s\" -> INTEGER\n", i, tokens[i]);
-                } else if (strcmp(tokens[i], "leia") == 0) {
-                    // Processamento específico para o comando leia
-                    printf("tokens[%d] = \"%s\" -> LEIA_COMMAND\n", i, tokens[i]);
-                    
-                    if (i + 1 < length) {
-                        int end_pos = length - 1;
-                        if (validate_leia_command(tokens, i + 1, &end_pos, current_line)) {
-                            // Processa tokens validados do comando leia
-                            for (int j = i + 1; j <= end_pos; j++) {
-                                if (strcmp(tokens[j], "(") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ")") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ",") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> COMMA\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ";") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", j, tokens[j]);
-                                } else if (is_variable(tokens[j])) {
-                                    printf("tokens[%d] = \"%s\" -> VARIABLE (leitura)\n", j, tokens[j]);
-                                }
-                            }
-                            i = end_pos; // Pula para o final do comando processado
-                        } else {
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                    } else {
-                        printf("SYNTAX ERROR: Comando 'leia' incompleto\n");
-                        break;
-                    }
-                } else if (strcmp(tokens[i], "escreva") == 0) {
-                    // Processamento específico para o comando escreva
-                    printf("tokens[%d] = \"%s\" -> ESCREVA_COMMAND\n", i, tokens[i]);
-                    
-                    if (i + 1 < length) {
-                        int end_pos = length - 1;
-                        if (validate_escreva_command(tokens, i + 1, &end_pos, current_line)) {
-                            // Processa tokens validados do comando escreva
-                            for (int j = i + 1; j <= end_pos; j++) {
-                                if (strcmp(tokens[j], "(") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ")") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ",") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> COMMA\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ";") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "\"") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> QUOTE\n", j, tokens[j]);
-                                } else if (is_variable(tokens[j])) {
-                                    printf("tokens[%d] = \"%s\" -> VARIABLE (escrita)\n", j, tokens[j]);
-                                } else {
-                                    printf("tokens[%d] = \"%s\" -> STRING_TEXT\n", j, tokens[j]);
-                                }
-                            }
-                            i = end_pos; // Pula para o final do comando processado
-                        } else {
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                    } else {
-                        printf("SYNTAX ERROR: Comando 'escreva' incompleto\n");
-                        break;
-                    }
-                } else if (strcmp(tokens[i], "se") == 0) {
-                    // Processamento específico para o comando se
-                    printf("tokens[%d] = \"%s\" -> SE_COMMAND\n", i, tokens[i]);
-                    
-                    if (i + 1 < length) {
-                        int end_pos = length - 1;
-                        if (validate_se_command(tokens, i + 1, &end_pos, current_line)) {
-                            // Processa tokens validados do comando se
-                            for (int j = i + 1; j <= end_pos; j++) {
-                                if (strcmp(tokens[j], "(") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ")") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "{") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_BRACE\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "}") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_BRACE\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ";") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "senao") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> SENAO_KEYWORD\n", j, tokens[j]);
-                                } else if (is_variable(tokens[j])) {
-                                    printf("tokens[%d] = \"%s\" -> VARIABLE (condicional)\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "\n") != 0) {
-                                    printf("tokens[%d] = \"%s\" -> CONDITIONAL_CONTENT\n", j, tokens[j]);
-                                }
-                            }
-                            i = end_pos; // Pula para o final do comando processado
-                        } else {
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                    } else {
-                        printf("SYNTAX ERROR: Comando 'se' incompleto\n");
-                        break;
-                    }
-                } else if (strcmp(tokens[i], "para") == 0) {
-                    // Processamento específico para o comando para
-                    printf("tokens[%d] = \"%s\" -> PARA_COMMAND\n", i, tokens[i]);
-                    
-                    if (i + 1 < length) {
-                        int end_pos = length - 1;
-                        if (validate_para_command(tokens, i + 1, &end_pos, current_line)) {
-                            // Processa tokens validados do comando para
-                            for (int j = i + 1; j <= end_pos; j++) {
-                                if (strcmp(tokens[j], "(") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ")") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_PAREN\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "{") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> LEFT_BRACE\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "}") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> RIGHT_BRACE\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ";") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> SEMICOLON\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], ",") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> COMMA\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "=") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> ASSIGNMENT\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "+") == 0 || strcmp(tokens[j], "-") == 0 || 
-                                         strcmp(tokens[j], "*") == 0 || strcmp(tokens[j], "/") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> MATH_OPERATOR\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "++") == 0 || strcmp(tokens[j], "--") == 0) {
-                                    printf("tokens[%d] = \"%s\" -> INCREMENT_DECREMENT\n", j, tokens[j]);
-                                } else if (is_variable(tokens[j])) {
-                                    printf("tokens[%d] = \"%s\" -> VARIABLE (loop)\n", j, tokens[j]);
-                                } else if (isdigit(tokens[j][0])) {
-                                    printf("tokens[%d] = \"%s\" -> NUMBER\n", j, tokens[j]);
-                                } else if (strcmp(tokens[j], "\n") != 0) {
-                                    printf("tokens[%d] = \"%s\" -> LOOP_CONTENT\n", j, tokens[j]);
-                                }
-                            }
-                            i = end_pos; // Pula para o final do comando processado
-                        } else {
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                    } else {
-                        printf("SYNTAX ERROR: Comando 'para' incompleto\n");
-                        break;
-                    }
-                } else if (strcmp(tokens[i], "inteiro") == 0 || strcmp(tokens[i], "texto") == 0 || strcmp(tokens[i], "decimal") == 0) {
-                    // Declaração de variável
-                    DataType var_type = string_to_data_type(tokens[i]);
-                    const char* type_name = data_type_to_string(var_type);
-                    
-                    printf("tokens[%d] = \"%s\" -> %s_TYPE\n", i, tokens[i], 
-                           var_type == TYPE_INTEGER ? "INTEGER" : 
-                           var_type == TYPE_STRING ? "STRING" : "FLOAT");
-                    
-                    // Processa todas as variáveis declaradas na linha
-                    i++; // vai para o primeiro identificador
-                    while (i < length && strcmp(tokens[i], ";") != 0 && strcmp(tokens[i], "\\n") != 0) {
-                        if (strncmp(tokens[i], "!", 1) == 0) {
-                            // Remove vírgula do nome da variável se presente
-                            char *var_name = safe_malloc(strlen(tokens[i]) + 1);
-                            strcpy(var_name, tokens[i]);
-                            char *comma = strchr(var_name, ',');
-                            if (comma) *comma = '\0';
-                            
-                            // Verifica se é redeclaração de parâmetro
-                            if (is_parameter_redeclaration(var_name)) {
-                                printf("tokens[%d] = \"%s\" -> SEMANTIC ERROR (Parâmetro '%s' não deve ser redeclarado dentro da função)\n", 
-                                       i, tokens[i], var_name);
-                                printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                                free(var_name);
-                                break;
-                            }
-                            
-                            // Adiciona variável à tabela de símbolos
-                            if (add_symbol(var_name, SYMBOL_VARIABLE, var_type, current_line)) {
-                                printf("tokens[%d] = \"%s\" -> VARIABLE (declaração)\n", i, tokens[i]);
-                            }
-                            free(var_name);
-                        } else if (strcmp(tokens[i], "=") == 0) {
-                            printf("tokens[%d] = \"%s\" -> ASSIGNMENT\n", i, tokens[i]);
-                        } else if (strcmp(tokens[i], ",") == 0) {
-                            printf("tokens[%d] = \"%s\" -> COMMA\n", i, tokens[i]);
-                        } else if (isdigit(tokens[i][0])) {
-                            printf("tokens[%d] = \"%s\" -> INTEGER\n", i, tokens[i]);
-                        } else {
-                            printf("tokens[%d] = \"%s\" -> IDENTIFIER/OTHER\n", i, tokens[i]);
-                        }
-                        i++;
-                    }
-                    i--; // volta um para o loop principal processar o próximo token
-                } else if (is_variable(tokens[i])) {
-                    // Remove vírgula do nome da variável se presente para busca
-                    char *var_name = safe_malloc(strlen(tokens[i]) + 1);
-                    strcpy(var_name, tokens[i]);
-                    char *comma = strchr(var_name, ',');
-                    if (comma) *comma = '\0';
-                    
-                    // Verifica se a variável já foi declarada
-                    Symbol *var = lookup_symbol(var_name);
-                    if (var == NULL) {
-                        printf("tokens[%d] = \"%s\" -> SEMANTIC ERROR (Variável não declarada)\n", i, tokens[i]);
-                    } else {
-                        printf("tokens[%d] = \"%s\" -> VARIABLE (uso)\n", i, tokens[i]);
-                    }
-                    free(var_name);
-                } else if (has_lexical_error(tokens[i])) {
-                    char *suggestion = suggest_keyword(tokens[i]);
-                    if (suggestion != NULL) {
-                        printf("tokens[%d] = \"%s\" -> LEXICAL ERROR (Você quis dizer '%s'?)\n", i, tokens[i], suggestion);
-                    } else {
-                        printf("tokens[%d] = \"%s\" -> LEXICAL ERROR\n", i, tokens[i]);
+static void parser_init(Parser *p, AnalysisContext *ctx, int pos) {
+    p->ctx = ctx;
+    p->tokens = ctx->tokens;
+    p->kinds = ctx->token_kinds;
+    p->match = ctx->bracket_match;
+    p->length = ctx->token_count;
+    p->pos = pos;
+    p->depth = 0;
+    p->commands = NULL;
+}
+
+// Monta a árvore do arquivo inteiro em ctx->ast
+static void parse_program(AnalysisContext *ctx) {
+    reset_arena(&ctx->ast_arena);
+    if (ctx->command_capacity < ctx->token_count) {
+        AstNode **nodes = realloc(ctx->command_nodes, ctx->token_count * sizeof(AstNode*));
+        if (nodes == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->command_nodes = nodes;
+        ctx->command_capacity = ctx->token_count;
+    }
+    if (ctx->token_count > 0) {
+        memset(ctx->command_nodes, 0, ctx->token_count * sizeof(AstNode*));
+    }
+    
+    Parser parser;
+    parser_init(&parser, ctx, 0);
+    parser.commands = ctx->command_nodes;
+    ctx->ast = ast_node(&parser, AST_PROGRAM, 0);
+    for (;;) {
+        parser_skip_newlines(&parser);
+        if (parser.pos >= parser.length) break;
+        ast_add_child(ctx->ast, parse_statement(&parser));
+    }
+    ctx->ast->end = ctx->token_count - 1;
+}
+
+// Nó do comando cuja palavra-chave está em `index`. O que a passada
+// principal engoliu (dentro de um grupo sem fechamento, por exemplo) é
+// montado agora, a partir dele, na arena do contexto (num contexto de corpo,
+// na arena do próprio contexto).
+static AstNode* command_node(AnalysisContext *ctx, int index) {
+    if (ctx->command_nodes[index] != NULL) {
+        return ctx->command_nodes[index];
+    }
+    Parser parser;
+    parser_init(&parser, ctx, index);
+    return parse_command(&parser);
+}
+
+// Fechamento da abertura em `index`, tratando como não fechado o que passa de `limit`
+static int bracket_end_before(AnalysisContext *ctx, int index, int limit) {
+    int match = ctx->bracket_match[index];
+    return match > index && match < limit ? match : -1;
+}
+
+// Espaço para mais um elemento num vetor que dobra quando enche
+static void* reserve_one(AnalysisContext *ctx, void *data, int count, int *capacity, size_t size) {
+    if (count < *capacity) return data;
+    int grown_capacity = *capacity > 0 ? *capacity * 2 : 64;
+    void *grown = realloc(data, grown_capacity * size);
+    if (grown == NULL) {
+        analysis_out_of_memory(ctx);
+    }
+    *capacity = grown_capacity;
+    return grown;
+}
+
+static int type_node(AnalysisContext *ctx, DataType type) {
+    TypeGraph *graph = &ctx->types;
+    graph->nodes = reserve_one(ctx, graph->nodes, graph->node_count, &graph->node_capacity, sizeof(TypeNode));
+    TypeNode *node = &graph->nodes[graph->node_count];
+    node->type = type;
+    node->fixed = type != TYPE_UNKNOWN;
+    node->first_edge = -1;
+    return graph->node_count++;
+}
+
+static void type_half_edge(AnalysisContext *ctx, int from, int to, int operand, int context, int token) {
+    TypeGraph *graph = &ctx->types;
+    graph->edges = reserve_one(ctx, graph->edges, graph->edge_count, &graph->edge_capacity, sizeof(TypeEdge));
+    TypeEdge *edge = &graph->edges[graph->edge_count];
+    edge->to = to;
+    edge->operand = operand;
+    edge->context = context;
+    edge->token = token;
+    edge->next = graph->nodes[from].first_edge;
+    graph->nodes[from].first_edge = graph->edge_count++;
+}
+
+// O operando em `token` é usado onde se espera o tipo do nó `context`
+static void type_link(AnalysisContext *ctx, int operand, int context, int token) {
+    if (operand == -1 || context == -1 || operand == context) return;
+    type_half_edge(ctx, operand, context, operand, context, token);
+    type_half_edge(ctx, context, operand, operand, context, token);
+}
+
+// Posição do nome na tabela: a que já o tem ou a vazia onde ele entraria.
+// Os nomes saem na ordem inversa da entrada, então voltar uma posição para
+// -1 nunca quebra a sequência de sondagem de um nome que continua na tabela.
+static int name_slot(NameLinks *links, const char *name, int length) {
+    int mask = links->slot_capacity - 1;
+    int s = (int)(content_hash(name, length) & mask);
+    while (links->slots[s] != -1) {
+        NameBinding *binding = &links->bindings[links->slots[s]];
+        if (binding->length == length && memcmp(binding->name, name, length) == 0) break;
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+// Variáveis com a vírgula colada ("!a,") valem pelo nome sem ela
+static int variable_name_length(const char *token) {
+    return (int)strcspn(token, ",");
+}
+
+// Declara o nome em `token` até o fim do escopo atual. Como na tabela de
+// símbolos, um nome que o escopo atual já declarou continua com a primeira
+// declaração.
+static void name_bind(AnalysisContext *ctx, int token) {
+    NameLinks *links = &ctx->links;
+    if (links->slot_capacity > 0) {
+        const char *name = ctx->tokens[token];
+        int existing = links->slots[name_slot(links, name, variable_name_length(name))];
+        if (existing >= links->scope_start) return;
+    }
+    if ((links->binding_count + 1) * 2 > links->slot_capacity) {
+        int capacity = links->slot_capacity > 0 ? links->slot_capacity * 2 : 64;
+        int *slots = realloc(links->slots, capacity * sizeof(int));
+        if (slots == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        links->slots = slots;
+        links->slot_capacity = capacity;
+        memset(slots, -1, capacity * sizeof(int));
+        for (int b = 0; b < links->binding_count; b++) {
+            NameBinding *binding = &links->bindings[b];
+            binding->slot = name_slot(links, binding->name, binding->length);
+            slots[binding->slot] = b;
+        }
+    }
+    links->bindings = reserve_one(ctx, links->bindings, links->binding_count, &links->binding_capacity, sizeof(NameBinding));
+    NameBinding *binding = &links->bindings[links->binding_count];
+    binding->name = ctx->tokens[token];
+    binding->length = variable_name_length(binding->name);
+    binding->token = token;
+    binding->slot = name_slot(links, binding->name, binding->length);
+    binding->shadowed = links->slots[binding->slot];
+    links->slots[binding->slot] = links->binding_count++;
+    links->declaration[token] = token;
+    links->first_use[token] = -1;
+    links->next_use[token] = -1;
+}
+
+// Fecha os escopos abertos depois de `mark`
+static void name_unbind(NameLinks *links, int mark) {
+    while (links->binding_count > mark) {
+        NameBinding *binding = &links->bindings[--links->binding_count];
+        links->slots[binding->slot] = binding->shadowed;
+    }
+}
+
+// Liga o uso em `token` à declaração em `declaration`, no fim da lista dela
+static void name_link(NameLinks *links, int token, int declaration) {
+    links->declaration[token] = declaration;
+    links->next_use[token] = -1;
+    if (links->first_use[declaration] == -1) {
+        links->first_use[declaration] = token;
+    } else {
+        links->next_use[links->next_use[declaration]] = token;
+    }
+    links->next_use[declaration] = token;
+}
+
+// Liga a variável em `token` à declaração mais interna do nome, se houver
+static void name_use(AnalysisContext *ctx, int token) {
+    NameLinks *links = &ctx->links;
+    if (links->slot_capacity == 0) return;
+    const char *name = ctx->tokens[token];
+    int s = name_slot(links, name, variable_name_length(name));
+    if (links->slots[s] != -1) {
+        name_link(links, token, links->bindings[links->slots[s]].token);
+    }
+}
+
+static void resolve_expression(AnalysisContext *ctx, AstNode *node) {
+    switch (node->kind) {
+        case AST_VARIABLE:
+            name_use(ctx, node->token);
+            break;
+        case AST_CALL:
+            ctx->links.calls = reserve_one(ctx, ctx->links.calls, ctx->links.call_count,
+                                           &ctx->links.call_capacity, sizeof(int));
+            ctx->links.calls[ctx->links.call_count++] = node->token;
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                resolve_expression(ctx, child);
+            }
+            break;
+        default:
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                resolve_expression(ctx, child);
+            }
+            break;
+    }
+}
+
+// Comandos: abre e fecha os escopos na mesma ordem da passada principal
+static void resolve_statement(AnalysisContext *ctx, AstNode *node) {
+    NameLinks *links = &ctx->links;
+    int mark = links->binding_count;
+    int outer_scope = links->scope_start;
+    bool opens_scope = node->kind == AST_BLOCK || node->kind == AST_FUNCTION || node->kind == AST_PRINCIPAL;
+    if (opens_scope) links->scope_start = mark;
+    switch (node->kind) {
+        case AST_FUNCTION:
+        case AST_PRINCIPAL: {
+            AstNode *body = NULL;
+            int function = -1;
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind == AST_NAME) {
+                    function = child->token;
+                } else if (child->kind == AST_BLOCK) {
+                    body = child;
+                } else if (child->kind == AST_GROUP) {
+                    for (AstNode *parameter = child->child; parameter != NULL; parameter = parameter->next) {
+                        if (parameter->kind != AST_PARAMETER) continue;
+                        // "tipo !nome" ou só "!nome"
+                        int name = parameter->end != parameter->token ? parameter->end : parameter->token;
+                        if (ctx->token_kinds[name] != KIND_VARIABLE) continue;
+                        name_bind(ctx, name);
                     }
-                    printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                    break;
-                } else if (is_keyword(tokens[i])) {
-                    printf("tokens[%d] = \"%s\" -> KEYWORD\n", i, tokens[i]);
-                } else if (strncmp(tokens[i], "__", 2) == 0) {
-                    // Possível chamada de função
-                    if (i + 1 < length && strcmp(tokens[i + 1], "(") == 0) {
-                        // Encontra o fechamento dos parênteses com balanceamento adequado
-                        int param_start = i + 2;
-                        int param_end = -1;
-                        int paren_level = 1;
-                        int j = param_start;
-                        
-                        while (j < length && paren_level > 0) {
-                            if (strcmp(tokens[j], "(") == 0) {
-                                paren_level++;
-                            } else if (strcmp(tokens[j], ")") == 0) {
-                                paren_level--;
-                                if (paren_level == 0) {
-                                    param_end = j - 1;
-                                    break;
-                                }
-                            }
-                            j++;
-                        }
-                        
-                        if (param_end == -1) {
-                            printf("SYNTAX ERROR (linha %d): Chamada de função '%s' sem fechamento de parênteses\n", current_line, tokens[i]);
-                            printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                            break;
-                        }
-                        
-                        // Valida duplo balanceamento nos parâmetros
-                        if (param_start <= param_end) {
-                            if (!validate_double_balancing(tokens, param_start, param_end, true)) {
-                                printf("SYNTAX ERROR (linha %d): Balanceamento incorreto nos parâmetros da função '%s'\n", current_line, tokens[i]);
-                                printf("ERRO ENCONTRADO: Finalizando a análise.\n");
-                                break;
-                            }
-                        }
-                        
-                        // Conta parâmetros na chamada
-                        int param_count = 0;
-                        bool has_content = false;
-                        
-                        for (int k = param_start; k <= param_end; k++) {
-                            if (tokens[k] == NULL || strcmp(tokens[k], "\n") == 0) continue;
-                            
-                            if (strcmp(tokens[k], ",") == 0) {
-                                if (has_content) {
-                                    param_count++;
-                                    has_content = false;
-                                }
-                            } else {
-                                has_content = true;
-                            }
-                        }
-                        
-                        // Se há conteúdo após a última vírgula (ou se não há vírgulas mas há conteúdo)
-                        if (has_content) param_count++;
-                        
-                        // Verifica se a função existe
-                        Symbol *func = lookup_symbol(tokens[i]);
-                        if (func == NULL) {
-                            // 1.10. Adiciona à lista de chamadas pendentes para validação posterior
-                            add_pending_function_call(tokens[i], param_count, current_line);
-                            printf("tokens[%d] = \"%s\" -> FUNCTION_CALL_PENDING (%d parâmetros)\n", i, tokens[i], param_count);
-                        } else {
-                            // Função já existe, valida imediatamente
-                            if (validate_function_call(tokens[i], param_count, current_line)) {
-                                printf("tokens[%d] = \"%s\" -> FUNCTION_CALL (%d parâmetros)\n", i, tokens[i], param_count);
-                            } else {
-                                printf("tokens[%d] = \"%s\" -> SEMANTIC ERROR (Chamada de função inválida)\n", i, tokens[i]);
-                            }
-                        }
-                    } else {
-                        printf("tokens[%d] = \"%s\" -> IDENTIFIER/OTHER\n", i, tokens[i]);
+                }
+            }
+            if (node->kind == AST_FUNCTION && function != -1) {
+                links->functions = reserve_one(ctx, links->functions, links->function_count,
+                                               &links->function_capacity, sizeof(NameFunction));
+                links->functions[links->function_count].name = ctx->tokens[function];
+                links->functions[links->function_count++].token = function;
+                links->declaration[function] = function;
+                links->first_use[function] = -1;
+                links->next_use[function] = -1;
+            }
+            if (body != NULL) {
+                resolve_statement(ctx, body);
+            }
+            break;
+        }
+        case AST_DECLARATION:
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind == AST_VARIABLE) {
+                    name_bind(ctx, child->token);
+                } else if (child->kind == AST_ASSIGNMENT && child->child->kind == AST_VARIABLE) {
+                    // O valor inicial é visto antes da variável existir
+                    if (child->child->next != NULL) {
+                        resolve_expression(ctx, child->child->next);
                     }
+                    name_bind(ctx, child->child->token);
                 } else {
-                    printf("tokens[%d] = \"%s\" -> IDENTIFIER/OTHER\n", i, tokens[i]);
+                    resolve_expression(ctx, child);
+                }
+            }
+            // Declarações valem até o fim do escopo de fora
+            return;
+        default:
+            // Filhos até AST_EXPRESSION são comandos; os demais, expressões
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind <= AST_EXPRESSION) {
+                    resolve_statement(ctx, child);
+                } else {
+                    resolve_expression(ctx, child);
                 }
-                i++;
             }
+            break;
+    }
+    if (opens_scope) {
+        name_unbind(links, mark);
+        links->scope_start = outer_scope;
+    }
+}
+
+static int compare_name_functions(const void *a, const void *b) {
+    const NameFunction *x = a;
+    const NameFunction *y = b;
+    int order = strcmp(x->name, y->name);
+    if (order != 0) return order;
+    return x->token - y->token;
+}
+
+// Token do nome na primeira definição da função, ou -1
+static int find_name_function(NameLinks *links, const char *name) {
+    int low = 0;
+    int high = links->function_count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (strcmp(links->functions[middle].name, name) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < links->function_count && strcmp(links->functions[low].name, name) == 0) {
+        return links->functions[low].token;
+    }
+    return -1;
+}
+
+// Passada de resolução de nomes sobre a árvore: liga cada variável à sua
+// declaração e cada chamada à primeira definição da função, uma vez só por
+// arquivo. Os avisos de símbolo não usado, a tabela de símbolos e a
+// inferência de tipos leem essas ligações em vez de procurar os nomes de novo.
+static void resolve_names(AnalysisContext *ctx) {
+    NameLinks *links = &ctx->links;
+    int length = ctx->token_count;
+    if (links->capacity < length) {
+        int *declaration = realloc(links->declaration, length * sizeof(int));
+        if (declaration == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        links->declaration = declaration;
+        int *first_use = realloc(links->first_use, length * sizeof(int));
+        if (first_use == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        links->first_use = first_use;
+        int *next_use = realloc(links->next_use, length * sizeof(int));
+        if (next_use == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        links->next_use = next_use;
+        links->capacity = length;
+    }
+    if (length > 0) {
+        memset(links->declaration, -1, length * sizeof(int));
+    }
+    name_unbind(links, 0);
+    links->scope_start = 0;
+    links->function_count = 0;
+    links->call_count = 0;
+    if (ctx->ast == NULL) return;
+    
+    resolve_statement(ctx, ctx->ast);
+    
+    if (links->function_count > 1) {
+        qsort(links->functions, links->function_count, sizeof(NameFunction), compare_name_functions);
+    }
+    for (int c = 0; c < links->call_count; c++) {
+        int call = links->calls[c];
+        int function = find_name_function(links, ctx->tokens[call]);
+        if (function != -1) {
+            name_link(links, call, function);
+        }
+    }
+}
+
+// Algum uso do símbolo foi ligado à sua declaração. Num contexto de corpo, as
+// ligações são as do arquivo.
+static bool symbol_used(AnalysisContext *ctx, Symbol *symbol) {
+    NameLinks *links = ctx->owner != NULL ? &ctx->owner->links : &ctx->links;
+    int token = symbol->name_token;
+    return token >= 0 && token < links->capacity && links->declaration[token] == token &&
+           links->first_use[token] != -1;
+}
 
-            check_brackets_and_quotes(tokens, length);
+static void type_bind(AnalysisContext *ctx, int token, int node) {
+    ctx->types.declared[token] = node;
+}
+
+// Nó da declaração a que o nome em `token` está ligado, ou -1
+static int type_lookup(AnalysisContext *ctx, int token) {
+    int declaration = ctx->links.declaration[token];
+    return declaration != -1 ? ctx->types.declared[declaration] : -1;
+}
+
+static bool is_comparison(TokenKind kind) {
+    return kind == KIND_EQUALS || kind == KIND_NOT_EQUALS || kind == KIND_LESS ||
+           kind == KIND_LESS_EQUAL || kind == KIND_GREATER || kind == KIND_GREATER_EQUAL;
+}
 
-            if (!check_return_statement(tokens, length)) {
-                printf("Verificação de 'retorno' falhou. Erro encontrado.\n");
+// Liga cada operando da expressão ao nó `context` (-1 quando o valor não vai
+// para lugar nenhum), e registra as restrições das partes internas:
+// comparações, atribuições e argumentos de chamadas
+static void type_expression(AnalysisContext *ctx, AstNode *node, int context) {
+    TypeGraph *graph = &ctx->types;
+    switch (node->kind) {
+        case AST_VARIABLE:
+            type_link(ctx, type_lookup(ctx, node->token), context, node->token);
+            break;
+        case AST_NUMBER: {
+            DataType type = strchr(ctx->tokens[node->token], '.') != NULL ? TYPE_FLOAT : TYPE_INTEGER;
+            type_link(ctx, graph->constants[type], context, node->token);
+            break;
+        }
+        case AST_STRING:
+            type_link(ctx, graph->constants[TYPE_STRING], context, node->token);
+            break;
+        case AST_GROUP:
+        case AST_SEGMENT:
+        case AST_UNARY:
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                type_expression(ctx, child, context);
+            }
+            break;
+        case AST_POSTFIX:
+            // '++' e '--' só valem para números
+            type_expression(ctx, node->child, graph->constants[TYPE_INTEGER]);
+            type_expression(ctx, node->child, context);
+            break;
+        case AST_BINARY: {
+            TokenKind op = ctx->token_kinds[node->token];
+            if (is_comparison(op)) {
+                // Os dois lados de uma comparação têm o mesmo tipo
+                int compared = type_node(ctx, TYPE_UNKNOWN);
+                for (AstNode *child = node->child; child != NULL; child = child->next) {
+                    type_expression(ctx, child, compared);
+                }
+                type_link(ctx, graph->constants[TYPE_INTEGER], context, node->token);
+            } else if (op == KIND_AND || op == KIND_OR) {
+                for (AstNode *child = node->child; child != NULL; child = child->next) {
+                    type_expression(ctx, child, -1);
+                }
+                type_link(ctx, graph->constants[TYPE_INTEGER], context, node->token);
             } else {
-                printf("Verificação de 'retorno' concluída com sucesso.\n");
+                for (AstNode *child = node->child; child != NULL; child = child->next) {
+                    type_expression(ctx, child, context);
+                }
+            }
+            break;
+        }
+        case AST_ASSIGNMENT: {
+            AstNode *target = node->child;
+            int assigned = target->kind == AST_VARIABLE ? type_lookup(ctx, target->token) : -1;
+            if (target->next != NULL) {
+                type_expression(ctx, target->next, assigned);
+            }
+            type_link(ctx, assigned, context, target->token);
+            break;
+        }
+        case AST_CALL: {
+            int argument = 0;
+            AstNode *arguments = node->child;
+            for (AstNode *child = arguments != NULL ? arguments->child : NULL; child != NULL; child = child->next) {
+                int value = type_node(ctx, TYPE_UNKNOWN);
+                type_expression(ctx, child, value);
+                graph->calls = reserve_one(ctx, graph->calls, graph->call_count, &graph->call_capacity, sizeof(TypeCall));
+                TypeCall *call = &graph->calls[graph->call_count++];
+                call->function = node->token;
+                call->argument = argument++;
+                call->node = value;
+                call->token = child->token;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Comandos. Os nomes já vêm ligados por resolve_names(); aqui cada
+// declaração só ganha o seu nó.
+static void type_statement(AnalysisContext *ctx, AstNode *node) {
+    TypeGraph *graph = &ctx->types;
+    switch (node->kind) {
+        case AST_FUNCTION:
+        case AST_PRINCIPAL: {
+            TypeFunction function = {graph->node_count, 0};
+            int name = -1;
+            AstNode *body = NULL;
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind == AST_NAME) {
+                    name = child->token;
+                } else if (child->kind == AST_BLOCK) {
+                    body = child;
+                } else if (child->kind == AST_GROUP) {
+                    for (AstNode *parameter = child->child; parameter != NULL; parameter = parameter->next) {
+                        if (parameter->kind != AST_PARAMETER) continue;
+                        // "tipo !nome" fixa o tipo; só "!nome" deixa para a inferência
+                        bool typed = parameter->end != parameter->token;
+                        int name = typed ? parameter->end : parameter->token;
+                        if (ctx->token_kinds[name] != KIND_VARIABLE) continue;
+                        DataType type = typed ? string_to_data_type(ctx->tokens[parameter->token]) : TYPE_UNKNOWN;
+                        type_bind(ctx, name, type_node(ctx, type));
+                        function.param_count++;
+                    }
+                }
+            }
+            if (node->kind == AST_FUNCTION && name != -1) {
+                graph->functions = reserve_one(ctx, graph->functions, graph->function_count,
+                                               &graph->function_capacity, sizeof(TypeFunction));
+                graph->declared[name] = graph->function_count;
+                graph->functions[graph->function_count++] = function;
+            }
+            if (body != NULL) {
+                type_statement(ctx, body);
+            }
+            break;
+        }
+        case AST_DECLARATION: {
+            DataType type = string_to_data_type(ctx->tokens[node->token]);
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind == AST_VARIABLE) {
+                    type_bind(ctx, child->token, type_node(ctx, type));
+                } else if (child->kind == AST_ASSIGNMENT && child->child->kind == AST_VARIABLE) {
+                    // O valor inicial é visto antes da variável existir
+                    int declared = type_node(ctx, type);
+                    if (child->child->next != NULL) {
+                        type_expression(ctx, child->child->next, declared);
+                    }
+                    type_bind(ctx, child->child->token, declared);
+                } else {
+                    type_expression(ctx, child, -1);
+                }
+            }
+            // Declarações valem até o fim do escopo de fora
+            return;
+        }
+        default:
+            // Filhos até AST_EXPRESSION são comandos; os demais, expressões
+            for (AstNode *child = node->child; child != NULL; child = child->next) {
+                if (child->kind <= AST_EXPRESSION) {
+                    type_statement(ctx, child);
+                } else {
+                    type_expression(ctx, child, -1);
+                }
             }
+            break;
+    }
+}
 
-            // 1.10. Valida chamadas de função pendentes
-            if (!validate_pending_function_calls(tokens, length)) {
-                printf("Erro na validação de chamadas de função pendentes.\n");
-            } else {
-                printf("Validação de chamadas pendentes concluída com sucesso.\n");
+static bool is_numeric_type(DataType type) {
+    return type == TYPE_INTEGER || type == TYPE_FLOAT;
+}
+
+// Propaga os tipos conhecidos pela lista de trabalho. Um nó só volta à lista
+// quando o tipo muda, e o tipo muda no máximo duas vezes (desconhecido,
+// inteiro, decimal), então o custo é linear no tamanho do grafo. A lista é
+// uma fila: o tipo de um nó vem da declaração mais próxima dele.
+static void solve_types(AnalysisContext *ctx) {
+    TypeGraph *graph = &ctx->types;
+    int head = 0;
+    int tail = 0;
+    for (int n = 0; n < graph->node_count; n++) {
+        if (graph->nodes[n].type == TYPE_UNKNOWN) continue;
+        graph->worklist = reserve_one(ctx, graph->worklist, tail, &graph->worklist_capacity, sizeof(int));
+        graph->worklist[tail++] = n;
+    }
+    while (head < tail) {
+        TypeNode *from = &graph->nodes[graph->worklist[head++]];
+        for (int e = from->first_edge; e != -1; e = graph->edges[e].next) {
+            TypeNode *to = &graph->nodes[graph->edges[e].to];
+            if (to->fixed) continue;
+            DataType type = to->type;
+            if (type == TYPE_UNKNOWN) {
+                type = from->type;
+            } else if (type == TYPE_INTEGER && from->type == TYPE_FLOAT) {
+                type = TYPE_FLOAT;
             }
+            // Texto e número no mesmo nó: fica o primeiro, e a ligação é relatada
+            if (type == to->type) continue;
+            to->type = type;
+            graph->worklist = reserve_one(ctx, graph->worklist, tail, &graph->worklist_capacity, sizeof(int));
+            graph->worklist[tail++] = graph->edges[e].to;
+        }
+    }
+}
+
+// Infere o tipo dos parâmetros sem tipo declarado e relata texto usado onde se
+// espera número (ou o contrário) em atribuições, testes e chamadas
+static void infer_types(AnalysisContext *ctx) {
+    TypeGraph *graph = &ctx->types;
+    if (graph->declared_capacity < ctx->token_count) {
+        int *declared = realloc(graph->declared, ctx->token_count * sizeof(int));
+        if (declared == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        graph->declared = declared;
+        graph->declared_capacity = ctx->token_count;
+    }
+    graph->node_count = 0;
+    graph->edge_count = 0;
+    graph->function_count = 0;
+    graph->call_count = 0;
+    for (int type = 0; type < TYPE_UNKNOWN; type++) {
+        graph->constants[type] = type_node(ctx, type);
+    }
+    if (ctx->ast == NULL) return;
+    
+    type_statement(ctx, ctx->ast);
+    
+    // Argumentos são ligados aos parâmetros da definição a que a chamada se liga
+    for (int c = 0; c < graph->call_count; c++) {
+        TypeCall *call = &graph->calls[c];
+        int declaration = ctx->links.declaration[call->function];
+        if (declaration == -1) continue;
+        TypeFunction *function = &graph->functions[graph->declared[declaration]];
+        if (call->argument < function->param_count) {
+            type_link(ctx, call->node, function->first_param + call->argument, call->token);
+        }
+    }
+    
+    solve_types(ctx);
+    
+    // Cada ligação aparece como duas meias-arestas seguidas; basta a primeira
+    for (int e = 0; e < graph->edge_count; e += 2) {
+        TypeEdge *edge = &graph->edges[e];
+        DataType operand = graph->nodes[edge->operand].type;
+        DataType context = graph->nodes[edge->context].type;
+        if (operand == TYPE_UNKNOWN || context == TYPE_UNKNOWN || operand == context) continue;
+        if (is_numeric_type(operand) && is_numeric_type(context)) continue;
+        const char *text = ctx->tokens[edge->token];
+        TokenKind kind = ctx->token_kinds[edge->token];
+        char operand_text[128];
+        if (kind == KIND_QUOTED) {
+            snprintf(operand_text, sizeof(operand_text), "O texto entre aspas");
+        } else if (is_comparison(kind) || kind == KIND_AND || kind == KIND_OR) {
+            snprintf(operand_text, sizeof(operand_text), "O resultado de '%s'", text);
+        } else {
+            snprintf(operand_text, sizeof(operand_text), "'%.*s'", variable_name_length(text), text);
+        }
+        report_diagnostic(ctx, DIAG_TYPE_MISMATCH, edge->token, NULL,
+                          "SEMANTIC ERROR (linha %d): %s é %s, mas é usado como %s\n",
+                          ctx->spans[edge->token].line, operand_text,
+                          data_type_keyword(operand), data_type_keyword(context));
+    }
+    
+    // Os tipos inferidos vão para a tabela de símbolos, percorrida pela
+    // trilha. Sem nenhum uso que indique o tipo, o parâmetro continua inteiro.
+    for (int i = 0; i < ctx->symbol_table.trail_top; i++) {
+        Symbol *current = ctx->symbol_table.trail[i];
+        if (current->symbol_type == SYMBOL_PARAMETER && current->data_type == TYPE_UNKNOWN) {
+            current->data_type = TYPE_INTEGER;
+        }
+        if (current->symbol_type != SYMBOL_FUNCTION) continue;
+        int declaration = find_name_function(&ctx->links, current->name);
+        if (declaration == -1) continue;
+        TypeFunction *function = &graph->functions[graph->declared[declaration]];
+        for (int k = 0; k < current->param_count && k < function->param_count; k++) {
+            DataType type = graph->nodes[function->first_param + k].type;
+            current->param_types[k] = type != TYPE_UNKNOWN ? type : TYPE_INTEGER;
+        }
+    }
+}
+
+// Hash do conteúdo (XXH64, semente 0), chave do cache de tokens
+#define XXH_PRIME64_1 11400714785074694791ULL
+#define XXH_PRIME64_2 14029467366897019727ULL
+#define XXH_PRIME64_3 1609587929392839161ULL
+#define XXH_PRIME64_4 9650029242287828579ULL
+#define XXH_PRIME64_5 2870177450012600261ULL
+
+static uint64_t xxh_rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t xxh_read64(const char *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
 
-            // Infere tipos de parâmetros antes de imprimir a tabela
-            infer_parameter_types();
+static uint32_t xxh_read32(const char *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
 
-            // Imprime a tabela de símbolos
-            print_symbol_table();
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
 
-            // Limpa chamadas pendentes
-            clear_pending_function_calls();
+static uint64_t xxh_merge_round(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
 
-            for (int j = 0; j < length; j++) {
-                free(tokens[j]);
-            }
-            free(tokens);
+static uint64_t content_hash(const char *data, size_t length) {
+    const char *p = data;
+    const char *end = data + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = XXH_PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -XXH_PRIME64_1;
+        while (p + 32 <= end) {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
         }
-        printf("\nMemória ocupada: %zu Bytes ou %.2f KB\n", memory, memory / 1024.0);
-        free(content);
+        hash = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        hash = xxh_merge_round(hash, v1);
+        hash = xxh_merge_round(hash, v2);
+        hash = xxh_merge_round(hash, v3);
+        hash = xxh_merge_round(hash, v4);
+    } else {
+        hash = XXH_PRIME64_5;
     }
+    hash += length;
 
-    closedir(dir);
-    return 0;
-}
\ No newline at end of file
+    while (p + 8 <= end) {
+        hash ^= xxh_round(0, xxh_read64(p));
+        hash = xxh_rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        hash ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        hash = xxh_rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= (unsigned char)*p * XXH_PRIME64_5;
+        hash = xxh_rotl64(hash, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static void token_cache_path(AnalysisContext *ctx, uint64_t hash, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.tok", ctx->cache_dir, (unsigned long long)hash);
+}
+
+// Procura os tokens de um conteúdo no cache. Em caso de acerto o arquivo do
+// cache fica mapeado até token_cache_release() e os tokens apontam para ele;
+// qualquer arquivo inválido ou de outra versão é tratado como ausente.
+static char** token_cache_load(AnalysisContext *ctx, uint64_t hash, size_t content_length, int *length) {
+    char path[4096];
+    token_cache_path(ctx, hash, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TokenCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t map_size = st.st_size;
+    char *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const TokenCacheHeader *header = (const TokenCacheHeader *)map;
+    size_t count = header->token_count;
+    size_t spans_size = count * sizeof(TokenSpan);
+    size_t offsets_size = count * sizeof(uint32_t);
+    bool valid = memcmp(header->magic, TOKEN_CACHE_MAGIC, 4) == 0 &&
+                 header->version == TOKEN_CACHE_VERSION &&
+                 header->byte_order == TOKEN_CACHE_BYTE_ORDER &&
+                 header->content_hash == hash &&
+                 header->content_length == content_length &&
+                 count > 0 && count <= (size_t)INT32_MAX / sizeof(TokenSpan) &&
+                 header->text_size > 0 &&
+                 sizeof(TokenCacheHeader) + spans_size + offsets_size + header->text_size == map_size &&
+                 ctx->memory + header->lexer_memory <= MAX_MEMORY;
+    const char *text = map + sizeof(TokenCacheHeader) + spans_size + offsets_size;
+    if (valid && text[header->text_size - 1] != '\0') valid = false;
+    if (!valid) {
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    const uint32_t *offsets = (const uint32_t *)(map + sizeof(TokenCacheHeader) + spans_size);
+    char **tokens = malloc(count * sizeof(char*));
+    if (tokens == NULL) {
+        munmap(map, map_size);
+        return NULL;
+    }
+    reserve_token_kinds(ctx, count);
+    for (size_t t = 0; t < count; t++) {
+        if (offsets[t] >= header->text_size) {
+            free(tokens);
+            munmap(map, map_size);
+            return NULL;
+        }
+        tokens[t] = (char *)text + offsets[t];
+        ctx->token_kinds[t] = token_kind(tokens[t], strlen(tokens[t]));
+    }
+    ctx->token_kinds[count] = KIND_END;
+
+    if (ctx->span_capacity < (int)count) {
+        TokenSpan *spans = realloc(ctx->spans, spans_size);
+        if (spans == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->spans = spans;
+        ctx->span_capacity = count;
+    }
+    memcpy(ctx->spans, map + sizeof(TokenCacheHeader), spans_size);
+
+    // O relatório mostra a mesma memória de uma análise sem cache
+    ctx->memory += header->lexer_memory;
+    ctx->cache_map = map;
+    ctx->cache_map_size = map_size;
+    *length = count;
+    return tokens;
+}
+
+// Grava os tokens recém-lidos no cache. O arquivo é escrito com outro nome e
+// renomeado no fim, então outro processo nunca vê um arquivo pela metade.
+// Falhas são ignoradas: sem cache a análise só fica mais lenta.
+static void token_cache_store(AnalysisContext *ctx, uint64_t hash, size_t content_length,
+                              char **tokens, int length, size_t lexer_memory) {
+    char path[4096];
+    char temp_path[4096];
+    token_cache_path(ctx, hash, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s/.tok-XXXXXX", ctx->cache_dir);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0) return;
+    FILE *file = fdopen(fd, "wb");
+    if (file == NULL) {
+        close(fd);
+        unlink(temp_path);
+        return;
+    }
+
+    TokenCacheHeader header = {0};
+    memcpy(header.magic, TOKEN_CACHE_MAGIC, 4);
+    header.version = TOKEN_CACHE_VERSION;
+    header.byte_order = TOKEN_CACHE_BYTE_ORDER;
+    header.token_count = length;
+    header.content_hash = hash;
+    header.content_length = content_length;
+    header.lexer_memory = lexer_memory;
+    for (int t = 0; t < length; t++) {
+        header.text_size += strlen(tokens[t]) + 1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(ctx->spans, sizeof(TokenSpan), length, file) == (size_t)length;
+    uint32_t offset = 0;
+    for (int t = 0; ok && t < length; t++) {
+        ok = fwrite(&offset, sizeof(offset), 1, file) == 1;
+        offset += strlen(tokens[t]) + 1;
+    }
+    for (int t = 0; ok && t < length; t++) {
+        ok = fwrite(tokens[t], strlen(tokens[t]) + 1, 1, file) == 1;
+    }
+    if (fclose(file) != 0) ok = false;
+
+    if (!ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+    }
+}
+
+// Desfaz o mapeamento do cache usado pelo arquivo atual
+static void token_cache_release(AnalysisContext *ctx) {
+    if (ctx->cache_map == NULL) return;
+    munmap(ctx->cache_map, ctx->cache_map_size);
+    ctx->cache_map = NULL;
+    ctx->cache_map_size = 0;
+}
+
+// Resultado de uma análise no cache. O corpo é o relatório do arquivo já
+// renderizado, sem as partes que citam o caminho (início e fim do arquivo),
+// então serve para qualquer arquivo com o mesmo conteúdo.
+static void result_cache_path(AnalysisContext *ctx, uint64_t hash, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx-r%d-%d%d-e%d-d%d.res", ctx->cache_dir, (unsigned long long)hash,
+             RESULT_CACHE_VERSION, (int)ctx->verbosity, (int)ctx->format, ctx->max_errors, ctx->max_diagnostics);
+}
+
+// Copia para o relatório o resultado guardado de um conteúdo, se existir
+static bool result_cache_load(AnalysisContext *ctx, uint64_t hash, size_t content_length, int *token_count) {
+    char path[4096];
+    result_cache_path(ctx, hash, path, sizeof(path));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    ResultCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, RESULT_CACHE_MAGIC, 4) == 0 &&
+                 header.version == RESULT_CACHE_VERSION &&
+                 header.byte_order == TOKEN_CACHE_BYTE_ORDER &&
+                 header.verbosity == (uint32_t)ctx->verbosity &&
+                 header.format == (uint32_t)ctx->format &&
+                 header.content_hash == hash &&
+                 header.content_length == content_length;
+    if (valid) {
+        size_t start = ctx->out.length;
+        report_reserve(&ctx->out, header.body_size);
+        valid = fread(ctx->out.data + start, 1, header.body_size, file) == header.body_size &&
+                fgetc(file) == EOF;
+        if (valid) {
+            ctx->out.length += header.body_size;
+        }
+    }
+    fclose(file);
+    if (!valid) return false;
+
+    ctx->error_count = header.error_count;
+    ctx->warning_count = header.warning_count;
+    *token_count = header.token_count;
+    return true;
+}
+
+// Guarda o corpo do relatório (a partir de body_start) e as contagens
+static void result_cache_store(AnalysisContext *ctx, uint64_t hash, size_t content_length,
+                               size_t body_start, int token_count) {
+    char path[4096];
+    char temp_path[4096];
+    result_cache_path(ctx, hash, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s/.res-XXXXXX", ctx->cache_dir);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0) return;
+    FILE *file = fdopen(fd, "wb");
+    if (file == NULL) {
+        close(fd);
+        unlink(temp_path);
+        return;
+    }
+
+    ResultCacheHeader header = {0};
+    memcpy(header.magic, RESULT_CACHE_MAGIC, 4);
+    header.version = RESULT_CACHE_VERSION;
+    header.byte_order = TOKEN_CACHE_BYTE_ORDER;
+    header.verbosity = ctx->verbosity;
+    header.format = ctx->format;
+    header.token_count = token_count;
+    header.error_count = ctx->error_count;
+    header.warning_count = ctx->warning_count;
+    header.content_hash = hash;
+    header.content_length = content_length;
+    header.body_size = ctx->out.length - body_start;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(ctx->out.data + body_start, 1, header.body_size, file) == header.body_size;
+    if (fclose(file) != 0) ok = false;
+
+    if (!ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+    }
+}
+
+// Libera os tokens do arquivo atual. Tokens vindos do cache apontam para o
+// arquivo mapeado e só o vetor é liberado.
+static void release_tokens(AnalysisContext *ctx) {
+    if (ctx->tokens != NULL && ctx->cache_map == NULL) {
+        for (int j = 0; j < ctx->token_count; j++) {
+            free(ctx->tokens[j]);
+        }
+    }
+    free(ctx->tokens);
+    ctx->tokens = NULL;
+    ctx->token_count = 0;
+    token_cache_release(ctx);
+}
+
+// Verdadeiro quando quem pediu a análise desistiu dela
+static bool analysis_cancelled(AnalysisContext *ctx) {
+    return ctx->cancel != NULL && __atomic_load_n(ctx->cancel, __ATOMIC_RELAXED);
+}
+
+static long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int perf_counter_open(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void phase_clock_close(PhaseClock *clock) {
+    if (!clock->bound) return;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (clock->perf_fds[c] >= 0) close(clock->perf_fds[c]);
+    }
+    clock->bound = false;
+}
+
+// Abre o grupo de contadores para a thread atual. Sem perf_event_open
+// (kernel, permissão ou máquina virtual sem PMU) ficam só os tempos.
+static void phase_clock_bind(PhaseClock *clock) {
+    const uint64_t configs[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    phase_clock_close(clock);
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        clock->perf_fds[c] = perf_counter_open(configs[c], c == 0 ? -1 : clock->perf_fds[0]);
+        if (clock->perf_fds[c] < 0) {
+            for (int k = 0; k < c; k++) {
+                close(clock->perf_fds[k]);
+                clock->perf_fds[k] = -1;
+            }
+            break;
+        }
+    }
+    clock->thread = pthread_self();
+    clock->bound = true;
+    clock->counted = false;
+}
+
+// Valores atuais do grupo, corrigidos pela fração do tempo em que o kernel
+// de fato contou (quando há mais grupos que contadores na CPU)
+static bool phase_clock_read(PhaseClock *clock, long long *values) {
+    if (clock->perf_fds[0] < 0) return false;
+    uint64_t data[3 + NUM_COUNTERS]; // Quantidade, tempo habilitado, tempo contando, valores
+    if (read(clock->perf_fds[0], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) {
+        return false;
+    }
+    double scale = (double)data[1] / data[2];
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        values[c] = (long long)(data[3 + c] * scale);
+    }
+    return true;
+}
+
+// Passa o contexto para a fase `phase` e devolve a anterior, para quem
+// mede um trecho dentro de outra fase poder voltar a ela. O trecho desde a
+// última troca vai para a fase que termina. Sem --stats é só um teste.
+static Phase stats_phase(AnalysisContext *ctx, Phase phase) {
+    PhaseClock *clock = &ctx->phase_clock;
+    Phase previous = clock->phase;
+    if (clock->stats == NULL) return previous;
+    
+    if (!clock->bound || !pthread_equal(clock->thread, pthread_self())) {
+        phase_clock_bind(clock);
+    }
+    long long now = monotonic_ns();
+    long long counters[NUM_COUNTERS];
+    bool counted = phase_clock_read(clock, counters);
+    if (previous != PHASE_IDLE) {
+        PhaseStats *stats = &clock->stats->phases[previous];
+        stats->nanoseconds += now - clock->start;
+        if (counted && clock->counted) {
+            for (int c = 0; c < NUM_COUNTERS; c++) {
+                stats->counters[c] += counters[c] - clock->counters[c];
+            }
+        } else {
+            clock->stats->counted = false;
+        }
+    }
+    clock->phase = phase;
+    clock->start = now;
+    clock->counted = counted;
+    memcpy(clock->counters, counters, sizeof(counters));
+    return previous;
+}
+
+// Começa as medidas de um arquivo em `stats` (NULL sem --stats)
+static void stats_begin(AnalysisContext *ctx, FileStats *stats, const char *path) {
+    ctx->phase_clock.stats = stats;
+    ctx->phase_clock.phase = PHASE_IDLE;
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(FileStats));
+        stats->path = path;
+        stats->counted = true;
+    }
+}
+
+static void stats_add(FileStats *total, const FileStats *stats) {
+    for (int p = 0; p < NUM_PHASES; p++) {
+        total->phases[p].nanoseconds += stats->phases[p].nanoseconds;
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            total->phases[p].counters[c] += stats->phases[p].counters[c];
+        }
+    }
+    total->bytes += stats->bytes;
+    total->tokens += stats->tokens;
+    total->counted = total->counted && stats->counted;
+}
+
+static void reset_analysis_context(AnalysisContext *ctx) {
+    init_symbol_table(ctx);
+    clear_pending_function_calls(ctx);
+    ctx->principal_func = false;
+    ctx->memory = sizeof(ctx->memory);
+    ctx->out.length = 0;
+    ctx->current_token = -1;
+    ctx->error_count = 0;
+    ctx->warning_count = 0;
+    clear_diagnostics(ctx);
+}
+
+static void free_analysis_context(AnalysisContext *ctx) {
+    for (int w = 0; w < ctx->body_worker_count; w++) {
+        release_body_worker(ctx->body_workers[w]);
+    }
+    free(ctx->body_workers);
+    free(ctx->function_scopes);
+    free(ctx->bodies);
+    init_symbol_table(ctx);
+    clear_pending_function_calls(ctx);
+    free(ctx->symbol_table.trail);
+    free(ctx->out.data);
+    free(ctx->spans);
+    free(ctx->token_kinds);
+    free_arena(&ctx->ast_arena);
+    free(ctx->command_nodes);
+    free(ctx->bracket_match);
+    free(ctx->bracket_stack);
+    free(ctx->bracket_errors);
+    free(ctx->functions);
+    free(ctx->level_waiting);
+    free(ctx->missing_returns);
+    free(ctx->diagnostics);
+    free(ctx->diagnostic_text.data);
+    free(ctx->diagnostic_message.data);
+    free(ctx->diagnostic_slots);
+    free(ctx->types.nodes);
+    free(ctx->types.edges);
+    free(ctx->links.declaration);
+    free(ctx->links.first_use);
+    free(ctx->links.next_use);
+    free(ctx->links.bindings);
+    free(ctx->links.slots);
+    free(ctx->links.functions);
+    free(ctx->links.calls);
+    free(ctx->types.declared);
+    free(ctx->types.functions);
+    free(ctx->types.calls);
+    free(ctx->types.worklist);
+    release_tokens(ctx);
+    free(ctx->content);
+    phase_clock_close(&ctx->phase_clock);
+    free(ctx);
+}
+
+// Analisa um único arquivo usando apenas o estado do contexto recebido
+static void analyze_file(AnalysisContext *ctx, const char *path) {
+    // Reinicia o contexto para cada arquivo
+    reset_analysis_context(ctx);
+
+    report_file_begin(ctx, path);
+
+    stats_phase(ctx, PHASE_READ);
+    char *content = read_file(ctx, path);
+    stats_phase(ctx, PHASE_IDLE);
+    if (content == NULL) {
+        report_printf(ctx, VERBOSITY_DIAGNOSTICS, "Erro ao ler o arquivo: %s\n", path);
+        report_file_end(ctx, path, 0);
+        return;
+    }
+    analyze_content(ctx, path, content);
+}
+
+// Analisa um arquivo cujo conteúdo a leitura antecipada já trouxe. A memória
+// é contabilizada como se read_file() tivesse lido o arquivo.
+static void analyze_loaded_file(AnalysisContext *ctx, const char *path, char *content, size_t size) {
+    reset_analysis_context(ctx);
+
+    report_file_begin(ctx, path);
+
+    if (ctx->memory + size + 1 > MAX_MEMORY) {
+        free(content);
+        analysis_out_of_memory(ctx);
+    }
+    ctx->memory += size + 1;
+    analyze_content(ctx, path, content);
+}
+
+// Analisa um conteúdo que já está em memória, como o de um editor. `name`
+// só aparece no relatório.
+static void analyze_buffer(AnalysisContext *ctx, const char *name, const char *buffer, size_t buffer_length) {
+    reset_analysis_context(ctx);
+
+    report_file_begin(ctx, name);
+
+    char *content = safe_malloc(ctx, buffer_length + 1);
+    if (content == NULL) {
+        report_diagnostic(ctx, DIAG_IO_ERROR, ctx->current_token, NULL, "Erro ao alocar memória!");
+        report_file_end(ctx, name, 0);
+        return;
+    }
+    memcpy(content, buffer, buffer_length);
+    content[buffer_length] = '\0';
+    analyze_content(ctx, name, content);
+}
+
+// Análise de um conteúdo lido para a memória (alocado com safe_malloc), que é
+// liberado no fim. O contexto já foi reiniciado e o relatório aberto.
+static void analyze_content(AnalysisContext *ctx, const char *path, char *content) {
+    if (analysis_lex(ctx, path, content)) {
+        analysis_check(ctx, path);
+    }
+}
+
+// Primeira etapa da análise de um conteúdo: o resultado guardado no cache,
+// os tokens guardados no cache ou o lexer. Devolve false quando o resultado
+// veio pronto do cache e o relatório do arquivo já está completo.
+static bool analysis_lex(AnalysisContext *ctx, const char *path, char *content) {
+    stats_phase(ctx, PHASE_LEX);
+    ctx->content = content;
+    ctx->content_length = strlen(content);
+    if (ctx->phase_clock.stats != NULL) ctx->phase_clock.stats->bytes = ctx->content_length;
+    ctx->body_start = ctx->out.length;
+    ctx->content_hash = 0;
+    if (ctx->cache_dir != NULL) {
+        ctx->content_hash = content_hash(content, ctx->content_length);
+        // Conteúdo já analisado com as mesmas opções: repete o resultado. No
+        // modo projeto o resultado depende dos outros arquivos e não é guardado.
+        int length = 0;
+        if (ctx->project == NULL && result_cache_load(ctx, ctx->content_hash, ctx->content_length, &length)) {
+            report_file_end(ctx, path, length);
+            free(content);
+            ctx->content = NULL;
+            stats_phase(ctx, PHASE_IDLE);
+            return false;
+        }
+    }
+    lex_content(ctx, content);
+    stats_phase(ctx, PHASE_IDLE);
+    return true;
+}
+
+// Tokens de ctx->content: os do cache de tokens, se o conteúdo já foi visto,
+// ou os do lexer
+static void lex_content(AnalysisContext *ctx, char *content) {
+    int length = 0;
+    char **tokens = NULL;
+    if (ctx->cache_dir != NULL) {
+        tokens = token_cache_load(ctx, ctx->content_hash, ctx->content_length, &length);
+        ctx->tokens = tokens;
+        ctx->token_count = length;
+    }
+    if (tokens == NULL) {
+        size_t memory_before = ctx->memory;
+        tokens = string_tokens(ctx, content, &length);
+        if (ctx->cache_dir != NULL && tokens != NULL) {
+            token_cache_store(ctx, ctx->content_hash, ctx->content_length, tokens, length,
+                              ctx->memory - memory_before);
+        }
+    }
+    ctx->token_count = tokens != NULL ? length : 0;
+}
+
+// '}' do corpo da função cujo nome está em `name`: depois da lista de
+// parâmetros (se houver) e de quebras de linha, a '{' e o seu par
+static int function_body_close(AnalysisContext *ctx, int name, int length) {
+    int k = name + 1;
+    if (ctx->token_kinds[k] == KIND_LEFT_PAREN) {
+        if (ctx->bracket_match[k] < k) return -1;
+        k = ctx->bracket_match[k] + 1;
+    }
+    while (k < length && ctx->token_kinds[k] == KIND_NEWLINE) k++;
+    if (k >= length || ctx->token_kinds[k] != KIND_LEFT_BRACE) return -1;
+    int close = ctx->bracket_match[k];
+    return close > k && close < length ? close : -1;
+}
+
+static void open_function_scope(AnalysisContext *ctx, int token, int close, int line) {
+    ctx->function_scopes = reserve_one(ctx, ctx->function_scopes, ctx->function_scope_count,
+                                       &ctx->function_scope_capacity, sizeof(FunctionScope));
+    FunctionScope *function = &ctx->function_scopes[ctx->function_scope_count++];
+    function->close = close;
+    function->scope = ctx->symbol_table.current_scope;
+    function->token = token;
+    function->line = line;
+}
+
+// Linha da classificação na '}' do corpo: a do cabeçalho mais as linhas que
+// o corpo ocupa no arquivo, seja ele classificado aqui ou em outro contexto
+static int function_end_line(AnalysisContext *ctx, const FunctionScope *function) {
+    return function->line + ctx->spans[function->close].line - ctx->spans[function->token].line;
+}
+
+// Sai do escopo dos parâmetros e do que tiver ficado aberto dentro dele.
+// Parâmetros sem uso não geram aviso.
+static void leave_function_scope(AnalysisContext *ctx, int scope) {
+    while (ctx->symbol_table.trail_top > 0 &&
+           ctx->symbol_table.trail[ctx->symbol_table.trail_top - 1]->scope_level >= scope) {
+        pop_trail_symbol(ctx);
+    }
+    ctx->symbol_table.current_scope = scope > 0 ? scope - 1 : 0;
+}
+
+// Depois da '}' em `index`: se ela fecha o corpo da função aberta mais
+// interna, fecha também o escopo dos parâmetros. Funções cuja '}' foi
+// engolida por um comando ficam com o escopo aberto, como antes.
+static int close_function_scope(AnalysisContext *ctx, int index, int current_line) {
+    while (ctx->function_scope_count > 0 && ctx->function_scopes[ctx->function_scope_count - 1].close < index) {
+        ctx->function_scope_count--;
+    }
+    if (ctx->function_scope_count == 0 || ctx->function_scopes[ctx->function_scope_count - 1].close != index) {
+        return current_line;
+    }
+    FunctionScope *function = &ctx->function_scopes[--ctx->function_scope_count];
+    leave_function_scope(ctx, function->scope);
+    return function_end_line(ctx, function);
+}
+
+// Separa o corpo que começa em `open` para validate_function_bodies(). Os
+// parâmetros saem da tabela do arquivo e vão com o corpo; o que foi inserido
+// até aqui fica visível para ele. Devolve a linha onde a classificação segue.
+static int defer_function_body(AnalysisContext *ctx, int open, int current_line) {
+    FunctionScope *function = &ctx->function_scopes[--ctx->function_scope_count];
+    ctx->bodies = reserve_one(ctx, ctx->bodies, ctx->body_count, &ctx->body_capacity, sizeof(FunctionBody));
+    FunctionBody *body = &ctx->bodies[ctx->body_count++];
+    body->open = open;
+    body->close = function->close;
+    body->scope = function->scope;
+    body->line = current_line;
+    body->params = NULL;
+    while (ctx->symbol_table.trail_top > 0 &&
+           ctx->symbol_table.trail[ctx->symbol_table.trail_top - 1]->scope_level >= function->scope) {
+        Symbol *param = unlink_trail_symbol(ctx);
+        param->next = body->params;
+        body->params = param;
+    }
+    ctx->symbol_table.current_scope = function->scope - 1;
+    body->visible = ctx->symbol_table.inserted;
+    body->insert_at = ctx->out.length;
+    body->worker = NULL;
+    body->out_start = 0;
+    body->out_end = 0;
+    return function_end_line(ctx, function);
+}
+
+// Recuperação em modo pânico depois de um erro na classificação: pula os
+// tokens a partir de `from` até um ponto de sincronização e devolve onde a
+// classificação continua. Sincroniza depois de ';' ou de uma quebra de linha
+// e antes de '{', '}' ou do próximo comando; as chaves são sempre
+// classificadas, então os escopos da tabela de símbolos continuam
+// equilibrados. Parênteses e textos são pulados inteiros pelo índice de
+// pares, para o ';' de um cabeçalho de 'para' não contar como fim de
+// comando. Não passa de `length`, e com o limite de erros do arquivo
+// atingido devolve esse fim.
+static int recover_from_error(AnalysisContext *ctx, int from, int length, int *current_line) {
+    if (ctx->max_errors > 0 && ctx->error_count >= ctx->max_errors) {
+        report_diagnostic(ctx, DIAG_RECOVERY, from, NULL, "ERRO ENCONTRADO: limite de %d erros atingido. Finalizando a análise.\n", ctx->max_errors);
+        return length;
+    }
+    
+    int i = from;
+    while (i < length) {
+        TokenKind kind = ctx->token_kinds[i];
+        int match = ctx->bracket_match[i];
+        if ((kind == KIND_LEFT_PAREN || strcmp(ctx->tokens[i], "\"") == 0) && match > i) {
+            // Linhas dentro do trecho pulado ainda contam
+            for (int j = i + 1; j < match; j++) {
+                if (ctx->token_kinds[j] == KIND_NEWLINE) (*current_line)++;
+            }
+            i = match + 1;
+            continue;
+        }
+        if (kind == KIND_SEMICOLON) {
+            i++;
+            break;
+        }
+        if (kind == KIND_NEWLINE) {
+            (*current_line)++;
+            i++;
+            break;
+        }
+        if (kind == KIND_LEFT_BRACE || kind == KIND_RIGHT_BRACE || kind == KIND_FUNCAO ||
+            kind == KIND_PRINCIPAL || kind == KIND_LEIA || kind == KIND_ESCREVA ||
+            kind == KIND_SE || kind == KIND_PARA || kind == KIND_TYPE ||
+            (kind == KIND_WORD && strcmp(ctx->tokens[i], "retorno") == 0)) {
+            break;
+        }
+        i++;
+    }
+    if (i < length) {
+        report_diagnostic(ctx, DIAG_RECOVERY, i, NULL, "ERRO ENCONTRADO: análise retomada em tokens[%d].\n", i);
+    }
+    return i;
+}
+
+// Classificação dos tokens de `from` até antes de `length`, a partir da
+// linha `current_line`. No contexto do arquivo, o corpo de cada função de
+// primeiro nível é separado para validate_function_bodies() em vez de ser
+// classificado aqui; os contextos de corpo chamam esta mesma função, um
+// corpo por vez.
+static void classify_tokens(AnalysisContext *ctx, int from, int length, int current_line) {
+    char **tokens = ctx->tokens;
+    TokenKind *kinds = ctx->token_kinds;
+    int error_at = -1; // Depois de um erro, onde a recuperação começa a procurar
+    // Com limite de erros a ordem em que eles aparecem decide quais entram, e
+    // com delimitadores desencontrados o fim dos corpos não é confiável
+    bool defer_bodies = ctx->owner == NULL && ctx->max_errors == 0 && ctx->bracket_error_count == 0;
+    
+    int i = from;
+    while (i < length) {
+        if (analysis_cancelled(ctx)) break;
+        ctx->current_token = i;
+        TokenKind kind = kinds[i];
+        if (defer_bodies && kind == KIND_LEFT_BRACE && ctx->function_scope_count > 0) {
+            // '{' do corpo de uma função de primeiro nível, logo depois do cabeçalho
+            FunctionScope *function = &ctx->function_scopes[ctx->function_scope_count - 1];
+            if (ctx->bracket_match[i] == function->close && function->scope == 1 &&
+                ctx->symbol_table.current_scope == 1) {
+                int open = i;
+                i = function->close + 1;
+                current_line = defer_function_body(ctx, open, current_line);
+                continue;
+            }
+        }
+        if (kind == KIND_PRINCIPAL && strcmp(tokens[i], "principal") == 0) {
+            ctx->principal_func = true;
+        }
+        // Texto seguido de '=' é o alvo de uma atribuição, qualquer que seja
+        // o tipo (só quebras de linha, strings e 'funcao' têm prioridade)
+        if (kind != KIND_NEWLINE && kind != KIND_QUOTED && kind != KIND_FUNCAO && kinds[i + 1] == KIND_ASSIGN) {
+            if (tokens[i][0] != '!') {
+                char *suggestion = suggest_keyword(ctx, tokens[i]);
+                if (suggestion != NULL) {
+                    report_diagnostic(ctx, DIAG_LEXICAL_ERROR, i, suggestion, "tokens[%d] = \"%s\" -> LEXICAL ERROR (Você quis dizer '%s'?)\n", i, tokens[i], suggestion);
+                } else {
+                    report_diagnostic(ctx, DIAG_LEXICAL_ERROR, i, NULL, "tokens[%d] = \"%s\" -> LEXICAL ERROR\n", i, tokens[i]);
+                }
+                i = recover_from_error(ctx, i + 1, length, &current_line);
+                continue;
+            }
+            // Remove vírgula do nome da variável se presente para busca
+            char *var_name = safe_malloc(ctx, strlen(tokens[i]) + 1);
+            strcpy(var_name, tokens[i]);
+            char *comma = strchr(var_name, ',');
+            if (comma) *comma = '\0';
+            
+            // Verifica se a variável já foi declarada
+            Symbol *var = lookup_symbol(ctx, var_name);
+            if (var == NULL) {
+                report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, i, NULL, "tokens[%d] = \"%s\" -> SEMANTIC ERROR (Variável não declarada)\n", i, tokens[i]);
+            } else {
+                report_token(ctx, i, tokens[i], CLASS_VARIABLE_USE);
+            }
+            free(var_name);
+            i++;
+            continue;
+        }
+        
+        switch (kind) {
+        case KIND_NEWLINE:
+            current_line++;
+            if (i == 0) {
+                report_token(ctx, i, tokens[i], CLASS_NEWLINE);
+            } else {
+                TokenKind prev = kinds[i - 1];
+                if (prev != KIND_SEMICOLON && prev != KIND_LEFT_BRACE && prev != KIND_RIGHT_BRACE && prev != KIND_NEWLINE) {
+                    report_diagnostic(ctx, DIAG_MISSING_SEMICOLON, i, NULL, "tokens[%d] = \"%s\" -> SYNTAX ERROR (ausência de ; após '%s')\n", i, tokens[i], tokens[i - 1]);
+                    error_at = i + 1;
+                    break;
+                } else {
+                    report_token(ctx, i, tokens[i], CLASS_NEWLINE);
+                }
+            }
+            i++;
+            continue;
+        case KIND_QUOTED:
+            report_token(ctx, i, tokens[i], CLASS_STRING);
+            i++;
+            while (i < length) {
+                size_t len = strlen(tokens[i]);
+                if (len >= strlen("\"") && strcmp(&tokens[i][len - strlen("\"")], "\"") == 0) {
+                    report_token(ctx, i, tokens[i], CLASS_STRING);
+                    break;
+                } else {
+                    report_token(ctx, i, tokens[i], CLASS_STRING);
+                    i++;
+                }
+            }
+            break;
+        case KIND_FUNCAO:
+            if (i + 1 < length && strncmp(tokens[i + 1], "__", 2) == 0) {
+                report_token(ctx, i, tokens[i], CLASS_KEYWORD);
+                
+                // Valida o nome da função
+                if (!validate_function_declaration(ctx, tokens[i + 1])) {
+                    error_at = i + 2;
+                    break;
+                }
+                
+                report_token(ctx, i + 1, tokens[i + 1], CLASS_FUNC_NAME);
+                
+                // Adiciona função à tabela de símbolos
+                add_symbol(ctx, tokens[i + 1], i + 1, SYMBOL_FUNCTION, TYPE_VOID, current_line);
+                enter_scope(ctx); // Entra no escopo da função
+                int close = function_body_close(ctx, i + 1, length);
+                if (close != -1) {
+                    open_function_scope(ctx, i, close, current_line);
+                }
+                
+                char *current_function = tokens[i + 1];
+                
+                // Processa parâmetros da função se houver
+                i += 2;
+                if (i < length && kinds[i] == KIND_LEFT_PAREN) {
+                    int start_params = i + 1;
+                    int end_params = ctx->bracket_match[i];
+                    if (end_params == -1) end_params = length;
+                    
+                    // Valida a lista de parâmetros se não estiver vazia
+                    if (end_params > start_params) {
+                        if (!validate_parameter_list(ctx, tokens, start_params, end_params - 1)) {
+                            // Retoma depois da lista, para os parâmetros não virarem declarações
+                            error_at = end_params + 1;
+                            break;
+                        }
+                    }
+                    
+                    i = start_params; // volta para processar os parâmetros
+                    while (i < end_params) {
+                        if (is_variable(tokens[i])) {
+                            // Sem tipo declarado, o tipo vem de infer_types()
+                            DataType param_type = i > start_params && kinds[i - 1] == KIND_TYPE ?
+                                                  string_to_data_type(tokens[i - 1]) : TYPE_UNKNOWN;
+                            // Remove vírgula do nome da variável se presente
+                            char *param_name = safe_malloc(ctx, strlen(tokens[i]) + 1);
+                            strcpy(param_name, tokens[i]);
+                            char *comma = strchr(param_name, ',');
+                            if (comma) *comma = '\0';
+                            
+                            // Adiciona parâmetro à tabela de símbolos
+                            add_symbol(ctx, param_name, i, SYMBOL_PARAMETER, param_type, current_line);
+                            // Adiciona parâmetro à função
+                            add_function_parameter(ctx, current_function, param_name, param_type);
+                            
+                            report_token(ctx, i, tokens[i], CLASS_PARAMETER);
+                            free(param_name);
+                        } else if (kinds[i] == KIND_COMMA) {
+                            report_token(ctx, i, tokens[i], CLASS_COMMA);
+                        }
+                        i++;
+                    }
+                    if (i < length && kinds[i] == KIND_RIGHT_PAREN) {
+                        i--; // volta um para o loop principal processar o ')'
+                    }
+                }
+                continue;
+            } else if (i + 1 < length) {
+                report_token(ctx, i, tokens[i], CLASS_KEYWORD);
+                report_diagnostic(ctx, DIAG_BAD_FUNCTION_NAME, i + 1, NULL, "tokens[%d] = \"%s\" -> SEMANTIC ERROR (Nome de função deve começar com '__')\n", i + 1, tokens[i + 1]);
+                error_at = i + 1;
+            } else {
+                report_token(ctx, i, tokens[i], CLASS_KEYWORD);
+                report_diagnostic(ctx, DIAG_UNEXPECTED_END, -1, NULL, "tokens[%d] = <FIM> -> LEXICAL ERROR\n", i + 1);
+                error_at = i + 1;
+            }
+            break;
+        case KIND_PRINCIPAL:
+            report_token(ctx, i, tokens[i], CLASS_KEYWORD);
+            
+            // Adiciona função principal à tabela de símbolos
+            add_symbol(ctx, "__principal", i, SYMBOL_FUNCTION, TYPE_VOID, current_line);
+            enter_scope(ctx); // Entra no escopo da função principal
+            
+            i++; 
+
+            // Verifica se o próximo token é '('
+            if (i >= length || kinds[i] != KIND_LEFT_PAREN) {
+                report_diagnostic(ctx, DIAG_EXPECTED_PAREN, i, NULL, "tokens[%d] = \"%s\" -> SYNTAX ERROR (esperado '(' após 'principal')\n", i, i < length ? tokens[i] : "<FIM>");
+                error_at = i;
+                break; 
+            }
+            report_token(ctx, i, tokens[i], CLASS_LEFT_PAREN);
+            i++; 
+
+            // Verifica se o próximo token é ')'
+            if (i >= length || kinds[i] != KIND_RIGHT_PAREN) {
+                report_diagnostic(ctx, DIAG_EXPECTED_PAREN, i, NULL, "SYNTAX ERROR: '%s' inesperado dentro da declaração da função 'principal'\n", tokens[i]);
+                report_diagnostic(ctx, DIAG_EXPECTED_PAREN, i, NULL, "tokens[%d] = \"%s\" -> SYNTAX ERROR (esperado ')' após '(' em 'principal')\n", i, tokens[i]);
+                error_at = i;
+                break;
+            }
+            report_token(ctx, i, tokens[i], CLASS_RIGHT_PAREN);
+            if (kinds[i + 1] != KIND_LEFT_BRACE) {
+                report_diagnostic(ctx, DIAG_EXPECTED_BRACE, i+1, NULL, "tokens[%d] = \"%s\" -> ERRO: esperado '{' após 'principal()'\n", i+1, tokens[i+1]);
+                error_at = i + 1;
+                break;
+            } 
+            i++;
+            report_token(ctx, i, tokens[i], CLASS_LEFT_BRACE);
+            i++;
+            break;
+        case KIND_SEMICOLON:
+            report_token(ctx, i, tokens[i], CLASS_SEMICOLON);
+            break;
+        case KIND_PLUS:
+            report_token(ctx, i, tokens[i], CLASS_PLUS);
+            break;
+        case KIND_MINUS:
+            report_token(ctx, i, tokens[i], CLASS_MINUS);
+            break;
+        case KIND_MULTIPLY:
+            report_token(ctx, i, tokens[i], CLASS_MULTIPLY);
+            break;
+        case KIND_DIVIDE:
+            report_token(ctx, i, tokens[i], CLASS_DIVIDE);
+            break;
+        case KIND_POWER:
+            report_token(ctx, i, tokens[i], CLASS_POWER);
+            break;
+        case KIND_EQUALS:
+            report_token(ctx, i, tokens[i], CLASS_EQUALS);
+            break;
+        case KIND_NOT_EQUALS:
+            report_token(ctx, i, tokens[i], CLASS_NOT_EQUALS);
+            break;
+        case KIND_LESS:
+            report_token(ctx, i, tokens[i], CLASS_LESS);
+            break;
+        case KIND_LESS_EQUAL:
+            report_token(ctx, i, tokens[i], CLASS_LESS_EQUAL);
+            break;
+        case KIND_GREATER:
+            report_token(ctx, i, tokens[i], CLASS_GREATER);
+            break;
+        case KIND_GREATER_EQUAL:
+            report_token(ctx, i, tokens[i], CLASS_GREATER_EQUAL);
+            break;
+        case KIND_AND:
+            report_token(ctx, i, tokens[i], CLASS_AND);
+            break;
+        case KIND_OR:
+            report_token(ctx, i, tokens[i], CLASS_OR);
+            break;
+        case KIND_INVALID_OPERATOR:
+            report_diagnostic(ctx, DIAG_INVALID_OPERATOR, i, NULL, "tokens[%d] = \"%s\" -> LEXICAL ERROR (Operador inválido)\n", i, tokens[i]);
+            error_at = i + 1;
+            break;
+        case KIND_COMMA:
+            report_token(ctx, i, tokens[i], CLASS_COMMA);
+            break;
+        case KIND_ASSIGN:
+            report_token(ctx, i, tokens[i], CLASS_ASSIGNMENT);
+            break;
+        case KIND_LEFT_PAREN:
+            report_token(ctx, i, tokens[i], CLASS_LEFT_PAREN);
+            break;
+        case KIND_RIGHT_PAREN:
+            report_token(ctx, i, tokens[i], CLASS_RIGHT_PAREN);
+            break;
+        case KIND_LEFT_BRACE:
+            report_token(ctx, i, tokens[i], CLASS_LEFT_BRACE);
+            enter_scope(ctx); // Entra em novo escopo
+            break;
+        case KIND_RIGHT_BRACE:
+            report_token(ctx, i, tokens[i], CLASS_RIGHT_BRACE);
+            exit_scope(ctx); // Sai do escopo atual
+            current_line = close_function_scope(ctx, i, current_line);
+            break;
+        case KIND_NUMBER:
+            report_token(ctx, i, tokens[i], CLASS_INTEGER);
+            break;
+        case KIND_LEIA:
+            // Processamento específico para o comando leia
+            report_token(ctx, i, tokens[i], CLASS_LEIA_COMMAND);
+            
+            if (i + 1 < length) {
+                int end_pos = length - 1;
+                if (validate_leia_command(ctx, command_node(ctx, i), &end_pos, current_line)) {
+                    // Processa (só no relatório completo) os tokens validados do comando leia
+                    if (ctx->verbosity >= VERBOSITY_TOKENS) {
+                        for (int j = i + 1; j <= end_pos; j++) {
+                            switch (kinds[j]) {
+                                case KIND_LEFT_PAREN: report_token(ctx, j, tokens[j], CLASS_LEFT_PAREN); break;
+                                case KIND_RIGHT_PAREN: report_token(ctx, j, tokens[j], CLASS_RIGHT_PAREN); break;
+                                case KIND_COMMA: report_token(ctx, j, tokens[j], CLASS_COMMA); break;
+                                case KIND_SEMICOLON: report_token(ctx, j, tokens[j], CLASS_SEMICOLON); break;
+                                default:
+                                    if (is_variable(tokens[j])) {
+                                        report_token(ctx, j, tokens[j], CLASS_VARIABLE_READ);
+                                    }
+                            }
+                        }
+                    }
+                    i = end_pos; // Pula para o final do comando processado
+                } else {
+                    error_at = i + 1;
+                }
+            } else {
+                report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, ctx->current_token, NULL, "SYNTAX ERROR: Comando 'leia' incompleto\n");
+                error_at = i + 1;
+            }
+            break;
+        case KIND_ESCREVA:
+            // Processamento específico para o comando escreva
+            report_token(ctx, i, tokens[i], CLASS_ESCREVA_COMMAND);
+            
+            if (i + 1 < length) {
+                int end_pos = length - 1;
+                if (validate_escreva_command(ctx, command_node(ctx, i), &end_pos, current_line)) {
+                    // Processa (só no relatório completo) os tokens validados do comando escreva
+                    if (ctx->verbosity >= VERBOSITY_TOKENS) {
+                        for (int j = i + 1; j <= end_pos; j++) {
+                            switch (kinds[j]) {
+                                case KIND_LEFT_PAREN: report_token(ctx, j, tokens[j], CLASS_LEFT_PAREN); break;
+                                case KIND_RIGHT_PAREN: report_token(ctx, j, tokens[j], CLASS_RIGHT_PAREN); break;
+                                case KIND_COMMA: report_token(ctx, j, tokens[j], CLASS_COMMA); break;
+                                case KIND_SEMICOLON: report_token(ctx, j, tokens[j], CLASS_SEMICOLON); break;
+                                default:
+                                    if (strcmp(tokens[j], "\"") == 0) {
+                                        report_token(ctx, j, tokens[j], CLASS_QUOTE);
+                                    } else if (is_variable(tokens[j])) {
+                                        report_token(ctx, j, tokens[j], CLASS_VARIABLE_WRITE);
+                                    } else {
+                                        report_token(ctx, j, tokens[j], CLASS_STRING_TEXT);
+                                    }
+                            }
+                        }
+                    }
+                    i = end_pos; // Pula para o final do comando processado
+                } else {
+                    error_at = i + 1;
+                }
+            } else {
+                report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, ctx->current_token, NULL, "SYNTAX ERROR: Comando 'escreva' incompleto\n");
+                error_at = i + 1;
+            }
+            break;
+        case KIND_SE:
+            // Processamento específico para o comando se
+            report_token(ctx, i, tokens[i], CLASS_SE_COMMAND);
+            
+            if (i + 1 < length) {
+                int end_pos = length - 1;
+                if (validate_se_command(ctx, command_node(ctx, i), &end_pos, current_line)) {
+                    // Processa (só no relatório completo) os tokens validados do comando se
+                    if (ctx->verbosity >= VERBOSITY_TOKENS) {
+                        for (int j = i + 1; j <= end_pos; j++) {
+                            switch (kinds[j]) {
+                                case KIND_LEFT_PAREN: report_token(ctx, j, tokens[j], CLASS_LEFT_PAREN); break;
+                                case KIND_RIGHT_PAREN: report_token(ctx, j, tokens[j], CLASS_RIGHT_PAREN); break;
+                                case KIND_LEFT_BRACE: report_token(ctx, j, tokens[j], CLASS_LEFT_BRACE); break;
+                                case KIND_RIGHT_BRACE: report_token(ctx, j, tokens[j], CLASS_RIGHT_BRACE); break;
+                                case KIND_SEMICOLON: report_token(ctx, j, tokens[j], CLASS_SEMICOLON); break;
+                                default:
+                                    if (strcmp(tokens[j], "senao") == 0) {
+                                        report_token(ctx, j, tokens[j], CLASS_SENAO_KEYWORD);
+                                    } else if (is_variable(tokens[j])) {
+                                        report_token(ctx, j, tokens[j], CLASS_VARIABLE_CONDITION);
+                                    } else if (strcmp(tokens[j], "\n") != 0) {
+                                        report_token(ctx, j, tokens[j], CLASS_CONDITIONAL_CONTENT);
+                                    }
+                            }
+                        }
+                    }
+                    i = end_pos; // Pula para o final do comando processado
+                } else {
+                    error_at = i + 1;
+                }
+            } else {
+                report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, ctx->current_token, NULL, "SYNTAX ERROR: Comando 'se' incompleto\n");
+                error_at = i + 1;
+            }
+            break;
+        case KIND_PARA:
+            // Processamento específico para o comando para
+            report_token(ctx, i, tokens[i], CLASS_PARA_COMMAND);
+            
+            if (i + 1 < length) {
+                int end_pos = length - 1;
+                if (validate_para_command(ctx, command_node(ctx, i), &end_pos, current_line)) {
+                    // Processa (só no relatório completo) os tokens validados do comando para
+                    if (ctx->verbosity >= VERBOSITY_TOKENS) {
+                        for (int j = i + 1; j <= end_pos; j++) {
+                            switch (kinds[j]) {
+                                case KIND_LEFT_PAREN: report_token(ctx, j, tokens[j], CLASS_LEFT_PAREN); break;
+                                case KIND_RIGHT_PAREN: report_token(ctx, j, tokens[j], CLASS_RIGHT_PAREN); break;
+                                case KIND_LEFT_BRACE: report_token(ctx, j, tokens[j], CLASS_LEFT_BRACE); break;
+                                case KIND_RIGHT_BRACE: report_token(ctx, j, tokens[j], CLASS_RIGHT_BRACE); break;
+                                case KIND_SEMICOLON: report_token(ctx, j, tokens[j], CLASS_SEMICOLON); break;
+                                case KIND_COMMA: report_token(ctx, j, tokens[j], CLASS_COMMA); break;
+                                case KIND_ASSIGN: report_token(ctx, j, tokens[j], CLASS_ASSIGNMENT); break;
+                                case KIND_PLUS:
+                                case KIND_MINUS:
+                                case KIND_MULTIPLY:
+                                case KIND_DIVIDE:
+                                    report_token(ctx, j, tokens[j], CLASS_MATH_OPERATOR);
+                                    break;
+                                case KIND_NUMBER: report_token(ctx, j, tokens[j], CLASS_NUMBER); break;
+                                default:
+                                    if (strcmp(tokens[j], "++") == 0 || strcmp(tokens[j], "--") == 0) {
+                                        report_token(ctx, j, tokens[j], CLASS_INCREMENT_DECREMENT);
+                                    } else if (is_variable(tokens[j])) {
+                                        report_token(ctx, j, tokens[j], CLASS_VARIABLE_LOOP);
+                                    } else if (strcmp(tokens[j], "\n") != 0) {
+                                        report_token(ctx, j, tokens[j], CLASS_LOOP_CONTENT);
+                                    }
+                            }
+                        }
+                    }
+                    i = end_pos; // Pula para o final do comando processado
+                } else {
+                    error_at = i + 1;
+                }
+            } else {
+                report_diagnostic(ctx, DIAG_INCOMPLETE_COMMAND, ctx->current_token, NULL, "SYNTAX ERROR: Comando 'para' incompleto\n");
+                error_at = i + 1;
+            }
+            break;
+        case KIND_TYPE: {
+            // Declaração de variável
+            DataType var_type = string_to_data_type(tokens[i]);
+            
+            report_token(ctx, i, tokens[i], 
+                         var_type == TYPE_INTEGER ? CLASS_INTEGER_TYPE : 
+                         var_type == TYPE_STRING ? CLASS_STRING_TYPE : CLASS_FLOAT_TYPE);
+            
+            // Processa todas as variáveis declaradas na linha
+            i++; // vai para o primeiro identificador
+            while (i < length && kinds[i] != KIND_SEMICOLON && kinds[i] != KIND_NEWLINE) {
+                if (tokens[i][0] == '!') {
+                    // Remove vírgula do nome da variável se presente
+                    char *var_name = safe_malloc(ctx, strlen(tokens[i]) + 1);
+                    strcpy(var_name, tokens[i]);
+                    char *comma = strchr(var_name, ',');
+                    if (comma) *comma = '\0';
+                    
+                    // Verifica se é redeclaração de parâmetro
+                    if (is_parameter_redeclaration(ctx, var_name)) {
+                        report_diagnostic(ctx, DIAG_REDECLARED_PARAMETER, i, NULL, "tokens[%d] = \"%s\" -> SEMANTIC ERROR (Parâmetro '%s' não deve ser redeclarado dentro da função)\n", 
+                               i, tokens[i], var_name);
+                        free(var_name);
+                        error_at = i + 1;
+                        break;
+                    }
+                    
+                    // Adiciona variável à tabela de símbolos
+                    if (add_symbol(ctx, var_name, i, SYMBOL_VARIABLE, var_type, current_line)) {
+                        report_token(ctx, i, tokens[i], CLASS_VARIABLE_DECLARATION);
+                    }
+                    free(var_name);
+                } else if (kinds[i] == KIND_ASSIGN) {
+                    report_token(ctx, i, tokens[i], CLASS_ASSIGNMENT);
+                } else if (kinds[i] == KIND_COMMA) {
+                    report_token(ctx, i, tokens[i], CLASS_COMMA);
+                } else if (kinds[i] == KIND_NUMBER) {
+                    report_token(ctx, i, tokens[i], CLASS_INTEGER);
+                } else {
+                    report_token(ctx, i, tokens[i], CLASS_IDENTIFIER);
+                }
+                i++;
+            }
+            i--; // volta um para o loop principal processar o próximo token
+            break;
+        }
+        case KIND_VARIABLE: {
+            // Remove vírgula do nome da variável se presente para busca
+            char *var_name = safe_malloc(ctx, strlen(tokens[i]) + 1);
+            strcpy(var_name, tokens[i]);
+            char *comma = strchr(var_name, ',');
+            if (comma) *comma = '\0';
+            
+            // Verifica se a variável já foi declarada
+            Symbol *var = lookup_symbol(ctx, var_name);
+            if (var == NULL) {
+                report_diagnostic(ctx, DIAG_UNDECLARED_VARIABLE, i, NULL, "tokens[%d] = \"%s\" -> SEMANTIC ERROR (Variável não declarada)\n", i, tokens[i]);
+            } else {
+                report_token(ctx, i, tokens[i], CLASS_VARIABLE_USE);
+            }
+            free(var_name);
+            break;
+        }
+        case KIND_WORD:
+            if (has_lexical_error(ctx, tokens[i])) {
+                char *suggestion = suggest_keyword(ctx, tokens[i]);
+                if (suggestion != NULL) {
+                    report_diagnostic(ctx, DIAG_LEXICAL_ERROR, i, suggestion, "tokens[%d] = \"%s\" -> LEXICAL ERROR (Você quis dizer '%s'?)\n", i, tokens[i], suggestion);
+                } else {
+                    report_diagnostic(ctx, DIAG_LEXICAL_ERROR, i, NULL, "tokens[%d] = \"%s\" -> LEXICAL ERROR\n", i, tokens[i]);
+                }
+                error_at = i + 1;
+            } else if (is_keyword(tokens[i])) {
+                report_token(ctx, i, tokens[i], CLASS_KEYWORD);
+            } else if (strncmp(tokens[i], "__", 2) == 0 && kinds[i + 1] == KIND_LEFT_PAREN) {
+                // Chamada de função: os argumentos vão até o ')' correspondente
+                int close_args = ctx->bracket_match[i + 1];
+                int param_start = i + 2;
+                int param_end = close_args - 1;
+                
+                if (close_args == -1) {
+                    report_diagnostic(ctx, DIAG_UNCLOSED_PAREN, i, NULL, "SYNTAX ERROR (linha %d): Chamada de função '%s' sem fechamento de parênteses\n", current_line, tokens[i]);
+                    error_at = i + 1;
+                    break;
+                }
+                
+                // Valida duplo balanceamento nos parâmetros
+                if (param_start <= param_end) {
+                    if (!validate_double_balancing(ctx, param_start, param_end)) {
+                        report_diagnostic(ctx, DIAG_UNBALANCED, i, NULL, "SYNTAX ERROR (linha %d): Balanceamento incorreto nos parâmetros da função '%s'\n", current_line, tokens[i]);
+                        error_at = close_args + 1;
+                        break;
+                    }
+                }
+                
+                // Conta parâmetros na chamada
+                int param_count = 0;
+                bool has_content = false;
+                
+                for (int k = param_start; k <= param_end; k++) {
+                    if (tokens[k] == NULL || strcmp(tokens[k], "\n") == 0) continue;
+                    
+                    if ((bracket_type(tokens[k]) == BRACKET_OPEN || strcmp(tokens[k], "\"") == 0) &&
+                        ctx->bracket_match[k] > k) {
+                        // Vírgulas de chamadas internas e de textos não separam argumentos
+                        k = ctx->bracket_match[k];
+                        has_content = true;
+                    } else if (kinds[k] == KIND_COMMA) {
+                        if (has_content) {
+                            param_count++;
+                            has_content = false;
+                        }
+                    } else {
+                        has_content = true;
+                    }
+                }
+                
+                // Se há conteúdo após a última vírgula (ou se não há vírgulas mas há conteúdo)
+                if (has_content) param_count++;
+                
+                // Verifica se a função existe
+                Symbol *func = lookup_symbol(ctx, tokens[i]);
+                if (func == NULL) {
+                    // 1.10. Adiciona à lista de chamadas pendentes para validação posterior
+                    add_pending_function_call(ctx, tokens[i], param_count, current_line);
+                    report_call_token(ctx, i, tokens[i], CLASS_FUNCTION_CALL_PENDING, param_count);
+                } else {
+                    // Função já existe, valida imediatamente
+                    if (validate_function_call(ctx, tokens[i], param_count, current_line)) {
+                        report_call_token(ctx, i, tokens[i], CLASS_FUNCTION_CALL, param_count);
+                    } else {
+                        report_diagnostic(ctx, DIAG_INVALID_CALL, i, NULL, "tokens[%d] = \"%s\" -> SEMANTIC ERROR (Chamada de função inválida)\n", i, tokens[i]);
+                    }
+                }
+            } else {
+                report_token(ctx, i, tokens[i], CLASS_IDENTIFIER);
+            }
+            break;
+        case KIND_END:
+            break;
+        }
+        if (error_at != -1) {
+            i = recover_from_error(ctx, error_at, length, &current_line);
+            error_at = -1;
+            continue;
+        }
+        i++;
+    }
+}
+
+// Corpos de função em paralelo. A passada principal classifica o que está
+// fora dos corpos de primeiro nível e deixa na tabela do arquivo as
+// assinaturas; cada corpo é depois validado num contexto próprio, com seus
+// escopos sobre essa tabela, que ninguém mais altera. Relatório,
+// diagnósticos e chamadas pendentes voltam na ordem do arquivo, então o
+// resultado não depende da quantidade de threads.
+
+// Abaixo disso (em tokens dos corpos) não vale criar threads
+#define FUNCTION_BODY_MIN_TOKENS 4096
+
+// Contexto de corpo `w`, preparado para o arquivo atual
+static AnalysisContext* prepare_body_worker(AnalysisContext *ctx, int w) {
+    if (w == ctx->body_worker_count) {
+        AnalysisContext **workers = realloc(ctx->body_workers, (w + 1) * sizeof(AnalysisContext*));
+        if (workers == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        ctx->body_workers = workers;
+        workers[w] = calloc(1, sizeof(AnalysisContext));
+        if (workers[w] == NULL) {
+            analysis_out_of_memory(ctx);
+        }
+        report_buffers_init(workers[w]);
+        ctx->body_worker_count++;
+    }
+    AnalysisContext *worker = ctx->body_workers[w];
+    init_symbol_table(worker);
+    clear_pending_function_calls(worker);
+    clear_diagnostics(worker);
+    reset_arena(&worker->ast_arena);
+    worker->owner = ctx;
+    worker->verbosity = ctx->verbosity;
+    worker->format = ctx->format;
+    worker->cancel = ctx->cancel;
+    worker->tokens = ctx->tokens;
+    worker->token_count = ctx->token_count;
+    worker->token_kinds = ctx->token_kinds;
+    worker->spans = ctx->spans;
+    worker->bracket_match = ctx->bracket_match;
+    worker->command_nodes = ctx->command_nodes;
+    worker->principal_func = false;
+    worker->memory = ctx->memory;
+    worker->out.length = 0;
+    worker->current_token = -1;
+    worker->error_count = 0;
+    worker->warning_count = 0;
+    worker->body_failed = false;
+    stats_begin(worker, ctx->phase_clock.stats != NULL ? &worker->body_stats : NULL, NULL);
+    return worker;
+}
+
+// Solta o que o contexto de corpo só empresta do contexto do arquivo
+static void release_body_worker(AnalysisContext *worker) {
+    worker->tokens = NULL;
+    worker->token_count = 0;
+    worker->token_kinds = NULL;
+    worker->spans = NULL;
+    worker->bracket_match = NULL;
+    worker->command_nodes = NULL;
+    free_analysis_context(worker);
+}
+
+static void validate_function_body(AnalysisContext *worker, FunctionBody *body) {
+    worker->visible_symbols = body->visible;
+    worker->symbol_table.current_scope = body->scope;
+    while (body->params != NULL) {
+        Symbol *param = body->params;
+        body->params = param->next;
+        insert_symbol(worker, param);
+    }
+    worker->function_scope_count = 0;
+    open_function_scope(worker, body->open, body->close, body->line);
+    classify_tokens(worker, body->open, body->close + 1, body->line);
+    // A '}' do corpo pode ter sido engolida por um comando
+    leave_function_scope(worker, body->scope);
+    worker->function_scope_count = 0;
+}
+
+// Valida corpos ainda não pegos até acabarem. Estourar o limite de memória
+// volta para cá, e o contexto do arquivo relata depois.
+static void run_function_bodies(AnalysisContext *worker) {
+    AnalysisContext *ctx = worker->owner;
+    jmp_buf memory_error;
+    worker->memory_error = &memory_error;
+    if (setjmp(memory_error) != 0) {
+        worker->body_failed = true;
+        worker->memory_error = NULL;
+        stats_phase(worker, PHASE_IDLE);
+        return;
+    }
+    stats_phase(worker, PHASE_CLASSIFY);
+    for (;;) {
+        int b = __atomic_fetch_add(&ctx->next_body, 1, __ATOMIC_RELAXED);
+        if (b >= ctx->body_count || analysis_cancelled(worker)) break;
+        FunctionBody *body = &ctx->bodies[b];
+        body->worker = worker;
+        body->out_start = worker->out.length;
+        body->out_end = worker->out.length;
+        validate_function_body(worker, body);
+        body->out_end = worker->out.length;
+    }
+    worker->memory_error = NULL;
+    stats_phase(worker, PHASE_IDLE);
+}
+
+static void* function_body_thread(void *arg) {
+    run_function_bodies(arg);
+    return NULL;
+}
+
+// Junta duas listas de chamadas pendentes, cada uma do token mais recente
+// para o mais antigo, como add_pending_function_call() as monta
+static PendingFunctionCall* merge_pending_calls(PendingFunctionCall *a, PendingFunctionCall *b) {
+    PendingFunctionCall head;
+    PendingFunctionCall *tail = &head;
+    while (a != NULL && b != NULL) {
+        if (a->token_index > b->token_index) {
+            tail->next = a;
+            a = a->next;
+        } else {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = a != NULL ? a : b;
+    return head.next;
+}
+
+// Valida os corpos separados por classify_tokens() e junta os resultados no
+// contexto do arquivo
+static void validate_function_bodies(AnalysisContext *ctx) {
+    if (ctx->body_count == 0) return;
+    
+    int jobs = ctx->function_jobs > 1 ? ctx->function_jobs : 1;
+    if (jobs > ctx->body_count) jobs = ctx->body_count;
+    long long body_tokens = 0;
+    for (int b = 0; b < ctx->body_count; b++) {
+        body_tokens += ctx->bodies[b].close - ctx->bodies[b].open + 1;
+    }
+    if (body_tokens < FUNCTION_BODY_MIN_TOKENS) jobs = 1;
+    
+    size_t memory_before = ctx->memory;
+    for (int w = 0; w < jobs; w++) {
+        prepare_body_worker(ctx, w);
+    }
+    ctx->next_body = 0;
+    // Enquanto os corpos são validados, quem mede são os contextos de corpo
+    Phase outer = stats_phase(ctx, PHASE_IDLE);
+    pthread_t *threads = jobs > 1 ? malloc((jobs - 1) * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    while (threads != NULL && started < jobs - 1 &&
+           pthread_create(&threads[started], NULL, function_body_thread, ctx->body_workers[started + 1]) == 0) {
+        started++;
+    }
+    run_function_bodies(ctx->body_workers[0]);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    stats_phase(ctx, outer);
+    
+    // Relatório: o trecho de cada corpo entra onde a passada principal o pulou
+    size_t total = ctx->out.length;
+    for (int b = 0; b < ctx->body_count; b++) {
+        total += ctx->bodies[b].out_end - ctx->bodies[b].out_start;
+    }
+    if (total > ctx->out.length) {
+        ReportBuffer merged = {0};
+        merged.owner = ctx;
+        report_reserve(&merged, total);
+        size_t copied = 0;
+        for (int b = 0; b < ctx->body_count; b++) {
+            FunctionBody *body = &ctx->bodies[b];
+            report_append(&merged, ctx->out.data + copied, body->insert_at - copied);
+            copied = body->insert_at;
+            if (body->out_end > body->out_start) {
+                report_append(&merged, body->worker->out.data + body->out_start, body->out_end - body->out_start);
+            }
+        }
+        report_append(&merged, ctx->out.data + copied, ctx->out.length - copied);
+        free(ctx->out.data);
+        ctx->out = merged;
+    }
+    
+    // Corpos que não chegaram a ser validados (análise cancelada)
+    for (int b = 0; b < ctx->body_count; b++) {
+        while (ctx->bodies[b].params != NULL) {
+            Symbol *param = ctx->bodies[b].params;
+            ctx->bodies[b].params = param->next;
+            free_symbol(param);
+        }
+    }
+    
+    bool failed = false;
+    for (int w = 0; w < jobs; w++) {
+        AnalysisContext *worker = ctx->body_workers[w];
+        ReportBuffer *text = &ctx->diagnostic_text;
+        for (int d = 0; d < worker->diagnostic_count; d++) {
+            DiagnosticRecord *record = &worker->diagnostics[d];
+            report_reserve(text, record->args_length);
+            memcpy(text->data + text->length, worker->diagnostic_text.data + record->args, record->args_length);
+            DiagnosticRecord *merged = store_diagnostic(ctx, record->code, record->token, record->format, record->args_length,
+                                                        record->suggestion != NO_SUGGESTION ? worker->diagnostic_text.data + record->suggestion : NULL,
+                                                        record->count);
+            // Os escritos no relatório do corpo já estão no trecho copiado acima
+            if (merged != NULL) merged->written = record->written;
+        }
+        clear_diagnostics(worker);
+        ctx->pending_calls = merge_pending_calls(ctx->pending_calls, worker->pending_calls);
+        worker->pending_calls = NULL;
+        ctx->principal_func = ctx->principal_func || worker->principal_func;
+        ctx->memory += worker->memory - memory_before;
+        failed = failed || worker->body_failed;
+        if (ctx->phase_clock.stats != NULL) {
+            stats_add(ctx->phase_clock.stats, &worker->body_stats);
+        }
+    }
+    ctx->body_count = 0;
+    if (failed || ctx->memory > MAX_MEMORY) {
+        analysis_out_of_memory(ctx);
+    }
+}
+
+// Segunda etapa: classificação dos tokens, verificações finais e fim do
+// relatório, sobre os tokens que analysis_lex() deixou no contexto
+static void analysis_check(AnalysisContext *ctx, const char *path) {
+    char **tokens = ctx->tokens;
+    int length = ctx->token_count;
+
+    if (tokens != NULL) {    
+        stats_phase(ctx, PHASE_INDEX);
+        index_tokens(ctx);
+        parse_program(ctx);
+        resolve_names(ctx);
+        report_printf(ctx, VERBOSITY_TOKENS, "\nTotal de tokens: %d\n", length);
+        
+        report_printf(ctx, VERBOSITY_TOKENS, "\nClassificação dos tokens:\n");
+        stats_phase(ctx, PHASE_CLASSIFY);
+        ctx->function_scope_count = 0;
+        ctx->body_count = 0;
+        classify_tokens(ctx, 0, length, 1);
+        validate_function_bodies(ctx);
+
+        // As verificações abaixo informam a posição de cada diagnóstico
+        ctx->current_token = -1;
+        stats_phase(ctx, PHASE_CHECKS);
+
+        check_brackets_and_quotes(ctx);
+
+        if (!check_return_statement(ctx)) {
+            report_printf(ctx, VERBOSITY_TOKENS, "Verificação de 'retorno' falhou. Erro encontrado.\n");
+        } else {
+            report_printf(ctx, VERBOSITY_TOKENS, "Verificação de 'retorno' concluída com sucesso.\n");
+        }
+
+        // 1.10. Valida chamadas de função pendentes
+        if (!validate_pending_function_calls(ctx)) {
+            report_printf(ctx, VERBOSITY_TOKENS, "Erro na validação de chamadas de função pendentes.\n");
+        } else {
+            report_printf(ctx, VERBOSITY_TOKENS, "Validação de chamadas pendentes concluída com sucesso.\n");
+        }
+
+        // Infere tipos de parâmetros e expressões antes de imprimir a tabela
+        infer_types(ctx);
+
+        // Imprime a tabela de símbolos
+        print_symbol_table(ctx);
+
+        // Limpa chamadas pendentes
+        clear_pending_function_calls(ctx);
+
+        release_tokens(ctx);
+    }
+    flush_diagnostics(ctx);
+    report_printf(ctx, VERBOSITY_TOKENS, "\nMemória ocupada: %zu Bytes ou %.2f KB\n", ctx->memory, ctx->memory / 1024.0);
+    if (ctx->cache_dir != NULL && ctx->project == NULL && !analysis_cancelled(ctx)) {
+        result_cache_store(ctx, ctx->content_hash, ctx->content_length, ctx->body_start, length);
+    }
+    report_file_end(ctx, path, length);
+    free(ctx->content);
+    ctx->content = NULL;
+    stats_phase(ctx, PHASE_IDLE);
+}
+
+// Biblioteca: análise de conteúdos em memória, sem imprimir nada (ver
+// analyzer.h). O relatório do contexto é gerado no formato binário e os
+// iteradores leem os registros direto dele.
+
+AnalysisContext* analyzer_create(void) {
+    AnalysisContext *ctx = calloc(1, sizeof(AnalysisContext));
+    if (ctx == NULL) return NULL;
+    report_buffers_init(ctx);
+    ctx->verbosity = VERBOSITY_TOKENS;
+    ctx->format = FORMAT_BINARY;
+    return ctx;
+}
+
+void analyzer_destroy(AnalysisContext *ctx) {
+    if (ctx != NULL) free_analysis_context(ctx);
+}
+
+// Descarta o que sobrou da chamada anterior (ou de uma análise abandonada)
+static void analyzer_release(AnalysisContext *ctx) {
+    ctx->memory_error = NULL;
+    release_tokens(ctx);
+    free(ctx->content);
+    ctx->content = NULL;
+}
+
+int analyzer_lex(AnalysisContext *ctx, const char *buffer, size_t length) {
+    jmp_buf memory_error;
+    analyzer_release(ctx);
+    reset_analysis_context(ctx);
+    if (length >= MAX_MEMORY) return -1;
+    
+    ctx->memory_error = &memory_error;
+    if (setjmp(memory_error) != 0) {
+        analyzer_release(ctx);
+        return -1;
+    }
+    ctx->content = safe_malloc(ctx, length + 1);
+    memcpy(ctx->content, buffer, length);
+    ctx->content[length] = '\0';
+    
+    int count = 0;
+    string_tokens(ctx, ctx->content, &count);
+    ctx->memory_error = NULL;
+    return count;
+}
+
+bool analyzer_lexed_token(AnalysisContext *ctx, int index, AnalyzerToken *token) {
+    if (ctx->tokens == NULL || index < 0 || index >= ctx->token_count) return false;
+    TokenSpan *span = &ctx->spans[index];
+    token->text = ctx->tokens[index];
+    token->text_length = strlen(ctx->tokens[index]);
+    token->token_class = -1;
+    token->class_name = NULL;
+    token->index = index;
+    token->offset = span->offset;
+    token->length = span->length;
+    token->line = span->line;
+    return true;
+}
+
+static unsigned int read_u16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int read_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Próximo registro do tipo pedido a partir de *cursor no relatório binário
+static const unsigned char* analyzer_next_record(AnalyzerResult *result, size_t *cursor, RecordType type) {
+    const unsigned char *data = (const unsigned char *)result->ctx->out.data;
+    size_t length = result->ctx->out.length;
+    while (*cursor + 5 <= length) {
+        const unsigned char *record = data + *cursor;
+        *cursor += 4 + read_u32(record);
+        if (record[4] == type) return record + 5;
+    }
+    return NULL;
+}
+
+int analyzer_analyze(AnalysisContext *ctx, const char *buffer, size_t length, AnalyzerResult *result) {
+    jmp_buf memory_error;
+    analyzer_release(ctx);
+    memset(result, 0, sizeof(*result));
+    result->ctx = ctx;
+    result->content = buffer;
+    if (length >= MAX_MEMORY) return -1;
+    
+    ctx->memory_error = &memory_error;
+    if (setjmp(memory_error) != 0) {
+        analyzer_release(ctx);
+        ctx->out.length = 0;
+        return -1;
+    }
+    analyze_buffer(ctx, "", buffer, length);
+    ctx->memory_error = NULL;
+    
+    size_t cursor = 0;
+    const unsigned char *end = analyzer_next_record(result, &cursor, RECORD_FILE_END);
+    if (end != NULL) result->token_count = read_u32(end);
+    result->error_count = ctx->error_count;
+    result->warning_count = ctx->warning_count;
+    return 0;
+}
+
+bool analyzer_next_token(AnalyzerResult *result, AnalyzerToken *token) {
+    const unsigned char *p = analyzer_next_record(result, &result->token_cursor, RECORD_TOKEN);
+    if (p == NULL) return false;
+    token->index = read_u32(p);
+    token->token_class = read_u16(p + 4);
+    token->class_name = token->token_class < NUM_TOKEN_CLASSES ? TOKEN_CLASS_NAMES[token->token_class] : NULL;
+    token->offset = read_u32(p + 6);
+    token->length = read_u32(p + 10);
+    token->line = read_u32(p + 14);
+    token->text = result->content + token->offset;
+    token->text_length = token->length;
+    return true;
+}
+
+bool analyzer_next_diagnostic(AnalyzerResult *result, AnalyzerDiagnostic *diagnostic) {
+    const unsigned char *p = analyzer_next_record(result, &result->diagnostic_cursor, RECORD_DIAGNOSTIC);
+    if (p == NULL) return false;
+    unsigned int code = read_u16(p);
+    diagnostic->code = code < NUM_DIAGNOSTIC_CODES ? DIAGNOSTIC_INFO[code].id : NULL;
+    diagnostic->is_warning = p[2] == SEVERITY_WARNING;
+    diagnostic->token = (int)read_u32(p + 3);
+    diagnostic->offset = read_u32(p + 7);
+    diagnostic->length = read_u32(p + 11);
+    diagnostic->line = read_u32(p + 15);
+    diagnostic->suggestion_length = read_u16(p + 19);
+    diagnostic->suggestion = diagnostic->suggestion_length > 0 ? (const char *)p + 21 : NULL;
+    p += 21 + diagnostic->suggestion_length;
+    diagnostic->message_length = read_u32(p);
+    diagnostic->message = (const char *)p + 4;
+    return true;
+}
+
+// Símbolos que ficaram na tabela ao fim da análise, na ordem de declaração
+bool analyzer_next_symbol(AnalyzerResult *result, AnalyzerSymbol *symbol) {
+    SymbolTable *table = &result->ctx->symbol_table;
+    if (result->symbol_cursor >= table->trail_top) return false;
+    Symbol *current = table->trail[result->symbol_cursor++];
+    symbol->name = current->name;
+    symbol->kind = symbol_type_to_string(current->symbol_type);
+    symbol->data_type = data_type_to_string(current->data_type);
+    symbol->scope_level = current->scope_level;
+    symbol->line = current->line_declared;
+    symbol->used = symbol_used(result->ctx, current);
+    symbol->param_count = current->param_count;
+    return true;
+}
+
+// Custo fixo estimado por arquivo (abertura, leitura, cabeçalho do relatório),
+// somado ao tamanho em bytes para que arquivos vazios não custem zero
+#define FILE_BASE_COST 4096
+// Quantos relatórios prontos podem ficar aguardando a vez de serem escritos.
+// Sem --window, a janela cresce até MAX_REORDER_WINDOW conforme a ordem de
+// análise do lote (veja reorder_window_size).
+#define DEFAULT_REORDER_WINDOW 64
+#define MAX_REORDER_WINDOW 4096
+
+// Ordem em que os relatórios dos arquivos são escritos
+typedef enum {
+    ORDER_INPUT, // Ordem em que os arquivos foram listados
+    ORDER_PATH   // Ordem alfabética do caminho
+} OutputOrder;
+
+// Arquivo de entrada do lote
+typedef struct BatchFile {
+    char *path;
+    long long size;
+    int order;   // Posição do relatório na saída
+    int claimed; // Já foi pego por alguma thread (acesso atômico)
+} BatchFile;
+
+// Fila de uma thread de trabalho. O dono consome pela frente (maiores
+// primeiro); as outras threads roubam pelo fim.
+typedef struct WorkerQueue {
+    int *items; // Índices em BatchScheduler.files
+    int head;
+    int tail;
+    long long remaining_cost;
+    pthread_mutex_t lock;
+} WorkerQueue;
+
+// Janela de reordenação: guarda os relatórios que terminaram fora de ordem
+// até que todos os anteriores tenham sido escritos. No máximo `window`
+// relatórios ficam guardados, além de um por thread aguardando espaço.
+typedef struct ReorderWindow {
+    char **reports;
+    size_t *sizes;
+    bool *ready;
+    int window;
+    int next_commit; // Próxima posição da saída a ser escrita
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+} ReorderWindow;
+
+// Como os arquivos do lote são lidos
+typedef enum {
+    READER_NONE,  // Cada thread de trabalho lê os seus arquivos com read_file()
+    READER_PREAD, // Thread de leitura antecipada com open + pread + close
+    READER_URING  // Thread de leitura antecipada com io_uring
+} ReaderMode;
+
+typedef enum {
+    PREFETCH_PENDING, // Ainda não lido (ou a leitura falhou)
+    PREFETCH_LOADING, // Sendo lido pela thread de leitura
+    PREFETCH_READY,   // Lido, esperando uma thread de trabalho
+    PREFETCH_TAKEN    // Já entregue a uma thread de trabalho
+} PrefetchState;
+
+// Filas do io_uring mapeadas na memória
+typedef struct UringQueue {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} UringQueue;
+
+typedef struct Prefetcher {
+    ReaderMode mode;
+    PrefetchState *state; // Por índice em BatchScheduler.files
+    char **buffers;
+    long long *sizes;
+    long long *read_time; // Parte de cada arquivo no tempo de leitura do lote, com --stats
+    int ready_count; // Arquivos lidos que ainda não foram pegos
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+    UringQueue ring;
+} Prefetcher;
+
+typedef struct BatchScheduler {
+    BatchFile *files;
+    int count;
+    int *by_order; // Posição na saída -> índice em files
+    WorkerQueue *queues;
+    int num_workers;
+    ReorderWindow output;
+    Prefetcher prefetch;
+    int total_errors;
+    int total_warnings;
+    FileStats *stats; // Por posição na saída, com --stats; senão NULL
+} BatchScheduler;
+
+typedef struct WorkerArgs {
+    BatchScheduler *scheduler;
+    AnalysisContext *ctx; // Contexto da thread, mantido entre lotes
+    int id;
+} WorkerArgs;
+
+static long long batch_file_cost(const BatchFile *file) {
+    return file->size + FILE_BASE_COST;
+}
+
+static int compare_batch_size_desc(const void *a, const void *b) {
+    const BatchFile *fa = a;
+    const BatchFile *fb = b;
+    if (fa->size != fb->size) return fa->size < fb->size ? 1 : -1;
+    return fa->order - fb->order;
+}
+
+static int compare_batch_path(const void *a, const void *b) {
+    const BatchFile *fa = a;
+    const BatchFile *fb = b;
+    return strcmp(fa->path, fb->path);
+}
+
+// Marca o arquivo como pego; falha se outra thread já o pegou
+static bool batch_file_claim(BatchFile *file) {
+    int expected = 0;
+    return __atomic_compare_exchange_n(&file->claimed, &expected, 1, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Janela para um lote analisado do maior para o menor: simulando essa ordem,
+// a maior distância na saída entre um arquivo que fica pronto e o primeiro
+// que ainda não ficou, mais uma folga por thread. Com uma janela menor, as
+// threads passam a analisar o arquivo que bloqueia a saída, na ordem de
+// entrada, e perdem o equilíbrio de carga justo nos lotes desiguais.
+static int reorder_window_size(const BatchFile *files, int count, int num_workers) {
+    bool *done = calloc(count > 0 ? count : 1, sizeof(bool));
+    if (done == NULL) return DEFAULT_REORDER_WINDOW;
+    int first = 0;
+    int spread = 0;
+    for (int i = 0; i < count; i++) {
+        if (files[i].order - first + 1 > spread) spread = files[i].order - first + 1;
+        done[files[i].order] = true;
+        while (first < count && done[first]) first++;
+    }
+    free(done);
+    int window = spread + num_workers;
+    if (window < DEFAULT_REORDER_WINDOW) window = DEFAULT_REORDER_WINDOW;
+    if (window > MAX_REORDER_WINDOW) window = MAX_REORDER_WINDOW;
+    return window;
+}
+
+// Define a ordem da saída e distribui os arquivos, do maior para o menor,
+// sempre para a fila com menor custo acumulado (LPT). Cada fila fica
+// ordenada do maior para o menor.
+static void batch_scheduler_init(BatchScheduler *scheduler, BatchFile *files, int count,
+                                 int num_workers, OutputOrder output_order, int window) {
+    scheduler->total_errors = 0;
+    scheduler->total_warnings = 0;
+    scheduler->files = files;
+    scheduler->count = count;
+    scheduler->num_workers = num_workers;
+    scheduler->queues = calloc(num_workers, sizeof(WorkerQueue));
+    
+    if (output_order == ORDER_PATH) {
+        qsort(files, count, sizeof(BatchFile), compare_batch_path);
+    }
+    for (int i = 0; i < count; i++) {
+        files[i].order = i;
+        files[i].claimed = 0;
+    }
+    
+    qsort(files, count, sizeof(BatchFile), compare_batch_size_desc);
+    
+    scheduler->by_order = malloc((count > 0 ? count : 1) * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        scheduler->by_order[files[i].order] = i;
+    }
+    
+    for (int w = 0; w < num_workers; w++) {
+        scheduler->queues[w].items = malloc((count > 0 ? count : 1) * sizeof(int));
+        pthread_mutex_init(&scheduler->queues[w].lock, NULL);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        WorkerQueue *target = &scheduler->queues[0];
+        for (int w = 1; w < num_workers; w++) {
+            if (scheduler->queues[w].remaining_cost < target->remaining_cost) {
+                target = &scheduler->queues[w];
+            }
+        }
+        target->items[target->tail++] = i;
+        target->remaining_cost += batch_file_cost(&files[i]);
+    }
+    
+    ReorderWindow *output = &scheduler->output;
+    output->window = window > 0 ? window : reorder_window_size(files, count, num_workers);
+    output->reports = calloc(output->window, sizeof(char*));
+    output->sizes = calloc(output->window, sizeof(size_t));
+    output->ready = calloc(output->window, sizeof(bool));
+    output->next_commit = 0;
+    pthread_mutex_init(&output->lock, NULL);
+    pthread_cond_init(&output->space, NULL);
+}
+
+static void batch_scheduler_destroy(BatchScheduler *scheduler) {
+    for (int w = 0; w < scheduler->num_workers; w++) {
+        free(scheduler->queues[w].items);
+        pthread_mutex_destroy(&scheduler->queues[w].lock);
+    }
+    free(scheduler->queues);
+    free(scheduler->by_order);
+    
+    ReorderWindow *output = &scheduler->output;
+    free(output->reports);
+    free(output->sizes);
+    free(output->ready);
+    pthread_mutex_destroy(&output->lock);
+    pthread_cond_destroy(&output->space);
+}
+
+// Retira um item da fila, pela frente ou pelo fim, ignorando arquivos que
+// já foram pegos por outra thread. Deve ser chamada com o lock da fila.
+static int worker_queue_take(BatchScheduler *scheduler, WorkerQueue *queue, bool from_front) {
+    while (queue->head < queue->tail) {
+        int index = from_front ? queue->items[queue->head++] : queue->items[--queue->tail];
+        __atomic_store_n(&queue->remaining_cost,
+                         queue->remaining_cost - batch_file_cost(&scheduler->files[index]),
+                         __ATOMIC_RELAXED);
+        if (batch_file_claim(&scheduler->files[index])) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// Pega o próximo arquivo da própria fila ou rouba da fila com mais trabalho
+// restante. Retorna -1 quando não há mais nada a fazer.
+static int batch_scheduler_next(BatchScheduler *scheduler, int worker_id) {
+    WorkerQueue *own = &scheduler->queues[worker_id];
+    
+    pthread_mutex_lock(&own->lock);
+    int index = worker_queue_take(scheduler, own, true);
+    pthread_mutex_unlock(&own->lock);
+    if (index != -1) return index;
+    
+    while (true) {
+        // A leitura de remaining_cost sem lock é só uma estimativa para
+        // escolher a vítima; a retirada em si é feita com lock
+        int victim = -1;
+        long long victim_cost = 0;
+        for (int w = 0; w < scheduler->num_workers; w++) {
+            if (w == worker_id) continue;
+            long long cost = __atomic_load_n(&scheduler->queues[w].remaining_cost, __ATOMIC_RELAXED);
+            if (cost > victim_cost) {
+                victim_cost = cost;
+                victim = w;
+            }
+        }
+        if (victim == -1) return -1;
+        
+        WorkerQueue *queue = &scheduler->queues[victim];
+        pthread_mutex_lock(&queue->lock);
+        index = worker_queue_take(scheduler, queue, false);
+        if (index == -1) {
+            // A fila esvaziou enquanto escolhíamos: zera o custo e tenta outra
+            __atomic_store_n(&queue->remaining_cost, 0, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (index != -1) return index;
+    }
+}
+
+// Leitura antecipada: uma thread lê os próximos arquivos do lote enquanto
+// as threads de trabalho analisam, em lotes de até PREFETCH_BATCH arquivos
+// por vez. Com io_uring as aberturas, leituras e fechamentos de um lote
+// inteiro saem em uma chamada de sistema cada; sem io_uring cada arquivo
+// custa open + pread + close, contra os cinco passos de read_file().
+#define PREFETCH_BATCH 32
+// Máximo de arquivos lidos esperando uma thread de trabalho
+#define PREFETCH_WINDOW 64
+
+// Submete as entradas preenchidas e espera todas terminarem. Os resultados
+// vão para results[user_data].
+static bool uring_submit_and_wait(UringQueue *ring, int count, int *results) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + count, __ATOMIC_RELEASE);
+    int submitted = 0;
+    int completed = 0;
+    while (completed < count) {
+        int to_submit = count - submitted;
+        int ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        submitted += ret;
+        
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            results[cqe->user_data] = cqe->res;
+            head++;
+            completed++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+// Próxima entrada livre da fila de submissão, já zerada
+static struct io_uring_sqe* uring_next_sqe(UringQueue *ring, int position) {
+    unsigned index = (*ring->sq_tail + position) & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+static void uring_destroy(UringQueue *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static bool uring_init(UringQueue *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, PREFETCH_BATCH, &params);
+    if (ring->fd < 0) return false;
+    
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring :
+                    mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uring_destroy(ring);
+        return false;
+    }
+    
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Completa com pread uma leitura que voltou curta, até o tamanho do stat ou
+// o fim do arquivo. A primeira leitura pede um byte a mais: `done` maior que
+// `size` é um arquivo que cresceu, e menor, um que encolheu. Devolve -1 em
+// caso de erro.
+static long long read_rest(int fd, char *buffer, long long done, long long size) {
+    while (done >= 0 && done < size) {
+        ssize_t n = pread(fd, buffer + done, size + 1 - done, done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+// Lê um lote com io_uring: todas as aberturas, depois todas as leituras e
+// por fim todos os fechamentos. Cada arquivo é lido com um byte a mais que
+// o tamanho conhecido para perceber se ele cresceu desde a listagem.
+// Devolve false se o kernel não aceita as operações.
+static bool prefetch_read_uring(Prefetcher *prefetch, BatchFile **files, int count, char **buffers, long long *sizes) {
+    UringQueue *ring = &prefetch->ring;
+    int fds[PREFETCH_BATCH];
+    int results[PREFETCH_BATCH];
+    
+    for (int i = 0; i < count; i++) {
+        struct io_uring_sqe *sqe = uring_next_sqe(ring, i);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)files[i]->path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = i;
+    }
+    if (!uring_submit_and_wait(ring, count, fds)) return false;
+    // Kernel sem IORING_OP_OPENAT: as outras entradas podem ter aberto
+    if (fds[0] == -EINVAL) {
+        for (int i = 1; i < count; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+        return false;
+    }
+    
+    int reads = 0;
+    int read_index[PREFETCH_BATCH];
+    for (int i = 0; i < count; i++) {
+        if (fds[i] < 0) continue;
+        buffers[i] = malloc(files[i]->size + 2);
+        if (buffers[i] == NULL) continue;
+        struct io_uring_sqe *sqe = uring_next_sqe(ring, reads);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fds[i];
+        sqe->addr = (unsigned long)buffers[i];
+        sqe->len = files[i]->size + 1;
+        sqe->off = 0;
+        sqe->user_data = reads;
+        read_index[reads++] = i;
+    }
+    if (reads > 0 && !uring_submit_and_wait(ring, reads, results)) {
+        for (int i = 0; i < count; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+        return false;
+    }
+    for (int r = 0; r < reads; r++) {
+        int i = read_index[r];
+        sizes[i] = read_rest(fds[i], buffers[i], results[r], files[i]->size);
+    }
+    
+    int closes = 0;
+    for (int i = 0; i < count; i++) {
+        if (fds[i] < 0) continue;
+        struct io_uring_sqe *sqe = uring_next_sqe(ring, closes);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = closes++;
+    }
+    if (closes > 0 && !uring_submit_and_wait(ring, closes, results)) {
+        for (int i = 0; i < count; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+    }
+    return true;
+}
+
+static void prefetch_read_pread(BatchFile **files, int count, char **buffers, long long *sizes) {
+    for (int i = 0; i < count; i++) {
+        int fd = open(files[i]->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        buffers[i] = malloc(files[i]->size + 2);
+        if (buffers[i] != NULL) {
+            sizes[i] = read_rest(fd, buffers[i], 0, files[i]->size);
+        }
+        close(fd);
+    }
+}
+
+static void* prefetch_reader(void *arg) {
+    BatchScheduler *scheduler = arg;
+    Prefetcher *prefetch = &scheduler->prefetch;
+    ReaderMode mode = prefetch->mode; // Só esta thread rebaixa o modo para pread
+    int next = 0;
+    
+    while (next < scheduler->count) {
+        int batch[PREFETCH_BATCH];
+        BatchFile *files[PREFETCH_BATCH];
+        int count = 0;
+        
+        pthread_mutex_lock(&prefetch->lock);
+        while (prefetch->ready_count >= PREFETCH_WINDOW) {
+            pthread_cond_wait(&prefetch->changed, &prefetch->lock);
+        }
+        int room = PREFETCH_WINDOW - prefetch->ready_count;
+        if (room > PREFETCH_BATCH) room = PREFETCH_BATCH;
+        // Arquivos já pegos por uma thread ou grandes demais para a análise ficam de fora
+        while (next < scheduler->count && count < room) {
+            BatchFile *file = &scheduler->files[next];
+            if (prefetch->state[next] == PREFETCH_PENDING && file->size < MAX_MEMORY) {
+                prefetch->state[next] = PREFETCH_LOADING;
+                files[count] = file;
+                batch[count++] = next;
+            }
+            next++;
+        }
+        pthread_mutex_unlock(&prefetch->lock);
+        if (count == 0) continue;
+        
+        char *buffers[PREFETCH_BATCH] = {0};
+        long long sizes[PREFETCH_BATCH];
+        for (int i = 0; i < count; i++) sizes[i] = -1;
+        long long started = scheduler->stats != NULL ? monotonic_ns() : 0;
+        if (mode == READER_URING && !prefetch_read_uring(prefetch, files, count, buffers, sizes)) {
+            // Kernel sem as operações necessárias: daqui em diante vai com pread
+            mode = READER_PREAD;
+            for (int i = 0; i < count; i++) {
+                free(buffers[i]);
+                buffers[i] = NULL;
+                sizes[i] = -1;
+            }
+        }
+        if (mode == READER_PREAD) {
+            prefetch_read_pread(files, count, buffers, sizes);
+        }
+        // As leituras de um lote se sobrepõem: o tempo do lote é dividido
+        // entre os arquivos pelo custo de cada um
+        long long elapsed = 0;
+        long long batch_cost = 0;
+        if (scheduler->stats != NULL) {
+            elapsed = monotonic_ns() - started;
+            for (int i = 0; i < count; i++) batch_cost += batch_file_cost(files[i]);
+        }
+        
+        // Arquivos que falharam ou mudaram de tamanho desde o stat voltam para
+        // a thread de trabalho
+        pthread_mutex_lock(&prefetch->lock);
+        for (int i = 0; i < count; i++) {
+            int index = batch[i];
+            if (buffers[i] != NULL && sizes[i] == files[i]->size) {
+                buffers[i][sizes[i]] = '\0';
+                prefetch->buffers[index] = buffers[i];
+                prefetch->sizes[index] = sizes[i];
+                if (batch_cost > 0) {
+                    prefetch->read_time[index] = elapsed * batch_file_cost(files[i]) / batch_cost;
+                }
+                prefetch->state[index] = PREFETCH_READY;
+                prefetch->ready_count++;
+            } else {
+                free(buffers[i]);
+                prefetch->state[index] = PREFETCH_PENDING;
+            }
+        }
+        pthread_cond_broadcast(&prefetch->changed);
+        pthread_mutex_unlock(&prefetch->lock);
+    }
+    return NULL;
+}
+
+static void prefetch_start(BatchScheduler *scheduler, ReaderMode mode) {
+    Prefetcher *prefetch = &scheduler->prefetch;
+    memset(prefetch, 0, sizeof(*prefetch));
+    prefetch->ring.fd = -1;
+    prefetch->mode = mode;
+    if (mode == READER_NONE || scheduler->count == 0) {
+        prefetch->mode = READER_NONE;
+        return;
+    }
+    if (mode == READER_URING && !uring_init(&prefetch->ring)) {
+        prefetch->mode = READER_PREAD;
+    }
+    
+    prefetch->state = calloc(scheduler->count, sizeof(PrefetchState));
+    prefetch->buffers = calloc(scheduler->count, sizeof(char*));
+    prefetch->sizes = calloc(scheduler->count, sizeof(long long));
+    prefetch->read_time = calloc(scheduler->count, sizeof(long long));
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_cond_init(&prefetch->changed, NULL);
+    pthread_create(&prefetch->thread, NULL, prefetch_reader, scheduler);
+}
+
+static void prefetch_stop(BatchScheduler *scheduler) {
+    Prefetcher *prefetch = &scheduler->prefetch;
+    if (prefetch->mode == READER_NONE) return;
+    pthread_join(prefetch->thread, NULL);
+    
+    for (int i = 0; i < scheduler->count; i++) {
+        free(prefetch->buffers[i]);
+    }
+    free(prefetch->state);
+    free(prefetch->buffers);
+    free(prefetch->sizes);
+    free(prefetch->read_time);
+    pthread_mutex_destroy(&prefetch->lock);
+    pthread_cond_destroy(&prefetch->changed);
+    uring_destroy(&prefetch->ring);
+}
+
+// Conteúdo já lido de um arquivo, ou NULL se a thread deve ler sozinha. Um
+// arquivo que está sendo lido neste momento é esperado. Em *read_time vai a
+// parte do arquivo no tempo de leitura da thread de leitura.
+static char* prefetch_take(BatchScheduler *scheduler, int index, long long *size, long long *read_time) {
+    Prefetcher *prefetch = &scheduler->prefetch;
+    if (prefetch->mode == READER_NONE) return NULL;
+    
+    pthread_mutex_lock(&prefetch->lock);
+    while (prefetch->state[index] == PREFETCH_LOADING) {
+        pthread_cond_wait(&prefetch->changed, &prefetch->lock);
+    }
+    char *content = NULL;
+    if (prefetch->state[index] == PREFETCH_READY) {
+        content = prefetch->buffers[index];
+        *size = prefetch->sizes[index];
+        *read_time = prefetch->read_time[index];
+        prefetch->buffers[index] = NULL;
+        prefetch->ready_count--;
+        pthread_cond_broadcast(&prefetch->changed);
+    }
+    prefetch->state[index] = PREFETCH_TAKEN;
+    pthread_mutex_unlock(&prefetch->lock);
+    return content;
+}
+
+// Relatório de um arquivo cuja análise passou do limite de memória: o que
+// já tinha sido escrito é descartado e fica só o erro
+static void report_out_of_memory(AnalysisContext *ctx, const char *path) {
+    analyzer_release(ctx);
+    stats_phase(ctx, PHASE_IDLE);
+    reset_analysis_context(ctx);
+    report_file_begin(ctx, path);
+    report_diagnostic(ctx, DIAG_IO_ERROR, -1, NULL, "ERRO: Memória Insuficiente");
+    report_file_end(ctx, path, 0);
+}
+
+// Analisa um arquivo do lote. Estourar o limite de memória num arquivo não
+// termina o processo: o arquivo sai com um relatório de erro no seu lugar e
+// os relatórios prontos na janela de reordenação continuam valendo.
+static void run_batch_file(BatchScheduler *scheduler, AnalysisContext *ctx, BatchFile *file) {
+    jmp_buf memory_error;
+    stats_begin(ctx, scheduler->stats != NULL ? &scheduler->stats[file->order] : NULL, file->path);
+    long long size = 0;
+    long long read_time = 0;
+    char *content = prefetch_take(scheduler, file - scheduler->files, &size, &read_time);
+    // A leitura antecipada não passa por read_file(): só o tempo dela entra
+    // na fase, sem os contadores de hardware, que são da thread de leitura
+    if (content != NULL && ctx->phase_clock.stats != NULL) {
+        ctx->phase_clock.stats->phases[PHASE_READ].nanoseconds += read_time;
+    }
+    ctx->memory_error = &memory_error;
+    if (setjmp(memory_error) != 0) {
+        report_out_of_memory(ctx, file->path);
+    } else if (content != NULL) {
+        analyze_loaded_file(ctx, file->path, content, size);
+    } else {
+        analyze_file(ctx, file->path);
+    }
+    ctx->memory_error = NULL;
+    __atomic_add_fetch(&scheduler->total_errors, ctx->error_count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&scheduler->total_warnings, ctx->warning_count, __ATOMIC_RELAXED);
+}
+
+static char* copy_report(const char *report, size_t report_size) {
+    char *copy = malloc(report_size > 0 ? report_size : 1);
+    if (copy == NULL) {
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    memcpy(copy, report, report_size);
+    return copy;
+}
+
+// Entrega o relatório de um arquivo à janela de reordenação e escreve em
+// stdout todos os relatórios que já estão na vez. Um relatório que já está
+// na vez é escrito direto do buffer do contexto; os outros são copiados
+// para a janela. Se a posição do relatório está além da janela, a thread
+// ajuda analisando o arquivo que está bloqueando a saída (quando ninguém o
+// pegou ainda) ou espera abrir espaço.
+static void commit_report(BatchScheduler *scheduler, AnalysisContext *ctx, int order,
+                          const char *report, size_t report_size) {
+    ReorderWindow *output = &scheduler->output;
+    char *held = NULL;
+    
+    pthread_mutex_lock(&output->lock);
+    while (order >= output->next_commit + output->window) {
+        BatchFile *blocking = &scheduler->files[scheduler->by_order[output->next_commit]];
+        if (batch_file_claim(blocking)) {
+            pthread_mutex_unlock(&output->lock);
+            // O buffer do contexto vai ser reutilizado: guarda uma cópia
+            if (held == NULL) {
+                held = copy_report(report, report_size);
+                report = held;
+            }
+            run_batch_file(scheduler, ctx, blocking);
+            commit_report(scheduler, ctx, blocking->order, ctx->out.data, ctx->out.length);
+            pthread_mutex_lock(&output->lock);
+            continue;
+        }
+        pthread_cond_wait(&output->space, &output->lock);
+    }
+    
+    if (order != output->next_commit) {
+        int slot = order % output->window;
+        output->reports[slot] = held != NULL ? held : copy_report(report, report_size);
+        output->sizes[slot] = report_size;
+        output->ready[slot] = true;
+        pthread_mutex_unlock(&output->lock);
+        return;
+    }
+    
+    fwrite(report, 1, report_size, stdout);
+    free(held);
+    output->next_commit++;
+    
+    while (output->ready[output->next_commit % output->window]) {
+        int slot = output->next_commit % output->window;
+        fwrite(output->reports[slot], 1, output->sizes[slot], stdout);
+        free(output->reports[slot]);
+        output->reports[slot] = NULL;
+        output->ready[slot] = false;
+        output->next_commit++;
+    }
+    pthread_cond_broadcast(&output->space);
+    pthread_mutex_unlock(&output->lock);
+}
+
+static void* analysis_worker(void *arg) {
+    WorkerArgs *args = arg;
+    BatchScheduler *scheduler = args->scheduler;
+    AnalysisContext *ctx = args->ctx;
+    
+    int index;
+    while ((index = batch_scheduler_next(scheduler, args->id)) != -1) {
+        run_batch_file(scheduler, ctx, &scheduler->files[index]);
+        commit_report(scheduler, ctx, scheduler->files[index].order, ctx->out.data, ctx->out.length);
+    }
+    return NULL;
+}
+
+// Um contexto por thread, criados uma vez e reaproveitados por todas as análises
+static AnalysisContext** create_context_pool(int pool_size, Verbosity verbosity, OutputFormat format,
+                                             const char *cache_dir, int max_errors, int max_diagnostics,
+                                             int function_jobs) {
+    AnalysisContext **contexts = malloc(pool_size * sizeof(AnalysisContext*));
+    for (int w = 0; contexts != NULL && w < pool_size; w++) {
+        contexts[w] = calloc(1, sizeof(AnalysisContext));
+        if (contexts[w] == NULL) {
+            contexts = NULL;
+            break;
+        }
+        report_buffers_init(contexts[w]);
+        contexts[w]->verbosity = verbosity;
+        contexts[w]->format = format;
+        contexts[w]->cache_dir = cache_dir;
+        contexts[w]->max_errors = max_errors;
+        contexts[w]->max_diagnostics = max_diagnostics;
+        contexts[w]->function_jobs = function_jobs;
+    }
+    if (contexts == NULL) {
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    return contexts;
+}
+
+// Opções que valem para todos os lotes de uma execução
+typedef struct BatchOptions {
+    OutputOrder output_order;
+    int window;
+    Verbosity verbosity;
+    OutputFormat format;
+    ReaderMode reader;
+    int max_errors;
+    int max_diagnostics;
+    int function_jobs;
+    ProjectIndex *project; // Índice do modo projeto, ou NULL
+    bool stats;            // Mede as fases de cada arquivo (--stats)
+} BatchOptions;
+
+// Linha de totais do relatório resumido
+static void print_batch_total(const BatchOptions *options, int count, int total_errors, int total_warnings) {
+    if (options->verbosity == VERBOSITY_SUMMARY && options->format == FORMAT_TEXT) {
+        printf("Total: %d arquivos, %d erros, %d avisos\n", count, total_errors, total_warnings);
+    }
+}
+
+// Números grandes com sufixo: 1.5K, 2.3M, 4.0G
+static void format_count(char *text, size_t size, double value) {
+    const char *suffixes = " KMGT";
+    int s = 0;
+    while (value >= 1000 && s < 4) {
+        value /= 1000;
+        s++;
+    }
+    if (s == 0) {
+        snprintf(text, size, "%.0f", value);
+    } else {
+        snprintf(text, size, "%.1f%c", value, suffixes[s]);
+    }
+}
+
+static long long stats_nanoseconds(const FileStats *stats) {
+    long long total = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        total += stats->phases[p].nanoseconds;
+    }
+    return total;
+}
+
+// Contador somado em todas as fases
+static long long stats_counter(const FileStats *stats, Counter counter) {
+    long long total = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        total += stats->phases[p].counters[counter];
+    }
+    return total;
+}
+
+// Uma linha por arquivo: tempo de cada fase e, quando há contadores, os
+// totais do arquivo
+static void print_file_stats(const FileStats *stats) {
+    long long nanoseconds = stats_nanoseconds(stats);
+    double seconds = nanoseconds / 1e9;
+    fprintf(stderr, "%s: %lld bytes, %lld tokens, %.3f ms", stats->path, stats->bytes, stats->tokens, nanoseconds / 1e6);
+    if (seconds > 0) {
+        fprintf(stderr, ", %.1f MB/s, %.0f tokens/s", stats->bytes / seconds / 1e6, stats->tokens / seconds);
+    }
+    fprintf(stderr, " (");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        fprintf(stderr, "%s%s %.3f", p > 0 ? ", " : "", PHASE_NAMES[p], stats->phases[p].nanoseconds / 1e6);
+    }
+    fprintf(stderr, ")");
+    if (stats->counted) {
+        char cycles[16], instructions[16], cache[16], branches[16];
+        format_count(cycles, sizeof(cycles), stats_counter(stats, COUNTER_CYCLES));
+        format_count(instructions, sizeof(instructions), stats_counter(stats, COUNTER_INSTRUCTIONS));
+        format_count(cache, sizeof(cache), stats_counter(stats, COUNTER_CACHE_MISSES));
+        format_count(branches, sizeof(branches), stats_counter(stats, COUNTER_BRANCH_MISSES));
+        fprintf(stderr, "; %s ciclos, %s instruções, %s falhas de cache, %s desvios errados",
+                cycles, instructions, cache, branches);
+    }
+    fprintf(stderr, "\n");
+}
+
+// Relatório de --stats em stderr: uma linha por arquivo, na ordem da saída,
+// e a tabela das fases somadas. A vazão é sobre o tempo de relógio do lote
+// inteiro; o tempo das fases é somado entre as threads.
+static void print_stats(const FileStats *stats, int count, long long elapsed) {
+    fflush(stdout);
+    FileStats total = {0};
+    total.counted = count > 0;
+    for (int i = 0; i < count; i++) {
+        print_file_stats(&stats[i]);
+        stats_add(&total, &stats[i]);
+    }
+    
+    long long nanoseconds = stats_nanoseconds(&total);
+    double seconds = elapsed / 1e9;
+    fprintf(stderr, "Estatísticas (%d arquivos, %lld bytes, %lld tokens, %.3f ms):\n",
+            count, total.bytes, total.tokens, elapsed / 1e6);
+    fprintf(stderr, "  %-14s %12s %6s", "fase", "tempo (ms)", "%");
+    if (total.counted) {
+        fprintf(stderr, " %10s %14s %6s %16s %16s", "ciclos", "instruções", "IPC", "falhas de cache", "desvios errados");
+    }
+    fprintf(stderr, "\n");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        const PhaseStats *phase = &total.phases[p];
+        // Os nomes têm acentos: a largura do printf conta bytes
+        int width = 14 + (int)strlen(PHASE_NAMES[p]);
+        for (const char *c = PHASE_NAMES[p]; *c != '\0'; c++) {
+            if ((*c & 0xC0) != 0x80) width--;
+        }
+        fprintf(stderr, "  %-*s %12.3f %6.1f", width, PHASE_NAMES[p], phase->nanoseconds / 1e6,
+                nanoseconds > 0 ? 100.0 * phase->nanoseconds / nanoseconds : 0.0);
+        if (total.counted) {
+            char cycles[16], instructions[16], cache[16], branches[16];
+            format_count(cycles, sizeof(cycles), phase->counters[COUNTER_CYCLES]);
+            format_count(instructions, sizeof(instructions), phase->counters[COUNTER_INSTRUCTIONS]);
+            format_count(cache, sizeof(cache), phase->counters[COUNTER_CACHE_MISSES]);
+            format_count(branches, sizeof(branches), phase->counters[COUNTER_BRANCH_MISSES]);
+            fprintf(stderr, " %10s %12s %6.2f %16s %16s", cycles, instructions,
+                    phase->counters[COUNTER_CYCLES] > 0
+                        ? (double)phase->counters[COUNTER_INSTRUCTIONS] / phase->counters[COUNTER_CYCLES] : 0.0,
+                    cache, branches);
+        }
+        fprintf(stderr, "\n");
+    }
+    if (!total.counted) {
+        fprintf(stderr, "  Contadores de hardware indisponíveis (perf_event_open); só os tempos foram medidos\n");
+    }
+    if (seconds > 0) {
+        fprintf(stderr, "  Vazão: %.1f MB/s, %.0f tokens/s\n", total.bytes / seconds / 1e6, total.tokens / seconds);
+    }
+}
+
+// Analisa um lote com até pool_size threads, cada uma com o seu contexto do
+// pool. Os contextos continuam vivos depois do lote, com os buffers já
+// alocados, para que o próximo lote comece aquecido.
+static void run_batch(BatchFile *files, int count, AnalysisContext **contexts, int pool_size,
+                      const BatchOptions *options) {
+    int num_workers = count < pool_size ? count : pool_size;
+    if (num_workers < 1) num_workers = 1;
+
+    long long started = monotonic_ns();
+    BatchScheduler scheduler;
+    batch_scheduler_init(&scheduler, files, count, num_workers, options->output_order, options->window);
+    scheduler.stats = options->stats ? calloc(count > 0 ? count : 1, sizeof(FileStats)) : NULL;
+    prefetch_start(&scheduler, options->reader);
+
+    pthread_t *workers = malloc(num_workers * sizeof(pthread_t));
+    WorkerArgs *args = malloc(num_workers * sizeof(WorkerArgs));
+    for (int w = 0; w < num_workers; w++) {
+        args[w].scheduler = &scheduler;
+        args[w].ctx = contexts[w];
+        args[w].id = w;
+        pthread_create(&workers[w], NULL, analysis_worker, &args[w]);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        pthread_join(workers[w], NULL);
+    }
+    free(workers);
+    free(args);
+    prefetch_stop(&scheduler);
+    batch_scheduler_destroy(&scheduler);
+
+    print_batch_total(options, count, scheduler.total_errors, scheduler.total_warnings);
+    if (scheduler.stats != NULL) {
+        print_stats(scheduler.stats, count, monotonic_ns() - started);
+        free(scheduler.stats);
+    }
+}
+
+// Modo projeto: uma primeira fase, com as threads do pool, passa por todos os
+// arquivos e junta no índice as funções de primeiro nível de cada um (nome,
+// quantidade de parâmetros e onde estão); depois a análise de sempre confere
+// contra o índice as chamadas que o próprio arquivo não resolve.
+static void project_index_init(ProjectIndex *index) {
+    for (int s = 0; s < PROJECT_SHARDS; s++) {
+        pthread_mutex_init(&index->shards[s].lock, NULL);
+        index->shards[s].buckets = NULL;
+        index->shards[s].bucket_count = 0;
+        index->shards[s].count = 0;
+    }
+}
+
+static void project_index_destroy(ProjectIndex *index) {
+    for (int s = 0; s < PROJECT_SHARDS; s++) {
+        ProjectShard *shard = &index->shards[s];
+        for (int b = 0; b < shard->bucket_count; b++) {
+            ProjectFunction *function = shard->buckets[b];
+            while (function != NULL) {
+                ProjectFunction *next = function->next;
+                free(function->name);
+                free(function);
+                function = next;
+            }
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+// Dobra os baldes da fatia quando ela passa de uma função por balde
+static void project_shard_grow(ProjectShard *shard) {
+    int bucket_count = shard->bucket_count > 0 ? shard->bucket_count * 2 : 16;
+    ProjectFunction **buckets = calloc(bucket_count, sizeof(ProjectFunction*));
+    if (buckets == NULL) {
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    for (int b = 0; b < shard->bucket_count; b++) {
+        ProjectFunction *function = shard->buckets[b];
+        while (function != NULL) {
+            ProjectFunction *next = function->next;
+            int slot = function->hash & (bucket_count - 1);
+            function->next = buckets[slot];
+            buckets[slot] = function;
+            function = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = bucket_count;
+}
+
+// Registra uma função. Se outro arquivo também a define, fica a do arquivo
+// que vem antes na entrada, qualquer que seja a ordem em que as threads chegam.
+static void project_index_insert(ProjectIndex *index, const char *name, int param_count,
+                                 int file, const char *path, int line) {
+    uint64_t hash = content_hash(name, strlen(name));
+    ProjectShard *shard = &index->shards[hash >> 58];
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count >= shard->bucket_count) {
+        project_shard_grow(shard);
+    }
+    ProjectFunction **slot = &shard->buckets[hash & (shard->bucket_count - 1)];
+    ProjectFunction *function = *slot;
+    while (function != NULL && (function->hash != hash || strcmp(function->name, name) != 0)) {
+        function = function->next;
+    }
+    if (function == NULL) {
+        function = malloc(sizeof(ProjectFunction));
+        char *copy = strdup(name);
+        if (function == NULL || copy == NULL) {
+            printf("ERRO: Memória Insuficiente\n");
+            exit(1);
+        }
+        function->name = copy;
+        function->hash = hash;
+        function->file = -1;
+        function->next = *slot;
+        *slot = function;
+        shard->count++;
+    }
+    if (function->file == -1 || file < function->file ||
+        (file == function->file && line < function->line)) {
+        function->param_count = param_count;
+        function->file = file;
+        function->path = path;
+        function->line = line;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Parâmetros da lista que começa em `open`, contados como a classificação
+// conta: as variáveis, se a lista passa por validate_parameter_list(), ou
+// nenhum
+static int signature_param_count(AnalysisContext *ctx, int open) {
+    if (ctx->token_kinds[open] != KIND_LEFT_PAREN || ctx->bracket_match[open] < open) return 0;
+    int close = ctx->bracket_match[open];
+    int param_count = 0;
+    bool expecting_param = true;
+    for (int k = open + 1; k < close; k++) {
+        if (expecting_param) {
+            if (!is_variable(ctx->tokens[k])) return 0;
+            param_count++;
+        } else if (ctx->token_kinds[k] != KIND_COMMA) {
+            return 0;
+        }
+        expecting_param = !expecting_param;
+    }
+    // Lista terminada em vírgula
+    if (param_count > 0 && expecting_param) return 0;
+    return param_count;
+}
+
+// Primeira fase para um arquivo: lexer e passada de índice, sem classificar.
+// Um arquivo que não abre ou que passa do limite de memória fica de fora; a
+// segunda fase relata o erro.
+static void project_scan_file(AnalysisContext *ctx, ProjectIndex *index, const char *path, int file) {
+    jmp_buf memory_error;
+    reset_analysis_context(ctx);
+    ctx->memory_error = &memory_error;
+    if (setjmp(memory_error) != 0) {
+        analyzer_release(ctx);
+        return;
+    }
+    char *content = read_file(ctx, path);
+    if (content == NULL) {
+        ctx->memory_error = NULL;
+        return;
+    }
+    ctx->content = content;
+    ctx->content_length = strlen(content);
+    ctx->content_hash = ctx->cache_dir != NULL ? content_hash(content, ctx->content_length) : 0;
+    lex_content(ctx, content);
+    index_tokens(ctx);
+
+    // Só as definições completas de primeiro nível são visíveis de fora
+    for (int f = 0; f < ctx->function_count; f++) {
+        FunctionDefinition *function = &ctx->functions[f];
+        if (function->level != 0 || function->end == -1) continue;
+        project_index_insert(index, function->name, signature_param_count(ctx, function->start + 2),
+                             file, path, ctx->spans[function->start].line);
+    }
+    analyzer_release(ctx);
+}
+
+typedef struct ProjectScan {
+    ProjectIndex *index;
+    BatchFile *files;
+    int count;
+    int next; // Próximo arquivo, disputado pelas threads
+} ProjectScan;
+
+typedef struct ProjectScanArgs {
+    ProjectScan *scan;
+    AnalysisContext *ctx;
+} ProjectScanArgs;
+
+static void* project_scan_worker(void *arg) {
+    ProjectScanArgs *args = arg;
+    ProjectScan *scan = args->scan;
+    int index;
+    while ((index = __atomic_fetch_add(&scan->next, 1, __ATOMIC_RELAXED)) < scan->count) {
+        project_scan_file(args->ctx, scan->index, scan->files[index].path, index);
+    }
+    return NULL;
+}
+
+// Primeira fase do modo projeto, com até pool_size threads do pool. A posição
+// de cada arquivo em `files` desempata as definições repetidas, então isto
+// roda antes do lote, que reordena a lista.
+static void build_project_index(ProjectIndex *index, BatchFile *files, int count,
+                                AnalysisContext **contexts, int pool_size) {
+    int num_workers = count < pool_size ? count : pool_size;
+    if (num_workers < 1) num_workers = 1;
+
+    ProjectScan scan = {index, files, count, 0};
+    pthread_t *workers = malloc(num_workers * sizeof(pthread_t));
+    ProjectScanArgs *args = malloc(num_workers * sizeof(ProjectScanArgs));
+    if (workers == NULL || args == NULL) {
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        args[w].scan = &scan;
+        args[w].ctx = contexts[w];
+        pthread_create(&workers[w], NULL, project_scan_worker, &args[w]);
+    }
+    for (int w = 0; w < num_workers; w++) {
+        pthread_join(workers[w], NULL);
+    }
+    free(workers);
+    free(args);
+}
+
+// Modo pipeline: em vez de cada thread fazer tudo com um arquivo, três
+// etapas em threads separadas trabalham em arquivos consecutivos ao mesmo
+// tempo: leitura, lexer e análise (classificação, verificações e relatório).
+// As etapas se comunicam por filas SPSC sem lock; os itens circulam por uma
+// quarta fila que devolve à leitura os contextos já usados.
+#define PIPELINE_DEPTH 16
+#define PIPELINE_ITEMS (2 * PIPELINE_DEPTH + 3)
+
+// Fila circular de um produtor e um consumidor. Cada contador de
+// estatística é escrito por um só lado e lido depois que as threads terminam.
+typedef struct SpscQueue {
+    void **slots;
+    size_t capacity;
+    size_t head; // Próximo a sair, escrito só pelo consumidor
+    size_t tail; // Próximo a entrar, escrito só pelo produtor
+    long long pushes;
+    long long depth_sum; // Soma das profundidades vistas a cada entrada
+    size_t max_depth;
+    long long full_stalls;  // Vezes em que o produtor achou a fila cheia
+    long long empty_stalls; // Vezes em que o consumidor achou a fila vazia
+} SpscQueue;
+
+static void spsc_init(SpscQueue *queue, size_t capacity) {
+    memset(queue, 0, sizeof(*queue));
+    queue->slots = malloc(capacity * sizeof(void*));
+    if (queue->slots == NULL) {
+        printf("ERRO: Memória Insuficiente\n");
+        exit(1);
+    }
+    queue->capacity = capacity;
+}
+
+static bool spsc_try_push(SpscQueue *queue, void *item) {
+    size_t tail = queue->tail;
+    size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (tail - head == queue->capacity) return false;
+    queue->slots[tail % queue->capacity] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    
+    size_t depth = tail + 1 - head;
+    queue->pushes++;
+    queue->depth_sum += depth;
+    if (depth > queue->max_depth) queue->max_depth = depth;
+    return true;
+}
+
+static bool spsc_try_pop(SpscQueue *queue, void **item) {
+    size_t head = queue->head;
+    if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) return false;
+    *item = queue->slots[head % queue->capacity];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Versões que esperam: cada espera conta como uma parada da etapa
+static void spsc_push(SpscQueue *queue, void *item) {
+    if (spsc_try_push(queue, item)) return;
+    queue->full_stalls++;
+    while (!spsc_try_push(queue, item)) {
+        sched_yield();
+    }
+}
+
+static void* spsc_pop(SpscQueue *queue) {
+    void *item;
+    if (spsc_try_pop(queue, &item)) return item;
+    queue->empty_stalls++;
+    while (!spsc_try_pop(queue, &item)) {
+        sched_yield();
+    }
+    return item;
+}
+
+// Um arquivo em trânsito pelo pipeline, com o contexto que o acompanha
+typedef struct PipelineItem {
+    AnalysisContext *ctx;
+    BatchFile *file;
+    bool done; // O relatório já está completo (erro de leitura ou cache)
+} PipelineItem;
+
+typedef struct Pipeline {
+    BatchFile *files;
+    int count;
+    SpscQueue free_items; // Análise -> leitura
+    SpscQueue read;       // Leitura -> lexer
+    SpscQueue lexed;      // Lexer -> análise
+    int total_errors;
+    int total_warnings;
+    FileStats *stats;     // Por arquivo, com --stats; senão NULL
+} Pipeline;
+
+// Etapa de leitura. Um item NULL marca o fim dos arquivos.
+static void* pipeline_reader(void *arg) {
+    Pipeline *pipeline = arg;
+    for (int i = 0; i < pipeline->count; i++) {
+        PipelineItem *item = spsc_pop(&pipeline->free_items);
+        AnalysisContext *ctx = item->ctx;
+        item->file = &pipeline->files[i];
+        item->done = false;
+        
+        reset_analysis_context(ctx);
+        report_file_begin(ctx, item->file->path);
+        stats_begin(ctx, pipeline->stats != NULL ? &pipeline->stats[i] : NULL, item->file->path);
+        stats_phase(ctx, PHASE_READ);
+        char *content = read_file(ctx, item->file->path);
+        stats_phase(ctx, PHASE_IDLE);
+        if (content == NULL) {
+            report_printf(ctx, VERBOSITY_DIAGNOSTICS, "Erro ao ler o arquivo: %s\n", item->file->path);
+            report_file_end(ctx, item->file->path, 0);
+            item->done = true;
+        } else {
+            ctx->content = content;
+        }
+        spsc_push(&pipeline->read, item);
+    }
+    spsc_push(&pipeline->read, NULL);
+    return NULL;
+}
+
+static void* pipeline_lexer(void *arg) {
+    Pipeline *pipeline = arg;
+    PipelineItem *item;
+    while ((item = spsc_pop(&pipeline->read)) != NULL) {
+        if (!item->done) {
+            item->done = !analysis_lex(item->ctx, item->file->path, item->ctx->content);
+        }
+        spsc_push(&pipeline->lexed, item);
+    }
+    spsc_push(&pipeline->lexed, NULL);
+    return NULL;
+}
+
+// Etapa de análise, na thread que chamou run_pipeline. Os arquivos chegam
+// na ordem de saída, então o relatório é escrito assim que fica pronto.
+static void pipeline_analyzer(Pipeline *pipeline) {
+    PipelineItem *item;
+    while ((item = spsc_pop(&pipeline->lexed)) != NULL) {
+        AnalysisContext *ctx = item->ctx;
+        if (!item->done) {
+            analysis_check(ctx, item->file->path);
+        }
+        fwrite(ctx->out.data, 1, ctx->out.length, stdout);
+        pipeline->total_errors += ctx->error_count;
+        pipeline->total_warnings += ctx->warning_count;
+        spsc_push(&pipeline->free_items, item);
+    }
+}
+
+static void print_queue_stats(const char *name, const SpscQueue *queue) {
+    fprintf(stderr, "  %s: profundidade média %.1f, máxima %zu de %zu; cheia %lld vezes, vazia %lld vezes\n",
+            name, queue->pushes > 0 ? (double)queue->depth_sum / queue->pushes : 0.0,
+            queue->max_depth, queue->capacity, queue->full_stalls, queue->empty_stalls);
+}
+
+// Analisa o lote pelo pipeline de três etapas e mostra em stderr a ocupação
+// de cada fila e quantas vezes cada etapa parou esperando a vizinha. Fila
+// cheia aponta para a etapa seguinte como gargalo; vazia, para a anterior.
+static void run_pipeline(BatchFile *files, int count, const BatchOptions *options, const char *cache_dir) {
+    if (options->output_order == ORDER_PATH) {
+        qsort(files, count, sizeof(BatchFile), compare_batch_path);
+    }
+    
+    long long started = monotonic_ns();
+    Pipeline pipeline = {0};
+    pipeline.files = files;
+    pipeline.count = count;
+    pipeline.stats = options->stats ? calloc(count > 0 ? count : 1, sizeof(FileStats)) : NULL;
+    spsc_init(&pipeline.free_items, PIPELINE_ITEMS);
+    spsc_init(&pipeline.read, PIPELINE_DEPTH);
+    spsc_init(&pipeline.lexed, PIPELINE_DEPTH);
+    
+    AnalysisContext **contexts = create_context_pool(PIPELINE_ITEMS, options->verbosity, options->format, cache_dir,
+                                                     options->max_errors, options->max_diagnostics, options->function_jobs);
+    PipelineItem items[PIPELINE_ITEMS];
+    for (int i = 0; i < PIPELINE_ITEMS; i++) {
+        items[i].ctx = contexts[i];
+        items[i].ctx->project = options->project;
+        spsc_push(&pipeline.free_items, &items[i]);
+    }
+    // O enchimento inicial não entra nas estatísticas
+    pipeline.free_items.pushes = 0;
+    pipeline.free_items.depth_sum = 0;
+    pipeline.free_items.max_depth = 0;
+    
+    pthread_t reader;
+    pthread_t lexer;
+    pthread_create(&reader, NULL, pipeline_reader, &pipeline);
+    pthread_create(&lexer, NULL, pipeline_lexer, &pipeline);
+    pipeline_analyzer(&pipeline);
+    pthread_join(reader, NULL);
+    pthread_join(lexer, NULL);
+    
+    print_batch_total(options, count, pipeline.total_errors, pipeline.total_warnings);
+    fflush(stdout);
+    fprintf(stderr, "Pipeline (%d arquivos):\n", count);
+    print_queue_stats("leitura -> lexer", &pipeline.read);
+    print_queue_stats("lexer -> análise", &pipeline.lexed);
+    print_queue_stats("análise -> leitura", &pipeline.free_items);
+    if (pipeline.stats != NULL) {
+        print_stats(pipeline.stats, count, monotonic_ns() - started);
+        free(pipeline.stats);
+    }
+    
+    for (int i = 0; i < PIPELINE_ITEMS; i++) {
+        free_analysis_context(contexts[i]);
+    }
+    free(contexts);
+    free(pipeline.free_items.slots);
+    free(pipeline.read.slots);
+    free(pipeline.lexed.slots);
+}
+
+
+// Lista de arquivos de entrada montada a partir da linha de comando
+typedef struct InputList {
+    BatchFile *files;
+    int count;
+    int capacity;
+} InputList;
+
+// Adiciona um arquivo à lista; o caminho passa a pertencer à lista
+static void input_list_add(InputList *list, char *path, long long size) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->files = realloc(list->files, list->capacity * sizeof(BatchFile));
+    }
+    list->files[list->count].path = path;
+    list->files[list->count].size = size;
+    list->count++;
+}
+
+// Junta diretório e nome sem limite fixo de tamanho
+static char* join_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    bool has_slash = dir_len > 0 && dir[dir_len - 1] == '/';
+    char *path = malloc(dir_len + name_len + 2);
+    memcpy(path, dir, dir_len);
+    if (!has_slash) path[dir_len++] = '/';
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+// Tipo de uma entrada de diretório: DT_DIR, DT_REG ou outro, que fica de
+// fora. O d_type decide sem stat extra; só quando o sistema de arquivos não
+// informa o tipo, ou para ver onde um link aponta, é que fstatat é usado, e
+// então `st` fica preenchido. Links para diretórios não são seguidos: um
+// link para um ancestral faria a recursão não terminar, e um para outro
+// diretório da entrada repetiria os mesmos arquivos. Um link para arquivo
+// vale como o arquivo.
+static unsigned char entry_type(DIR *dir, struct dirent *entry, struct stat *st, bool *have_stat) {
+    unsigned char type = entry->d_type;
+    *have_stat = false;
+    if (type == DT_UNKNOWN) {
+        if (fstatat(dirfd(dir), entry->d_name, st, AT_SYMLINK_NOFOLLOW) != 0) return DT_UNKNOWN;
+        if (S_ISLNK(st->st_mode)) {
+            type = DT_LNK;
+        } else {
+            *have_stat = true;
+            return S_ISDIR(st->st_mode) ? DT_DIR : S_ISREG(st->st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+    }
+    if (type == DT_LNK) {
+        if (fstatat(dirfd(dir), entry->d_name, st, 0) != 0 || !S_ISREG(st->st_mode)) return DT_LNK;
+        *have_stat = true;
+        return DT_REG;
+    }
+    return type;
+}
+
+// Adiciona os arquivos de um diretório, na ordem da listagem
+static bool collect_directory(InputList *list, const char *dir_path, bool recursive) {
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return false;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        
+        struct stat st;
+        bool have_stat;
+        unsigned char type = entry_type(dir, entry, &st, &have_stat);
+        if (type == DT_DIR) {
+            if (recursive) {
+                char *sub_path = join_path(dir_path, entry->d_name);
+                collect_directory(list, sub_path, recursive);
+                free(sub_path);
+            }
+            continue;
+        }
+        if (type != DT_REG) continue;
+        
+        // O tamanho alimenta o escalonador
+        if (!have_stat && fstatat(dirfd(dir), entry->d_name, &st, 0) != 0) continue;
+        input_list_add(list, join_path(dir_path, entry->d_name), st.st_size);
+    }
+    
+    closedir(dir);
+    return true;
+}
+
+// Adiciona um caminho da linha de comando: arquivo ou diretório
+static bool collect_path(InputList *list, const char *path, bool recursive) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Não foi possível acessar: %s\n", path);
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        if (!collect_directory(list, path, recursive)) {
+            fprintf(stderr, "Não foi possível abrir o diretório %s\n", path);
+            return false;
+        }
+        return true;
+    }
+    input_list_add(list, strdup(path), st.st_size);
+    return true;
+}
+
+// Lê uma lista de caminhos separados por NUL (como a de `find -print0`)
+static bool collect_files0(InputList *list, const char *list_path, bool recursive) {
+    FILE *stream = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (stream == NULL) {
+        fprintf(stderr, "Não foi possível abrir a lista de arquivos %s\n", list_path);
+        return false;
+    }
+    
+    bool ok = true;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_length;
+    while ((line_length = getdelim(&line, &line_capacity, '\0', stream)) != -1) {
+        if (line_length > 0 && line[line_length - 1] == '\0') line_length--;
+        if (line_length == 0) continue;
+        if (!collect_path(list, line, recursive)) ok = false;
+    }
+    
+    free(line);
+    if (stream != stdin) fclose(stream);
+    return ok;
+}
+
+// Tempo sem novos eventos antes de analisar o que mudou (junta as várias
+// escritas de um mesmo salvamento em uma só análise)
+#define WATCH_DEBOUNCE_MS 100
+
+// Arquivo passado diretamente: só ele é observado dentro do seu diretório
+typedef struct WatchedFile {
+    int wd;
+    char *name;
+    char *path; // Caminho como foi passado, usado no relatório
+} WatchedFile;
+
+// Diretórios observados com inotify, indexados pelo descritor do watch
+typedef struct WatchSet {
+    int fd;
+    bool recursive;
+    char **dirs;
+    bool *whole; // Todos os arquivos do diretório interessam
+    int capacity;
+    WatchedFile *files;
+    int file_count;
+    int file_capacity;
+} WatchSet;
+
+static int watch_add_dir(WatchSet *set, const char *dir_path, bool whole) {
+    int wd = inotify_add_watch(set->fd, dir_path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        fprintf(stderr, "Não foi possível observar %s\n", dir_path);
+        return -1;
+    }
+    if (wd >= set->capacity) {
+        int capacity = set->capacity ? set->capacity : 16;
+        while (capacity <= wd) capacity *= 2;
+        set->dirs = realloc(set->dirs, capacity * sizeof(char*));
+        set->whole = realloc(set->whole, capacity * sizeof(bool));
+        for (int i = set->capacity; i < capacity; i++) {
+            set->dirs[i] = NULL;
+            set->whole[i] = false;
+        }
+        set->capacity = capacity;
+    }
+    if (set->dirs[wd] == NULL) set->dirs[wd] = strdup(dir_path);
+    set->whole[wd] = set->whole[wd] || whole;
+    return wd;
+}
+
+// Observa um diretório e, no modo recursivo, os seus subdiretórios
+static void watch_directory(WatchSet *set, const char *dir_path) {
+    if (watch_add_dir(set, dir_path, true) < 0 || !set->recursive) return;
+    
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        struct stat st;
+        bool have_stat;
+        if (entry_type(dir, entry, &st, &have_stat) != DT_DIR) continue;
+        char *sub_path = join_path(dir_path, entry->d_name);
+        watch_directory(set, sub_path);
+        free(sub_path);
+    }
+    closedir(dir);
+}
+
+// Observa um único arquivo pelo diretório que o contém
+static void watch_file(WatchSet *set, const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir_path = slash == NULL ? strdup(".") :
+                     slash == path ? strdup("/") : strndup(path, slash - path);
+    int wd = watch_add_dir(set, dir_path, false);
+    free(dir_path);
+    if (wd < 0) return;
+    
+    if (set->file_count == set->file_capacity) {
+        set->file_capacity = set->file_capacity ? set->file_capacity * 2 : 16;
+        set->files = realloc(set->files, set->file_capacity * sizeof(WatchedFile));
+    }
+    WatchedFile *file = &set->files[set->file_count++];
+    file->wd = wd;
+    file->name = strdup(slash == NULL ? path : slash + 1);
+    file->path = strdup(path);
+}
+
+static void watch_path(WatchSet *set, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+    if (S_ISDIR(st.st_mode)) {
+        watch_directory(set, path);
+    } else {
+        watch_file(set, path);
+    }
+}
+
+static void watch_set_destroy(WatchSet *set) {
+    for (int i = 0; i < set->capacity; i++) {
+        free(set->dirs[i]);
+    }
+    for (int i = 0; i < set->file_count; i++) {
+        free(set->files[i].name);
+        free(set->files[i].path);
+    }
+    free(set->dirs);
+    free(set->whole);
+    free(set->files);
+    close(set->fd);
+}
+
+// Adiciona um arquivo alterado ao próximo lote, sem repetir caminhos
+static void watch_mark_changed(InputList *changed, char *path) {
+    for (int i = 0; i < changed->count; i++) {
+        if (strcmp(changed->files[i].path, path) == 0) {
+            free(path);
+            return;
+        }
+    }
+    input_list_add(changed, path, 0);
+}
+
+// Traduz os eventos lidos em caminhos alterados
+static void watch_handle_events(WatchSet *set, const char *buffer, ssize_t length, InputList *changed) {
+    const char *p = buffer;
+    while (p < buffer + length) {
+        const struct inotify_event *event = (const struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->len == 0 || event->wd < 0 || event->wd >= set->capacity ||
+            set->dirs[event->wd] == NULL) {
+            continue;
+        }
+        
+        if (event->mask & IN_ISDIR) {
+            // Diretório novo: passa a ser observado e o que já tem dentro é analisado
+            if (set->recursive && set->whole[event->wd] && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                char *sub_path = join_path(set->dirs[event->wd], event->name);
+                watch_directory(set, sub_path);
+                InputList found = {0};
+                collect_directory(&found, sub_path, true);
+                for (int i = 0; i < found.count; i++) {
+                    watch_mark_changed(changed, found.files[i].path);
+                }
+                free(found.files);
+                free(sub_path);
+            }
+            continue;
+        }
+        // Arquivos novos são analisados quando terminam de ser escritos
+        if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) continue;
+        
+        if (set->whole[event->wd]) {
+            watch_mark_changed(changed, join_path(set->dirs[event->wd], event->name));
+            continue;
+        }
+        for (int i = 0; i < set->file_count; i++) {
+            if (set->files[i].wd == event->wd && strcmp(set->files[i].name, event->name) == 0) {
+                watch_mark_changed(changed, strdup(set->files[i].path));
+                break;
+            }
+        }
+    }
+}
+
+// Fica residente analisando de novo só os arquivos que mudaram. Os eventos
+// de uma rajada de escritas são juntados até WATCH_DEBOUNCE_MS sem novidade.
+static void watch_loop(WatchSet *set, AnalysisContext **contexts, int pool_size, const BatchOptions *options) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {set->fd, POLLIN, 0};
+    
+    while (true) {
+        InputList changed = {0};
+        int timeout = -1;
+        while (true) {
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) break;
+            ssize_t length = read(set->fd, buffer, sizeof(buffer));
+            if (length <= 0) break;
+            watch_handle_events(set, buffer, length, &changed);
+            if (changed.count > 0) timeout = WATCH_DEBOUNCE_MS;
+        }
+        if (changed.count == 0) {
+            free(changed.files);
+            if (timeout == -1) return; // O descritor do inotify falhou
+            continue;
+        }
+        
+        // Arquivos que sumiram antes da análise ficam de fora
+        InputList batch = {0};
+        for (int i = 0; i < changed.count; i++) {
+            struct stat st;
+            if (stat(changed.files[i].path, &st) == 0 && S_ISREG(st.st_mode)) {
+                input_list_add(&batch, changed.files[i].path, st.st_size);
+            } else {
+                free(changed.files[i].path);
+            }
+        }
+        free(changed.files);
+        
+        // Um arquivo salvo que passa do limite de memória sai com o erro no
+        // relatório (ver run_batch_file()) e o watch continua
+        if (batch.count > 0) {
+            run_batch(batch.files, batch.count, contexts, pool_size, options);
+            fflush(stdout);
+        }
+        for (int i = 0; i < batch.count; i++) {
+            free(batch.files[i].path);
+        }
+        free(batch.files);
+    }
+}
+
+// Modo daemon: pedidos de análise por um socket Unix. Cada linha de pedido é
+//   PATH <id> <caminho>
+//   BUFFER <id> <tamanho> <nome>   seguida de <tamanho> bytes de conteúdo
+//   CANCEL <id>
+// e cada resposta é "RESULT <id> ok|cancelled|error <tamanho>" seguida de
+// <tamanho> bytes do relatório em NDJSON. As respostas saem na ordem em que
+// as análises terminam, então um cliente pode ter vários pedidos em aberto.
+// Cada conexão tem uma thread de leitura e uma de escrita; as threads de
+// análise só põem a resposta na fila da conexão, então um cliente que não lê
+// o socket não segura o pool.
+#define DAEMON_MAX_ID 64
+#define DAEMON_BACKLOG 64
+
+typedef struct DaemonConnection DaemonConnection;
+
+typedef struct DaemonJob {
+    DaemonConnection *conn;
+    char id[DAEMON_MAX_ID + 1];
+    char *path;   // Pedido PATH
+    char *buffer; // Pedido BUFFER, com o nome em path
+    size_t buffer_length;
+    int cancelled;
+    struct DaemonJob *next;         // Fila do servidor
+    struct DaemonJob *next_pending; // Pedidos em aberto da conexão
+} DaemonJob;
+
+// Resposta esperando a thread de escrita, com o cabeçalho e o corpo juntos
+typedef struct DaemonReply {
+    char *data;
+    size_t length;
+    struct DaemonReply *next;
+} DaemonReply;
+
+struct DaemonConnection {
+    int fd;
+    pthread_mutex_t lock; // Protege a fila de respostas, a lista de pedidos e as referências
+    pthread_cond_t changed; // Resposta na fila, pedido terminado ou leitor no fim
+    DaemonReply *replies;
+    DaemonReply *last_reply;
+    DaemonJob *pending;
+    int references; // Leitor, escritor e pedidos em aberto
+    bool reading;   // O leitor ainda pode criar pedidos
+    bool closed;    // O cliente foi embora: respostas não são mais enviadas
+};
+
+typedef struct DaemonServer {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    DaemonJob *head;
+    DaemonJob *tail;
+} DaemonServer;
+
+typedef struct DaemonWorkerArgs {
+    DaemonServer *server;
+    AnalysisContext *ctx;
+} DaemonWorkerArgs;
+
+typedef struct DaemonReaderArgs {
+    DaemonServer *server;
+    DaemonConnection *conn;
+} DaemonReaderArgs;
+
+// Solta uma referência; a última fecha o socket
+static void daemon_connection_release(DaemonConnection *conn) {
+    pthread_mutex_lock(&conn->lock);
+    bool last = --conn->references == 0;
+    pthread_mutex_unlock(&conn->lock);
+    if (!last) return;
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->changed);
+    free(conn);
+}
+
+static bool daemon_write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// O cliente foi embora: as respostas na fila são descartadas e os pedidos
+// dele que ainda estão na fila ou em análise são cancelados. Chamada com o
+// lock da conexão.
+static void daemon_close_locked(DaemonConnection *conn) {
+    conn->closed = true;
+    while (conn->replies != NULL) {
+        DaemonReply *reply = conn->replies;
+        conn->replies = reply->next;
+        free(reply->data);
+        free(reply);
+    }
+    conn->last_reply = NULL;
+    for (DaemonJob *job = conn->pending; job != NULL; job = job->next_pending) {
+        __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Põe uma resposta na fila da thread de escrita. Chamada com o lock da conexão.
+static void daemon_send_locked(DaemonConnection *conn, const char *id, const char *status,
+                               const char *body, size_t body_length) {
+    if (conn->closed) return;
+    char header[DAEMON_MAX_ID + 64];
+    int header_length = snprintf(header, sizeof(header), "RESULT %s %s %zu\n", id, status, body_length);
+    DaemonReply *reply = malloc(sizeof(DaemonReply));
+    char *data = malloc(header_length + body_length);
+    if (reply == NULL || data == NULL) {
+        // Sem memória para a resposta o cliente ficaria esperando para sempre
+        free(reply);
+        free(data);
+        daemon_close_locked(conn);
+        shutdown(conn->fd, SHUT_RDWR);
+        return;
+    }
+    memcpy(data, header, header_length);
+    memcpy(data + header_length, body, body_length);
+    reply->data = data;
+    reply->length = header_length + body_length;
+    reply->next = NULL;
+    if (conn->last_reply != NULL) {
+        conn->last_reply->next = reply;
+    } else {
+        conn->replies = reply;
+    }
+    conn->last_reply = reply;
+    pthread_cond_broadcast(&conn->changed);
+}
+
+static void daemon_send(DaemonConnection *conn, const char *id, const char *status, const char *body) {
+    pthread_mutex_lock(&conn->lock);
+    daemon_send_locked(conn, id, status, body, strlen(body));
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void daemon_enqueue(DaemonServer *server, DaemonJob *job) {
+    DaemonConnection *conn = job->conn;
+    pthread_mutex_lock(&conn->lock);
+    conn->references++;
+    job->next_pending = conn->pending;
+    conn->pending = job;
+    pthread_mutex_unlock(&conn->lock);
+    
+    pthread_mutex_lock(&server->lock);
+    job->next = NULL;
+    if (server->tail != NULL) {
+        server->tail->next = job;
+    } else {
+        server->head = job;
+    }
+    server->tail = job;
+    pthread_cond_signal(&server->available);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Responde o pedido, tira da lista da conexão e o libera
+static void daemon_finish(DaemonJob *job, const char *status, const char *body, size_t body_length) {
+    DaemonConnection *conn = job->conn;
+    pthread_mutex_lock(&conn->lock);
+    daemon_send_locked(conn, job->id, status, body, body_length);
+    DaemonJob **link = &conn->pending;
+    while (*link != job) link = &(*link)->next_pending;
+    *link = job->next_pending;
+    pthread_cond_broadcast(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    
+    daemon_connection_release(conn);
+    free(job->path);
+    free(job->buffer);
+    free(job);
+}
+
+static void* daemon_worker(void *arg) {
+    DaemonWorkerArgs *args = arg;
+    DaemonServer *server = args->server;
+    AnalysisContext *ctx = args->ctx;
+    
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+        while (server->head == NULL) {
+            pthread_cond_wait(&server->available, &server->lock);
+        }
+        DaemonJob *job = server->head;
+        server->head = job->next;
+        if (server->head == NULL) server->tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+        
+        if (__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED)) {
+            daemon_finish(job, "cancelled", "", 0);
+            continue;
+        }
+        
+        // Arquivos maiores que o limite de memória derrubariam o processo
+        struct stat st;
+        if (job->buffer == NULL && stat(job->path, &st) == 0 && st.st_size >= MAX_MEMORY) {
+            const char *message = "{\"type\":\"error\",\"message\":\"arquivo maior que o limite de memória\"}\n";
+            daemon_finish(job, "error", message, strlen(message));
+            continue;
+        }
+        
+        // Os tokens e a árvore crescem mais que a entrada: mesmo passando pelo
+        // teste acima, a análise pode estourar o limite. O pedido recebe um
+        // erro e o processo continua atendendo os outros clientes.
+        jmp_buf memory_error;
+        ctx->cancel = &job->cancelled;
+        ctx->memory_error = &memory_error;
+        if (setjmp(memory_error) != 0) {
+            analyzer_release(ctx);
+            ctx->cancel = NULL;
+            const char *message = "{\"type\":\"error\",\"message\":\"análise passou do limite de memória\"}\n";
+            daemon_finish(job, "error", message, strlen(message));
+            continue;
+        }
+        if (job->buffer != NULL) {
+            analyze_buffer(ctx, job->path, job->buffer, job->buffer_length);
+        } else {
+            analyze_file(ctx, job->path);
+        }
+        ctx->memory_error = NULL;
+        ctx->cancel = NULL;
+        
+        if (__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED)) {
+            daemon_finish(job, "cancelled", "", 0);
+        } else {
+            daemon_finish(job, "ok", ctx->out.data, ctx->out.length);
+        }
+    }
+    return NULL;
+}
+
+// Marca como cancelado o pedido em aberto com esse id, se houver
+static void daemon_cancel(DaemonConnection *conn, const char *id) {
+    pthread_mutex_lock(&conn->lock);
+    for (DaemonJob *job = conn->pending; job != NULL; job = job->next_pending) {
+        if (strcmp(job->id, id) == 0) {
+            __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+// Escreve as respostas da conexão na ordem em que entraram na fila. Termina
+// quando o leitor acabou e não há mais pedidos em aberto nem respostas.
+static void* daemon_writer(void *arg) {
+    DaemonConnection *conn = arg;
+    pthread_mutex_lock(&conn->lock);
+    while (true) {
+        while (conn->replies == NULL && (conn->reading || conn->pending != NULL)) {
+            pthread_cond_wait(&conn->changed, &conn->lock);
+        }
+        DaemonReply *reply = conn->replies;
+        if (reply == NULL) break;
+        conn->replies = reply->next;
+        if (conn->replies == NULL) conn->last_reply = NULL;
+        pthread_mutex_unlock(&conn->lock);
+        
+        bool sent = daemon_write_all(conn->fd, reply->data, reply->length);
+        free(reply->data);
+        free(reply);
+        
+        pthread_mutex_lock(&conn->lock);
+        if (!sent && !conn->closed) {
+            daemon_close_locked(conn);
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+    daemon_connection_release(conn);
+    return NULL;
+}
+
+// O leitor chegou ao fim. Se o cliente fechou a conexão inteira (e não só o
+// lado de escrita, caso em que ele ainda espera as respostas), os pedidos
+// dele são cancelados na hora.
+static void daemon_reader_done(DaemonConnection *conn) {
+    struct pollfd peer = {conn->fd, POLLOUT, 0};
+    bool hung_up = poll(&peer, 1, 0) > 0 && (peer.revents & (POLLHUP | POLLERR)) != 0;
+    pthread_mutex_lock(&conn->lock);
+    conn->reading = false;
+    if (hung_up && !conn->closed) {
+        daemon_close_locked(conn);
+    }
+    pthread_cond_broadcast(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    daemon_connection_release(conn);
+}
+
+// Lê os pedidos de uma conexão até o cliente fechar o lado de escrita. As
+// respostas pendentes continuam sendo enviadas depois disso.
+static void* daemon_reader(void *arg) {
+    DaemonReaderArgs *args = arg;
+    DaemonServer *server = args->server;
+    DaemonConnection *conn = args->conn;
+    free(args);
+    
+    int read_fd = dup(conn->fd);
+    FILE *stream = read_fd >= 0 ? fdopen(read_fd, "r") : NULL;
+    if (stream == NULL) {
+        if (read_fd >= 0) close(read_fd);
+        daemon_reader_done(conn);
+        return NULL;
+    }
+    
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_length;
+    while ((line_length = getline(&line, &line_capacity, stream)) > 0) {
+        if (line[line_length - 1] == '\n') line[--line_length] = '\0';
+        
+        char id[DAEMON_MAX_ID + 1];
+        int consumed = 0;
+        size_t buffer_length = 0;
+        if (sscanf(line, "CANCEL %64s", id) == 1) {
+            daemon_cancel(conn, id);
+            continue;
+        }
+        if (sscanf(line, "PATH %64s %n", id, &consumed) == 1 && consumed > 0 && line[consumed] != '\0') {
+            DaemonJob *job = calloc(1, sizeof(DaemonJob));
+            job->conn = conn;
+            strcpy(job->id, id);
+            job->path = strdup(line + consumed);
+            daemon_enqueue(server, job);
+            continue;
+        }
+        if (sscanf(line, "BUFFER %64s %zu %n", id, &buffer_length, &consumed) == 2 && consumed > 0) {
+            if (buffer_length >= MAX_MEMORY) {
+                daemon_send(conn, id, "error", "{\"type\":\"error\",\"message\":\"conteúdo maior que o limite de memória\"}\n");
+                break;
+            }
+            DaemonJob *job = calloc(1, sizeof(DaemonJob));
+            job->conn = conn;
+            strcpy(job->id, id);
+            job->path = strdup(line[consumed] != '\0' ? line + consumed : id);
+            job->buffer = malloc(buffer_length > 0 ? buffer_length : 1);
+            job->buffer_length = buffer_length;
+            if (fread(job->buffer, 1, buffer_length, stream) != buffer_length) {
+                free(job->path);
+                free(job->buffer);
+                free(job);
+                break;
+            }
+            daemon_enqueue(server, job);
+            continue;
+        }
+        daemon_send(conn, "-", "error", "{\"type\":\"error\",\"message\":\"pedido inválido\"}\n");
+    }
+    
+    free(line);
+    fclose(stream);
+    daemon_reader_done(conn);
+    return NULL;
+}
+
+// Atende pedidos no socket até o processo ser encerrado. Os contextos do pool
+// ficam com as threads, então cada pedido paga só a análise.
+static int run_daemon(const char *socket_path, AnalysisContext **contexts, int pool_size) {
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (listen_fd < 0 || strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Caminho de socket inválido: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, DAEMON_BACKLOG) != 0) {
+        fprintf(stderr, "Não foi possível escutar em %s\n", socket_path);
+        close(listen_fd);
+        return 1;
+    }
+    
+    DaemonServer server = {0};
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.available, NULL);
+    
+    DaemonWorkerArgs *worker_args = malloc(pool_size * sizeof(DaemonWorkerArgs));
+    for (int w = 0; w < pool_size; w++) {
+        pthread_t thread;
+        worker_args[w].server = &server;
+        worker_args[w].ctx = contexts[w];
+        pthread_create(&thread, NULL, daemon_worker, &worker_args[w]);
+        pthread_detach(thread);
+    }
+    
+    while (true) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) continue;
+            break;
+        }
+        DaemonConnection *conn = calloc(1, sizeof(DaemonConnection));
+        conn->fd = client_fd;
+        conn->references = 2;
+        conn->reading = true;
+        pthread_mutex_init(&conn->lock, NULL);
+        pthread_cond_init(&conn->changed, NULL);
+        
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, daemon_writer, conn) != 0) {
+            daemon_connection_release(conn);
+            daemon_connection_release(conn);
+            continue;
+        }
+        pthread_detach(thread);
+        DaemonReaderArgs *reader_args = malloc(sizeof(DaemonReaderArgs));
+        reader_args->server = &server;
+        reader_args->conn = conn;
+        if (pthread_create(&thread, NULL, daemon_reader, reader_args) != 0) {
+            free(reader_args);
+            daemon_reader_done(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    
+    fprintf(stderr, "Erro ao aceitar conexões em %s\n", socket_path);
+    close(listen_fd);
+    return 1;
+}
+
+static void print_usage(const char *program) {
+    printf("Uso: %s [opções] [arquivo|diretório ...]\n", program);
+    printf("Sem caminhos, analisa os arquivos de ./data\n\n");
+    printf("  -r, --recursive        entra nos subdiretórios, sem seguir links para diretórios\n");
+    printf("  --files0-from=LISTA    lê caminhos separados por NUL de LISTA ('-' = stdin)\n");
+    printf("  -j N, --jobs=N         número de threads (padrão: núcleos disponíveis)\n");
+    printf("  --function-jobs=N      threads para os corpos de função de cada arquivo (padrão:\n");
+    printf("                         os núcleos que sobram das threads de arquivos)\n");
+    printf("  --sort=input|path      ordem dos relatórios na saída\n");
+    printf("  --report=full|diagnostics|summary\n");
+    printf("                         relatório completo, só erros e avisos ou só contagens\n");
+    printf("  --window=N             relatórios prontos que podem aguardar a vez (padrão: o\n");
+    printf("                         que a ordem do maior para o menor pede, de %d a %d)\n",
+           DEFAULT_REORDER_WINDOW, MAX_REORDER_WINDOW);
+    printf("  --format=text|ndjson|binary\n");
+    printf("                         texto, um objeto JSON por linha ou registros binários\n");
+    printf("  --max-errors=N         relata no máximo N erros por arquivo (padrão 0, sem limite);\n");
+    printf("                         depois de cada erro a análise continua no próximo comando\n");
+    printf("  --max-diagnostics=N    escreve no máximo N diagnósticos por arquivo (padrão 0, sem\n");
+    printf("                         limite); dos demais fica só a contagem por código. O\n");
+    printf("                         relatório completo lista todos\n");
+    printf("  --cache-dir=DIR        guarda tokens e resultados de cada conteúdo em DIR e os\n");
+    printf("                         reaproveita nas próximas execuções\n");
+    printf("  --reader=uring|pread|none\n");
+    printf("                         leitura antecipada dos arquivos (padrão uring, com pread\n");
+    printf("                         quando o kernel não tem io_uring) ou leitura por thread\n");
+    printf("  --pipeline             leitura, lexer e análise em etapas com uma thread cada;\n");
+    printf("                         mostra em stderr a ocupação das filas entre as etapas\n");
+    printf("  --project              confere as chamadas contra as funções de primeiro nível de\n");
+    printf("                         todos os arquivos da entrada, não só as do próprio arquivo\n");
+    printf("  --stats                mostra em stderr o tempo de cada fase por arquivo e, com\n");
+    printf("                         perf_event_open, ciclos, instruções, falhas de cache e\n");
+    printf("                         desvios errados, além da vazão em bytes/s e tokens/s\n");
+    printf("  --watch                continua rodando e analisa de novo os arquivos alterados\n");
+    printf("  --daemon=SOCKET        atende pedidos de análise pelo socket Unix SOCKET\n");
+    printf("  -h, --help             mostra esta ajuda\n");
+}
+
+#ifndef ANALYZER_NO_MAIN
+int main(int argc, char **argv) {
+    OutputOrder output_order = ORDER_INPUT;
+    int window = 0; // Calculada para cada lote
+    Verbosity verbosity = VERBOSITY_TOKENS;
+    OutputFormat format = FORMAT_TEXT;
+    const char *cache_dir = NULL;
+    int max_errors = 0;
+    int max_diagnostics = 0;
+    long function_jobs = 0;
+    bool watch = false;
+    bool project = false;
+    ReaderMode reader = READER_URING;
+    bool pipeline = false;
+    bool stats = false;
+    const char *daemon_socket = NULL;
+    long num_workers = 0;
+    bool recursive = false;
+    const char *files0_from = NULL;
+    int first_path = argc;
+
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--") == 0) {
+            first_path = a + 1;
+            break;
+        } else if (strcmp(argv[a], "-r") == 0 || strcmp(argv[a], "--recursive") == 0) {
+            recursive = true;
+        } else if (strncmp(argv[a], "--files0-from=", 14) == 0) {
+            files0_from = argv[a] + 14;
+        } else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc && atol(argv[a + 1]) > 0) {
+            num_workers = atol(argv[++a]);
+        } else if (strncmp(argv[a], "--jobs=", 7) == 0 && atol(argv[a] + 7) > 0) {
+            num_workers = atol(argv[a] + 7);
+        } else if (strncmp(argv[a], "--function-jobs=", 16) == 0 && atol(argv[a] + 16) > 0) {
+            function_jobs = atol(argv[a] + 16);
+        } else if (strcmp(argv[a], "--sort=input") == 0) {
+            output_order = ORDER_INPUT;
+        } else if (strcmp(argv[a], "--sort=path") == 0) {
+            output_order = ORDER_PATH;
+        } else if (strncmp(argv[a], "--window=", 9) == 0 && atoi(argv[a] + 9) > 0) {
+            window = atoi(argv[a] + 9);
+        } else if (strcmp(argv[a], "--report=full") == 0) {
+            verbosity = VERBOSITY_TOKENS;
+        } else if (strcmp(argv[a], "--report=diagnostics") == 0) {
+            verbosity = VERBOSITY_DIAGNOSTICS;
+        } else if (strcmp(argv[a], "--report=summary") == 0) {
+            verbosity = VERBOSITY_SUMMARY;
+        } else if (strcmp(argv[a], "--format=text") == 0) {
+            format = FORMAT_TEXT;
+        } else if (strcmp(argv[a], "--format=ndjson") == 0) {
+            format = FORMAT_NDJSON;
+        } else if (strcmp(argv[a], "--format=binary") == 0) {
+            format = FORMAT_BINARY;
+        } else if (strncmp(argv[a], "--max-errors=", 13) == 0 && atoi(argv[a] + 13) >= 0) {
+            max_errors = atoi(argv[a] + 13);
+        } else if (strncmp(argv[a], "--max-diagnostics=", 18) == 0 && atoi(argv[a] + 18) >= 0) {
+            max_diagnostics = atoi(argv[a] + 18);
+        } else if (strncmp(argv[a], "--cache-dir=", 12) == 0 && argv[a][12] != '\0') {
+            cache_dir = argv[a] + 12;
+        } else if (strcmp(argv[a], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[a], "--pipeline") == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[a], "--project") == 0) {
+            project = true;
+        } else if (strcmp(argv[a], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[a], "--reader=uring") == 0) {
+            reader = READER_URING;
+        } else if (strcmp(argv[a], "--reader=pread") == 0) {
+            reader = READER_PREAD;
+        } else if (strcmp(argv[a], "--reader=none") == 0) {
+            reader = READER_NONE;
+        } else if (strncmp(argv[a], "--daemon=", 9) == 0 && argv[a][9] != '\0') {
+            daemon_socket = argv[a] + 9;
+        } else if (strcmp(argv[a], "-h") == 0 || strcmp(argv[a], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[a][0] == '-' && argv[a][1] != '\0') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            first_path = a;
+            break;
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers <= 0) num_workers = cores;
+    if (num_workers < 1) num_workers = 1;
+    if (cache_dir != NULL && mkdir(cache_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Não foi possível criar o diretório de cache %s; seguindo sem cache\n", cache_dir);
+        cache_dir = NULL;
+    }
+
+    // O índice do projeto é montado uma vez, antes da análise: não acompanha
+    // arquivos que mudam depois
+    if (project && (watch || daemon_socket != NULL)) {
+        fprintf(stderr, "--project não pode ser usado com --watch nem com --daemon\n");
+        return 1;
+    }
+    if (stats && daemon_socket != NULL) {
+        fprintf(stderr, "--stats não pode ser usado com --daemon\n");
+        return 1;
+    }
+
+    // No daemon os relatórios vão sempre em NDJSON
+    if (daemon_socket != NULL) {
+        AnalysisContext **contexts = create_context_pool(num_workers, verbosity, FORMAT_NDJSON, cache_dir, max_errors, max_diagnostics,
+                                                          function_jobs > 0 ? function_jobs : 1);
+        return run_daemon(daemon_socket, contexts, num_workers);
+    }
+
+    // Monta a lista de arquivos com seus tamanhos antes de escalonar o lote
+    InputList inputs = {0};
+    bool inputs_ok = true;
+    for (int a = first_path; a < argc; a++) {
+        if (!collect_path(&inputs, argv[a], recursive)) inputs_ok = false;
+    }
+    int files0_start = inputs.count;
+    if (files0_from != NULL) {
+        if (!collect_files0(&inputs, files0_from, recursive)) inputs_ok = false;
+    }
+    if (first_path >= argc && files0_from == NULL) {
+        if (!collect_directory(&inputs, "./data", recursive)) {
+            printf("Não foi possível abrir o diretório ./data\n");
+            return 1;
+        }
+    }
+
+    BatchFile *files = inputs.files;
+    int count = inputs.count;
+
+    // Pool de tamanho fixo: por padrão uma thread por núcleo disponível.
+    // Sem --watch não adianta ter mais threads que arquivos.
+    if (!watch && num_workers > count) num_workers = count > 0 ? count : 1;
+    // Núcleos que as threads de arquivos não usam vão para os corpos de
+    // função: um arquivo só, grande, ocupa a máquina toda
+    if (function_jobs <= 0) function_jobs = cores / num_workers;
+    if (function_jobs < 1) function_jobs = 1;
+
+    AnalysisContext **contexts = create_context_pool(num_workers, verbosity, format, cache_dir, max_errors, max_diagnostics, function_jobs);
+
+    // Os watches são criados antes da primeira análise, para que nenhuma
+    // alteração feita durante ela se perca (o lote reordena files)
+    WatchSet set = {0};
+    if (watch) {
+        set.fd = inotify_init1(IN_CLOEXEC);
+        set.recursive = recursive;
+        if (set.fd < 0) {
+            fprintf(stderr, "Não foi possível iniciar o inotify\n");
+            return 1;
+        }
+        for (int a = first_path; a < argc; a++) {
+            watch_path(&set, argv[a]);
+        }
+        // Caminhos da lista NUL são observados um a um
+        for (int i = files0_start; files0_from != NULL && i < count; i++) {
+            watch_file(&set, files[i].path);
+        }
+        if (first_path >= argc && files0_from == NULL) {
+            watch_directory(&set, "./data");
+        }
+    }
+
+    // Primeira fase do modo projeto, antes de o lote reordenar a lista
+    ProjectIndex project_index;
+    if (project) {
+        project_index_init(&project_index);
+        build_project_index(&project_index, files, count, contexts, num_workers);
+        for (long w = 0; w < num_workers; w++) {
+            contexts[w]->project = &project_index;
+        }
+    }
+
+    BatchOptions options = {output_order, window, verbosity, format, reader, max_errors, max_diagnostics, function_jobs,
+                            project ? &project_index : NULL, stats};
+    if (format == FORMAT_BINARY) write_binary_header(stdout);
+    if (pipeline) {
+        run_pipeline(files, count, &options, cache_dir);
+    } else {
+        run_batch(files, count, contexts, num_workers, &options);
+    }
+
+    if (watch) {
+        fflush(stdout);
+        watch_loop(&set, contexts, num_workers, &options);
+        watch_set_destroy(&set);
+    }
+
+    for (long w = 0; w < num_workers; w++) {
+        free_analysis_context(contexts[w]);
+    }
+    free(contexts);
+    if (project) project_index_destroy(&project_index);
+    for (int i = 0; i < count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+    return inputs_ok ? 0 : 1;
+}
+#endif